@@ -0,0 +1,130 @@
+/**
+ * @file activation.hpp
+ * @brief The activation function (the logistic sigmoid), which can be
+ * calculated exactly or approximated, applied to a whole layer at once.
+ */
+
+#ifndef __ACTIVATION_HPP
+#define __ACTIVATION_HPP
+
+#include <math.h>
+
+#include "kernels.hpp"
+
+/**
+ * Logistic sigmoid function, which is our activation function
+ */
+
+inline double sigmoid(double x){
+    return 1.0/(1.0+exp(-x));
+}
+
+/**
+ * The derivative of the sigmoid function
+ */
+
+inline double sigmoidDiff(double x){
+    double s = sigmoid(x);
+    return (1.0-s)*s;
+}
+
+/**
+ * Single precision logistic sigmoid function, for float networks
+ */
+
+inline float sigmoid(float x){
+    return 1.0f/(1.0f+expf(-x));
+}
+
+/**
+ * \brief How the sigmoid is calculated when running a network, set
+ * with Net::setSigmoidMode(). The maximum absolute errors given are
+ * those measured against the double sigmoid() over [-100,100], at every
+ * kernel level, and are checked by the sigmoidmodes test.
+ */
+enum class SigmoidMode {
+    /// \brief using the library exp(), one node at a time
+    EXACT,
+    /// \brief using a polynomial approximation of exp() (see
+    /// scalarKernels::sigmoidPoly()), vectorised across the layer.
+    /// The maximum error is \f$3\times 10^{-15}\f$ in double and
+    /// \f$10^{-7}\f$ in float (about the same as the exact float version).
+    POLY,
+    /// \brief linear interpolation in a table of 4096 intervals over
+    /// [-16,16], with the ends used outside that range. The maximum
+    /// error is \f$10^{-6}\f$.
+    TABLE
+};
+
+/**
+ * \brief The lookup table for SigmoidMode::TABLE, of which there is one
+ * for each scalar type, built when first used.
+ */
+template <class T> class SigmoidTable {
+public:
+    static const int SIZE=4096; //!< number of intervals in the table
+    static const int RANGE=16; //!< the table covers [-RANGE,RANGE]
+
+    /**
+     * \brief get the table, building it if required
+     */
+    static const SigmoidTable& get(){
+        static SigmoidTable t;
+        return t;
+    }
+
+    /**
+     * \brief sigmoid of each element of a vector, in place
+     * \param x vector
+     * \param n length of vector
+     */
+    void apply(T *x,int n) const {
+        const T scale = (T)SIZE/(T)(2*RANGE);
+        for(int i=0;i<n;i++){
+            // position in the table, clamped to the ends
+            T t = (x[i]+(T)RANGE)*scale;
+            t = t<0 ? 0 : (t>(T)SIZE ? (T)SIZE : t);
+            int j = (int)t;
+            if(j>=SIZE)j=SIZE-1;
+            T f = t-(T)j;
+            x[i] = tab[j]+f*(tab[j+1]-tab[j]);
+        }
+    }
+
+private:
+    T tab[SIZE+1]; //!< sigmoid at each end of each interval
+
+    /**
+     * \brief private constructor, which fills in the table
+     */
+    SigmoidTable(){
+        for(int i=0;i<=SIZE;i++){
+            double x = (double)i*(2.0*RANGE)/(double)SIZE - RANGE;
+            tab[i] = (T)sigmoid(x);
+        }
+    }
+};
+
+/**
+ * \brief apply the sigmoid to each element of a vector (typically the
+ * weighted sums for a layer) in place.
+ * \param m how to calculate the sigmoid
+ * \param x vector
+ * \param n length of vector
+ */
+template <class T> void activate(SigmoidMode m,T *x,int n){
+    switch(m){
+    case SigmoidMode::POLY:
+        vecSigmoidPoly(x,n);
+        break;
+    case SigmoidMode::TABLE:
+        SigmoidTable<T>::get().apply(x,n);
+        break;
+    default:
+        for(int i=0;i<n;i++)
+            x[i] = sigmoid(x[i]);
+        break;
+    }
+}
+
+#endif /* __ACTIVATION_HPP */
@@ -0,0 +1,213 @@
+/**
+ * @file benchmark.cpp
+ * @brief Time training and running networks on the same problems as the
+ * tests - addition, XOR/AND modulation and MNIST - with each of the ways
+ * of calculating the sigmoid (see SigmoidMode), and compare how many
+ * iterations each Optimizer takes to train them to a given error. Also
+ * time ALTERNATE shuffles of example sets of different sizes.
+ *
+ * Run it from the build directory, or give the directory holding the
+ * MNIST data as an argument.
+ */
+
+#include <chrono>
+#include <string>
+
+#include "netFactory.hpp"
+
+/** \brief number of iterations to train the addition and boolean networks for */
+#define SMALL_ITERATIONS 1000000
+
+/** \brief number of iterations to train the MNIST networks for (one epoch) */
+#define MNIST_ITERATIONS 60000
+
+/** \brief number of times to run the test set through each network */
+#define RUN_REPEATS 20
+
+/**
+ * \brief the sigmoid modes to compare, and their names
+ */
+static const SigmoidMode modes[] = {
+    SigmoidMode::EXACT,SigmoidMode::POLY,SigmoidMode::TABLE};
+static const char *modeNames[] = {"exact","poly","table"};
+
+/**
+ * \brief the optimizers to compare, and their names
+ */
+static const Optimizer optimizers[] = {
+    Optimizer::SGD,Optimizer::MOMENTUM,Optimizer::NESTEROV,
+    Optimizer::RMSPROP,Optimizer::ADAM};
+static const char *optimizerNames[] = {"sgd","momentum","nesterov","rmsprop","adam"};
+
+/**
+ * \brief get the time in seconds since some arbitrary point
+ */
+static double now(){
+    return std::chrono::duration<double>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+/**
+ * \brief Train a new network of a given type on a set of examples in each
+ * sigmoid mode, and print the time taken, the training rate and the MSE.
+ * The networks are then run over the examples a number of times with
+ * runBatch(), and the rate printed.
+ * \param batchSize the number of examples in each batch
+ */
+template <class T> void bench(const char *name,NetType tp,ExampleSetT<T>& e,
+                              int hnodes,int iterations,double eta,int batchSize=1){
+    for(int m=0;m<3;m++){
+        NetT<T> *n = NetFactory::makeNet(tp,e,hnodes);
+        n->setSigmoidMode(modes[m]);
+        typename NetT<T>::SGDParams params(eta,iterations);
+        params.setSeed(0).setBatchSize(batchSize);
+
+        double t0 = now();
+        double mse = n->trainSGD(e,params);
+        double t1 = now();
+
+        T *outs = new T[e.getCount()*e.getOutputCount()];
+        for(int i=0;i<RUN_REPEATS;i++)
+            n->runBatch(e,0,e.getCount(),outs);
+        double t2 = now();
+        delete [] outs;
+
+        printf("%-16s %-6s %8.3fs %12.0f ex/s train %12.0f ex/s run  mse %f\n",
+               name,modeNames[m],t1-t0,
+               iterations/(t1-t0),
+               (double)e.getCount()*RUN_REPEATS/(t2-t1),
+               mse);
+        delete n;
+    }
+}
+
+/**
+ * \brief Train a new network of a given type on a set of examples with each
+ * optimizer, stopping when the error reaches a target (see
+ * Net::SGDParams::setStopError()), and print the number of iterations and
+ * time taken. The error is checked at the end of each epoch, or on a
+ * cross-validation slice every 1000 iterations if there is cross-validation.
+ * \param etas the learning rate for each optimizer
+ * \param cv proportion of the examples to cross-validate on, or 0
+ */
+template <class T> void benchOptimizers(const char *name,NetType tp,ExampleSetT<T>& e,
+                                        int hnodes,int batchSize,int iterations,
+                                        const double *etas,double target,double cv=0){
+    for(int o=0;o<5;o++){
+        NetT<T> *n = NetFactory::makeNet(tp,e,hnodes);
+        typename NetT<T>::SGDParams params(etas[o],iterations);
+        params.setSeed(0).setBatchSize(batchSize).setStopError(target)
+              .setOptimizer(optimizers[o]);
+        if(tp==NetType::UESMANN)
+            params.setShuffle(ExampleSet::ALTERNATE);
+        if(cv>0)
+            params.crossValidationManual(5,(int)(e.getCount()*cv/5),1000);
+        
+        double t0 = now();
+        double mse = n->trainSGD(e,params);
+        double t1 = now();
+        
+        char iters[32];
+        if(params.stoppedAt<iterations)
+            sprintf(iters,"%d",params.stoppedAt);
+        else
+            sprintf(iters,"not reached");
+        printf("%-16s %-9s %8g %12s %8.3fs  mse %f\n",
+               name,optimizerNames[o],etas[o],iters,t1-t0,mse);
+        delete n;
+    }
+}
+
+/**
+ * \brief Time shuffling example sets with ExampleSet::ALTERNATE at each of
+ * a number of sizes and modulator levels, both with the same number of
+ * examples at each level and with the first level twice as common as the
+ * others, and print the time per shuffle.
+ */
+static void benchAlternate(){
+    static const int sizes[] = {1000,10000,100000,500000};
+    static const int levels[] = {2,4,8};
+    printf("\n%-16s %8s %8s %12s %12s\n","test","examples","levels","balanced","unbalanced");
+    for(int n: sizes){
+        for(int l: levels){
+            double t[2];
+            for(int unbalanced=0;unbalanced<2;unbalanced++){
+                ExampleSet e(n,1,1,l);
+                for(int i=0;i<n;i++){
+                    int level = i%(l+unbalanced);
+                    if(level==l)level=0;
+                    e.setH(i,(double)level/(l-1));
+                }
+                drand48_data rd;
+                srand48_r(0,&rd);
+                int reps = 2000000/n;
+                double t0 = now();
+                for(int r=0;r<reps;r++)
+                    e.shuffle(&rd,ExampleSet::ALTERNATE);
+                t[unbalanced] = (now()-t0)/reps;
+            }
+            printf("%-16s %8d %8d %11.6fs %11.6fs\n","alternate",n,l,t[0],t[1]);
+        }
+    }
+}
+
+/**
+ * \brief The main function for the benchmark
+ */
+int main(int argc,char *argv[]){
+    std::string dir = argc>1 ? argv[1] : "../testdata";
+
+    // addition: 1000 examples of a+b, a and b in [0,0.5)
+    ExampleSet add(1000,2,1,1);
+    drand48_data rd;
+    srand48_r(10,&rd);
+    for(int i=0;i<1000;i++){
+        double a,b;
+        drand48_r(&rd,&a);a*=0.5;
+        drand48_r(&rd,&b);b*=0.5;
+        add.getInputs(i)[0] = a;
+        add.getInputs(i)[1] = b;
+        *add.getOutputs(i) = a+b;
+    }
+
+    // XOR at h=0, AND at h=1, alternating
+    ExampleSet xorand(8,2,1,2);
+    for(int i=0;i<4;i++){
+        int a = i>>1;
+        int b = i&1;
+        for(int h=0;h<2;h++){
+            int idx = i*2+h;
+            xorand.getInputs(idx)[0] = a;
+            xorand.getInputs(idx)[1] = b;
+            *xorand.getOutputs(idx) = h ? (a&b) : (a^b);
+            xorand.setH(idx,h);
+        }
+    }
+
+    MNIST m((dir+"/train-labels-idx1-ubyte").c_str(),
+            (dir+"/train-images-idx3-ubyte").c_str());
+    ExampleSet mnist(m);
+    ExampleSetT<float> mnistf(m);
+    ExampleSet mnistc(m,ExampleSet::COMPACT);
+
+    printf("%-16s %-6s %9s %20s %20s\n","test","mode","time","training","running");
+    bench("addition",NetType::PLAIN,add,2,SMALL_ITERATIONS,1);
+    bench("xor/and ues",NetType::UESMANN,xorand,2,SMALL_ITERATIONS,0.1);
+    bench("mnist",NetType::PLAIN,mnist,16,MNIST_ITERATIONS,0.1);
+    bench("mnist float",NetType::PLAIN,mnistf,16,MNIST_ITERATIONS,0.1);
+    bench("mnist batch 16",NetType::PLAIN,mnist,16,MNIST_ITERATIONS,1,16);
+    bench("mnist compact 16",NetType::PLAIN,mnistc,16,MNIST_ITERATIONS,1,16);
+    
+    // iterations to reach a target error; the momentum methods take steps
+    // of about 1/(1-beta1) times the gradient, so get a tenth of the rate
+    static const double addEtas[] = {1,0.1,0.1,0.01,0.01};
+    static const double xorandEtas[] = {0.1,0.01,0.01,0.01,0.01};
+    static const double mnistEtas[] = {1,0.1,0.1,0.005,0.005};
+    printf("\n%-16s %-9s %8s %12s %9s\n","test","optimizer","eta","iterations","time");
+    benchOptimizers("addition",NetType::PLAIN,add,2,1,SMALL_ITERATIONS,addEtas,0.0005);
+    benchOptimizers("xor/and ues",NetType::UESMANN,xorand,2,1,SMALL_ITERATIONS,xorandEtas,0.01);
+    benchOptimizers("mnist batch 16",NetType::PLAIN,mnist,16,16,10*MNIST_ITERATIONS,
+                    mnistEtas,0.012,0.1);
+    benchAlternate();
+    return 0;
+}
@@ -8,37 +8,39 @@
 #define __BPNET_HPP
 
 #include "net.hpp"
+#include "kernels.hpp"
 
 /**
  * \brief The "basic" back-propagation network using a logistic sigmoid,
  * as described by Rumelhart, Hinton and Williams (and many others).
  * This class is used by output blending and h-as-input networks.
+ * BPNet is the double version.
  */
 
-class BPNet : public Net {
+template <class T> class BPNetT : public NetT<T> {
 protected:
     /**
      * \brief Special constructor for subclasses which need to manipulate layer
      * count before initialisation (e.g. HInputNet).
      */
-    BPNet() : Net (NetType::PLAIN) {
+    BPNetT() : NetT<T> (NetType::PLAIN) {
     }
     
     /**
      * \brief Initialiser for use by the main constructor and the ctors of those
-     * subclasses mentioned in BPNet()
+     * subclasses mentioned in BPNetT()
      */
     
     void init(int nlayers,const int *layerCounts){
         numLayers = nlayers;
-        outputs = new double* [numLayers];
-        errors = new double* [numLayers];
+        outputs = new T* [numLayers];
+        errors = new T* [numLayers];
         layerSizes = new int [numLayers];
         largestLayerSize=0;
         for(int i=0;i<numLayers;i++){
             int n = layerCounts[i];
-            outputs[i] = new double[n];
-            errors[i] = new double[n];
+            outputs[i] = new T[n];
+            errors[i] = new T[n];
             for(int k=0;k<n;k++)
                 outputs[i][k]=0;
             layerSizes[i]=n;
@@ -46,18 +48,134 @@ protected:
                 largestLayerSize=n;
         }
         
-        weights = new double * [numLayers];
-        gradAvgsWeights = new double* [numLayers];
-        biases = new double* [numLayers];
-        gradAvgsBiases = new double* [numLayers];
+        // weights are stored as exact-size per-layer matrices, all held
+        // in a single block followed by the biases of each layer (and the
+        // same for their gradients). The input layer has no incoming weights,
+        // so its weight pointers are NULL.
+        numWeights=0;
+        numParams=0;
         for(int i=0;i<numLayers;i++){
-            int n = layerCounts[i];
-            weights[i] = new double[largestLayerSize*largestLayerSize];
-            gradAvgsWeights[i] = new double[largestLayerSize*largestLayerSize];
-            biases[i] = new double[n];
-            gradAvgsBiases[i] = new double[n];
+            if(i)
+                numWeights += layerSizes[i]*layerSizes[i-1];
+            numParams += layerSizes[i];
+        }
+        numParams += numWeights;
+        paramBlock = new T[numParams];
+        gradAvgsBlock = new T[numParams];
+        
+        weights = new T * [numLayers];
+        gradAvgsWeights = new T* [numLayers];
+        biases = new T* [numLayers];
+        gradAvgsBiases = new T* [numLayers];
+        T *w = paramBlock;
+        T *g = gradAvgsBlock;
+        for(int i=1;i<numLayers;i++){
+            weights[i] = w;
+            gradAvgsWeights[i] = g;
+            w += layerSizes[i]*layerSizes[i-1];
+            g += layerSizes[i]*layerSizes[i-1];
+        }
+        weights[0] = NULL;
+        gradAvgsWeights[0] = NULL;
+        for(int i=0;i<numLayers;i++){
+            biases[i] = w;
+            gradAvgsBiases[i] = g;
+            w += layerSizes[i];
+            g += layerSizes[i];
         }
+        
+        // batch buffers are allocated when we first train a batch
+        batchCapacity = 0;
+        batchOutputs = new T* [numLayers];
+        batchErrors = new T* [numLayers];
+        for(int i=0;i<numLayers;i++){
+            batchOutputs[i] = NULL;
+            batchErrors[i] = NULL;
+        }
+        batchHFactors = NULL;
+        sharedParams = false;
+        batchWorkers = NULL;
+        optimizerState = NULL;
     }        
+    
+    /**
+     * \brief Make this network use the weights and biases of another of the
+     * same shape rather than its own, keeping its own working storage; used
+     * to make workers for multithreaded training (see makeWorker()).
+     */
+    void shareParams(BPNetT *master){
+        delete [] paramBlock;
+        paramBlock = master->paramBlock;
+        for(int i=0;i<numLayers;i++){
+            biases[i] = master->biases[i];
+            weights[i] = master->weights[i];
+        }
+        sharedParams = true;
+        this->sigmoidMode = master->sigmoidMode;
+    }
+    
+    virtual NetT<T> *makeWorker(){
+        // subclasses (other than those which are just plain networks)
+        // must make their own workers
+        if(this->type!=NetType::PLAIN)
+            return NULL;
+        BPNetT *w = new BPNetT(numLayers,layerSizes);
+        w->shareParams(this);
+        return w;
+    }
+    
+    virtual T *getParamBlock(int& n) const {
+        n = numParams;
+        return paramBlock;
+    }
+    
+    virtual NetT<T> *makeSimilar() const {
+        // as makeWorker(), subclasses must make their own
+        if(this->type!=NetType::PLAIN)
+            return NULL;
+        return new BPNetT(numLayers,layerSizes);
+    }
+    
+    virtual bool startBatchThreads(int n){
+        stopBatchThreads();
+        batchWorkers = new BatchWorkers(n);
+        // this network deals with the first shard of each batch
+        batchWorkers->nets.push_back(this);
+        for(int k=1;k<n;k++){
+            NetT<T> *w = makeWorker();
+            if(!w){
+                stopBatchThreads();
+                return false;
+            }
+            // workers are always made by a BPNet subclass
+            batchWorkers->nets.push_back(static_cast<BPNetT *>(w));
+        }
+        batchWorkers->errors.resize(n);
+        return true;
+    }
+    
+    virtual void stopBatchThreads(){
+        if(batchWorkers){
+            for(size_t k=1;k<batchWorkers->nets.size();k++)
+                delete batchWorkers->nets[k];
+            delete batchWorkers;
+            batchWorkers = NULL;
+        }
+    }
+    
+    virtual bool startOptimizer(const typename NetT<T>::SGDParams& params){
+        delete optimizerState;
+        optimizerState = NULL;
+        if(params.optimizer!=Optimizer::SGD)
+            optimizerState = new OptimizerStateT<T>(params.optimizer,numParams,
+                                                    params.beta1,params.beta2,
+                                                    params.epsilon);
+        return true;
+    }
+    
+    virtual OptimizerStateT<T> *getOptimizerState(){
+        return optimizerState;
+    }
         
 public:
     /**
@@ -66,7 +184,7 @@ public:
      * \param nlayers number of layers
      * \param layerCounts array of layer counts
      */
-    BPNet(int nlayers,const int *layerCounts) : Net(NetType::PLAIN) {
+    BPNetT(int nlayers,const int *layerCounts) : NetT<T>(NetType::PLAIN) {
         init(nlayers,layerCounts);
     }
     
@@ -83,15 +201,21 @@ public:
      * \brief destructor
      */
     
-    virtual ~BPNet(){
+    virtual ~BPNetT(){
+        stopBatchThreads();
+        delete optimizerState;
         for(int i=0;i<numLayers;i++){
-            delete [] weights[i];
-            delete [] biases[i];
-            delete [] gradAvgsWeights[i];
-            delete [] gradAvgsBiases[i];
             delete [] outputs[i];
             delete [] errors[i];
+            delete [] batchOutputs[i];
+            delete [] batchErrors[i];
         }
+        delete [] batchOutputs;
+        delete [] batchErrors;
+        delete [] batchHFactors;
+        if(!sharedParams)
+            delete [] paramBlock;
+        delete [] gradAvgsBlock;
         delete [] weights;
         delete [] biases;
         delete [] gradAvgsWeights;
@@ -101,7 +225,7 @@ public:
         delete [] layerSizes;
     }
     
-    virtual void setInputs(double *d) {
+    virtual void setInputs(T *d) {
         for(int i=0;i<layerSizes[0];i++){
             outputs[0][i]=d[i];
         }
@@ -112,12 +236,12 @@ public:
      * HInputNet.
      */
     
-    void setInput(int n, double d){
+    void setInput(int n, T d){
         outputs[0][n] = d;
     }
         
     
-    virtual double *getOutputs() const {
+    virtual T *getOutputs() const {
         return outputs[numLayers-1];
     }
     
@@ -148,8 +272,8 @@ public:
         return total;
     }
     
-    virtual void save(double *buf) const {
-        double *g=buf;
+    virtual void save(T *buf) const {
+        T *g=buf;
         // data is ordered by layers, with nodes within
         // layers, and each node is bias then weights.
         // 
@@ -167,8 +291,8 @@ public:
         }
     }
     
-    virtual void load(double *buf){
-        double *g=buf;
+    virtual void load(T *buf){
+        T *g=buf;
         // genome is ordered by layers, with nodes within
         // layers, and each node is bias then weights.
         // 
@@ -190,30 +314,79 @@ protected:
     int numLayers; //!< number of layers, including input and output
     int *layerSizes; //!< array of layer sizes
     int largestLayerSize; //!< number of nodes in largest layer
+    int numWeights; //!< total number of weights in all layers
+    int numParams; //!< total number of weights and biases in all layers
     
-    /// \brief Array of weights as [tolayer][tonode+largestLayerSize*fromnode]
+    /// \brief Array of weights as [tolayer][fromnode+layerSizes[tolayer-1]*tonode]
     ///
-    /// Weights are stored as a square matrix, even though less than
-    /// half is used. Less than that, if not all layers are the same
-    /// size, since the dimension of the matrix must be the size of
-    /// the largest layer. Each array has its own matrix,
-    /// so index by [layer][i+largestLayerSize*j], where
+    /// Each layer (other than the input layer, for which this is NULL)
+    /// has a matrix with a row for each node in that layer and a column
+    /// for each node in the previous layer, stored row by row so that
+    /// the incoming weights of each node are contiguous (see getwrow()).
+    /// Index by [layer][j+layerSizes[layer-1]*i], where
     /// - layer is the "TO" layer
     /// - layer-1 is the FROM layer
     /// - i is the TO neuron (i.e. the end of the connection)
     /// - j is the FROM neuron (the start)
-    double **weights;
+    ///
+    /// The matrices all live in paramBlock, one after another.
+    T **weights;
+    
+    /// \brief single allocation holding all the weight matrices followed by
+    /// the biases of each layer, numParams values in all
+    T *paramBlock;
+    
+    /// \brief true if the weights and biases belong to another network (see
+    /// shareParams()), in which case paramBlock is that network's.
+    bool sharedParams;
     
-    /// array of biases, stored as a rectangular array of [layer][node]
-    double **biases;
+    /// array of biases for each layer, held in paramBlock after the weights
+    T **biases;
     
     // data generated during training and running
     
-    double **outputs; //!< outputs of each layer: one array of doubles for each
-    double **errors; //!< the error for each node, calculated by calcError()
+    T **outputs; //!< outputs of each layer: one array of values for each
+    T **errors; //!< the error for each node, calculated by calcError()
+    
+    T **gradAvgsWeights; //!< average gradient for each weight (built during training)
+    T **gradAvgsBiases; //!< average gradient for each bias (built during training)
+    T *gradAvgsBlock; //!< single allocation holding all the gradients, laid out as paramBlock
+    
+    // data used when training a batch of examples at once
+    
+    int batchCapacity; //!< number of examples the batch buffers can hold
+    /// \brief outputs of each layer for each example in a batch, as
+    /// [layer][example*layerSizes[layer]+node]
+    T **batchOutputs;
+    /// \brief errors of each node for each example in a batch, laid out
+    /// as batchOutputs
+    T **batchErrors;
+    T *batchHFactors; //!< modFactor() for each example in a batch
+    
+    /**
+     * \brief The threads and worker networks used to split mini-batches
+     * across threads (see SGDParams::batchThreads).
+     */
+    struct BatchWorkers {
+        ThreadPool pool; //!< the threads
+        /// \brief a network for each shard of a batch, the first being the
+        /// network being trained and the rest workers sharing its parameters
+        std::vector<BPNetT *> nets;
+        std::vector<double> errors; //!< the total error of each shard
+        
+        /**
+         * \brief Constructor
+         * \param n number of threads
+         */
+        BatchWorkers(int n) : pool(n) {}
+    };
+    
+    /// \brief the batch threads if started with startBatchThreads(), or NULL
+    BatchWorkers *batchWorkers;
     
-    double **gradAvgsWeights; //!< average gradient for each weight (built during training)
-    double **gradAvgsBiases; //!< average gradient for each bias (built during training)
+    /// \brief the state of the optimizer set up by startOptimizer(), or NULL
+    /// for plain gradient descent
+    OptimizerStateT<T> *optimizerState;
     
     virtual void initWeights(double initr){
         for(int i=0;i<numLayers;i++){
@@ -227,16 +400,22 @@ protected:
             } else 
                 initrange = 0.1; // on input layer, should mean little.
             for(int j=0;j<layerSizes[i];j++)
-                biases[i][j]=drand(-initrange,initrange);
+                biases[i][j]=this->drand(-initrange,initrange);
+            // Weights used to be stored in square matrices of the largest
+            // layer size. We still draw a random number for every element of
+            // such a matrix (keeping only those which map onto a real weight)
+            // so that a given seed produces the same network as it always did.
             for(int j=0;j<largestLayerSize*largestLayerSize;j++){
-                weights[i][j]=drand(-initrange,initrange);
+                double w = this->drand(-initrange,initrange);
+                int to = j%largestLayerSize;
+                int from = j/largestLayerSize;
+                if(i && to<layerSizes[i] && from<layerSizes[i-1])
+                    getw(i,to,from)=w;
             }
         }
-        // zero the input layer weights, which should be unused.
+        // zero the input layer biases, which should be unused.
         for(int j=0;j<layerSizes[0];j++)
             biases[0][j]=0;
-        for(int j=0;j<largestLayerSize*largestLayerSize;j++)
-            weights[0][j]=0;
     }
     
     /**
@@ -246,8 +425,19 @@ protected:
      * \param fromneuron the index of the source node
      */
     
-    inline double& getw(int tolayer,int toneuron,int fromneuron) const {
-        return weights[tolayer][toneuron+largestLayerSize*fromneuron];
+    inline T& getw(int tolayer,int toneuron,int fromneuron) const {
+        return weights[tolayer][fromneuron+layerSizes[tolayer-1]*toneuron];
+    }
+    
+    /**
+     * \brief get a pointer to the incoming weights of a node, which are
+     * contiguous and indexed by the node in the previous layer.
+     * \param tolayer    the layer of the destination node
+     * \param toneuron   the index of the destination node in that layer
+     */
+    
+    inline T *getwrow(int tolayer,int toneuron) const {
+        return weights[tolayer]+layerSizes[tolayer-1]*toneuron;
     }
     
     /**
@@ -256,7 +446,7 @@ protected:
      * \param neuron  index of neuron within layer
      */
     
-    inline double& getb(int layer,int neuron) const {
+    inline T& getb(int layer,int neuron) const {
         return biases[layer][neuron];
     }
     
@@ -269,8 +459,19 @@ protected:
      * \param fromneuron the index of the source node
      */
     
-    inline double& getavggradw(int tolayer,int toneuron,int fromneuron) const {
-        return gradAvgsWeights[tolayer][toneuron+largestLayerSize*fromneuron];
+    inline T& getavggradw(int tolayer,int toneuron,int fromneuron) const {
+        return gradAvgsWeights[tolayer][fromneuron+layerSizes[tolayer-1]*toneuron];
+    }
+    
+    /**
+     * \brief get a pointer to the gradients of the incoming weights of a node,
+     * laid out in the same way as getwrow().
+     * \param tolayer    the layer of the destination node
+     * \param toneuron   the index of the destination node in that layer
+     */
+    
+    inline T *getavggradwrow(int tolayer,int toneuron) const {
+        return gradAvgsWeights[tolayer]+layerSizes[tolayer-1]*toneuron;
     }
     
     /**
@@ -280,7 +481,7 @@ protected:
      * \param n  index of neuron within layer
      */
     
-    inline double getavggradb(int l,int n) const {
+    inline T getavggradb(int l,int n) const {
         return gradAvgsBiases[l][n];
     }
     
@@ -291,7 +492,7 @@ protected:
      * \post the errors will be in the errors variable
      */
     
-    void calcError(double *in,double *out){
+    void calcError(T *in,T *out){
         // first run the network forwards
         setInputs(in);
         update();
@@ -299,92 +500,416 @@ protected:
         // first, calculate the error in the output layer
         int ol = numLayers-1;
         for(int i=0;i<layerSizes[ol];i++){
-            double o = outputs[ol][i];
+            T o = outputs[ol][i];
             errors[ol][i] = o*(1-o)*(o-out[i]);
         }
         
-        // then work out the errors in all the other layers
-        for(int l=1;l<numLayers-1;l++){
+        // then work out the errors in all the other layers, working
+        // backwards since each layer needs the errors of the next.
+        for(int l=numLayers-2;l>0;l--){
+            // sum the errors of the next layer weighted by the weights
+            // from each node in this layer: this is done a row of the
+            // next layer's weights at a time, so memory access is contiguous.
+            T *e = errors[l];
+            for(int j=0;j<layerSizes[l];j++)
+                e[j] = 0;
+            for(int i=0;i<layerSizes[l+1];i++)
+                vecAxpy(errors[l+1][i],getwrow(l+1,i),e,layerSizes[l]);
+            
             for(int j=0;j<layerSizes[l];j++){
-                double e = 0;
-                for(int i=0;i<layerSizes[l+1];i++)
-                    e += errors[l+1][i]*getw(l+1,i,j);
-                
                 // produce the \delta^l_i term where l is the layer and i
                 // the index of the node
-                errors[l][j] = e * outputs[l][j] * (1-outputs[l][j]); 
+                errors[l][j] = e[j] * outputs[l][j] * (1-outputs[l][j]); 
             }
         }
     }
     
     virtual void update(){
         for(int i=1;i<numLayers;i++){
+            // get the weighted sums for the layer, then apply the
+            // activation function to the whole layer
             for(int j=0;j<layerSizes[i];j++){
-                double v = biases[i][j];
-                for(int k=0;k<layerSizes[i-1];k++){
-                    v += getw(i,j,k) * outputs[i-1][k];
-                }
-                outputs[i][j]=sigmoid(v);
+                outputs[i][j] = biases[i][j] +
+                      vecDot(getwrow(i,j),outputs[i-1],layerSizes[i-1]);
             }
+            activate(this->sigmoidMode,outputs[i],layerSizes[i]);
         }
     }
     
-    virtual double trainBatch(ExampleSet& ex,int start,int num,double eta){
-        // zero average gradients
-        for(int j=0;j<numLayers;j++){
-            for(int k=0;k<layerSizes[j];k++)
-                gradAvgsBiases[j][k]=0;
-            for(int i=0;i<largestLayerSize*largestLayerSize;i++)
-                gradAvgsWeights[j][i]=0;
+    /**
+     * \brief Train on a single example, applying the delta rule directly
+     * from the errors and outputs without going through the gradient
+     * accumulators. This does the same thing as going through the
+     * accumulators with a single example, but we don't have to zero
+     * them every time. The weight update (see vecDelta()) rounds exactly
+     * as the accumulator path does, so with the scalar kernels (whose
+     * dot products also sum in order) the result is bit-identical.
+     * \param ex      example set
+     * \param idx     index of the example to use
+     * \param eta     learning rate
+     * \return        the sum of squared errors in the output layer
+     */
+    double trainSingle(ExampleSetT<T>& ex,int idx,double eta){
+        // set modulator
+        setH(ex.getH(idx));
+        // get outputs for this example
+        T *outs = ex.getOutputs(idx);
+        // build errors
+        calcError(ex.getInputs(idx),outs);
+        
+        // apply the errors to the weights and biases
+        for(int l=1;l<numLayers;l++){
+            for(int i=0;i<layerSizes[l];i++){
+                T e = errors[l][i];
+                // w -= eta*(e*o), rounded as the per-weight loop was
+                vecDelta((T)eta,e,(T)1,outputs[l-1],getwrow(l,i),layerSizes[l-1]);
+                biases[l][i] -= eta*e;
+            }
         }
         
-        // reset total error
+        // count up the total error
         double totalError=0;
-        // iterate over examples
-        for(int nn=0;nn<num;nn++){
-            int exampleIndex = nn+start;
-            // set modulator
-            setH(ex.getH(exampleIndex));
-            // get outputs for this example
-            double *outs = ex.getOutputs(exampleIndex);
-            // build errors for each example
-            calcError(ex.getInputs(exampleIndex),outs);
-            
-            // accumulate errors
-            for(int l=1;l<numLayers;l++){
-                for(int i=0;i<layerSizes[l];i++){
-                    for(int j=0;j<layerSizes[l-1];j++)
-                        getavggradw(l,i,j) += errors[l][i]*outputs[l-1][j];
-                    gradAvgsBiases[l][i] += errors[l][i];
-                }
-            }
-            // count up the total error
-            int ol = numLayers-1;
-            for(int i=0;i<layerSizes[ol];i++){
-                double o = outputs[ol][i];
-                double e = (o-outs[i]);
-                totalError += e*e;
+        int ol = numLayers-1;
+        for(int i=0;i<layerSizes[ol];i++){
+            T o = outputs[ol][i];
+            T e = (o-outs[i]);
+            totalError += e*e;
+        }
+        return totalError;
+    }
+    
+    /**
+     * \brief make sure the batch buffers can hold a given number of examples
+     */
+    void reserveBatch(int num){
+        if(num<=batchCapacity)
+            return;
+        for(int i=0;i<numLayers;i++){
+            delete [] batchOutputs[i];
+            delete [] batchErrors[i];
+            batchOutputs[i] = new T[num*layerSizes[i]];
+            batchErrors[i] = new T[num*layerSizes[i]];
+        }
+        delete [] batchHFactors;
+        batchHFactors = new T[num];
+        batchCapacity = num;
+    }
+    
+    /**
+     * \brief the factor by which the weights are multiplied at a given
+     * modulator level. This is 1 for an unmodulated network, and is overriden
+     * in UESNet.
+     */
+    virtual double modFactor(double h) const {
+        return 1.0;
+    }
+    
+    /**
+     * \brief write the input layer values for an example into a row of the
+     * batch input matrix - this is the batch equivalent of setInputs(),
+     * and is overriden in HInputNet.
+     * \param row the row to write, of layerSizes[0] values
+     * \param in the example inputs
+     * \param h the example modulator
+     */
+    virtual void setInputRow(T *row,const T *in,double h){
+        for(int i=0;i<layerSizes[0];i++)
+            row[i]=in[i];
+    }
+    
+    /**
+     * \brief write the input layer values for an example in a set into a row
+     * of the batch input matrix, as setInputRow(). The inputs of a COMPACT
+     * set are converted straight into the row.
+     * \param row the row to write, of layerSizes[0] values
+     * \param ex the example set
+     * \param idx index of the example
+     * \param h the example modulator
+     */
+    void setExampleRow(T *row,ExampleSetT<T>& ex,int idx,double h){
+        if(ex.getStorage()==ExampleSetBase::COMPACT){
+            ex.copyInputs(idx,row);
+            setInputRow(row,row,h);
+        } else
+            setInputRow(row,ex.getInputs(idx),h);
+    }
+    
+    /**
+     * \brief Run the network forwards on a whole batch of examples
+     * \pre batchOutputs[0] and batchHFactors filled in for the batch
+     * \post batchOutputs contains the outputs of every layer for every example
+     * \param num number of examples in the batch
+     */
+    void updateBatch(int num){
+        for(int l=1;l<numLayers;l++){
+            int n = layerSizes[l];
+            int nprev = layerSizes[l-1];
+            // the weighted sums for all the nodes for all the examples
+            matMulNT(num,n,nprev,
+                     batchOutputs[l-1],nprev,
+                     weights[l],nprev,
+                     batchOutputs[l],n);
+            // then modulate, add the biases and apply the activation function
+            for(int e=0;e<num;e++){
+                T *o = batchOutputs[l]+e*n;
+                T hfactor = batchHFactors[e];
+                for(int j=0;j<n;j++)
+                    o[j] = o[j]*hfactor+biases[l][j];
             }
+            activate(this->sigmoidMode,batchOutputs[l],num*n);
         }
+    }
+    
+    /**
+     * \brief the most examples runBatch() will put through updateBatch()
+     * at once, to limit the size of the batch buffers
+     */
+    static const int RUNBATCHCHUNK=256;
+    
+    /**
+     * \brief run the network forwards on a batch whose input matrix and
+     * factors are filled in, and copy out the output layer
+     * \param num number of examples in the batch
+     * \param out num rows of output layer values
+     */
+    void runBatchChunk(int num,T *out){
+        updateBatch(num);
+        int nout = layerSizes[numLayers-1];
+        T *o = batchOutputs[numLayers-1];
+        for(int i=0;i<num*nout;i++)
+            out[i] = o[i];
+    }
+    
+    /**
+     * \brief Train a batch of more than one example using matrix products
+     * across the entire batch. Each example's weight gradient is multiplied
+     * by its modFactor(), so this works for UESNet as well. Used by
+     * trainBatch(), see Net::trainBatch() for details.
+     */
+    double trainMiniBatch(ExampleSetT<T>& ex,int start,int num,double eta){
+        if(batchWorkers)
+            return trainMiniBatchThreaded(ex,start,num,eta);
+        
+        double totalError = batchGradients(ex,start,num);
+        // leave the modulator set as training one at a time would
+        setH(ex.getH(start+num-1));
         
         // for calculating average error - 1/number of examples trained
         double factor = 1.0/(double)num;
-        // we now have a full set of running averages. Time to apply them.
+        // apply the mean gradients, through the optimizer if there is one
+        if(optimizerState){
+            optimizerState->begin();
+            optimizerState->apply(paramBlock,gradAvgsBlock,factor,eta,0,numParams);
+            return totalError*factor;
+        }
         for(int l=1;l<numLayers;l++){
             for(int i=0;i<layerSizes[l];i++){
-                for(int j=0;j<layerSizes[l-1];j++){
-                    double wdelta = eta*getavggradw(l,i,j)*factor;
-//                    printf("WCORR: %f factor %f\n",wdelta,getavggradw(l,i,j));
-                    getw(l,i,j) -= wdelta;
-                }
-                double bdelta = eta*gradAvgsBiases[l][i]*factor;
+                vecAxpy((T)(-eta*factor),getavggradwrow(l,i),getwrow(l,i),
+                        layerSizes[l-1]);
+                T bdelta = eta*gradAvgsBiases[l][i]*factor;
                 biases[l][i] -= bdelta;
             }
         }
         // and return total error - this is the SUM of the MSE of each output
         return totalError*factor;
     }
+    
+    /**
+     * \brief Run a batch of examples forwards and backwards, and sum their
+     * gradients into gradAvgsWeights and gradAvgsBiases.
+     * \param ex example set
+     * \param start index of the first example
+     * \param num number of examples
+     * \return the total squared error of the outputs over the batch
+     */
+    double batchGradients(ExampleSetT<T>& ex,int start,int num){
+        reserveBatch(num);
+        
+        // build the input matrix
+        for(int e=0;e<num;e++){
+            int exampleIndex = start+e;
+            double h = ex.getH(exampleIndex);
+            batchHFactors[e] = modFactor(h);
+            setExampleRow(batchOutputs[0]+e*layerSizes[0],ex,exampleIndex,h);
+        }
+        // run forwards
+        updateBatch(num);
+        
+        // calculate the error in the output layer, and count up the total error
+        double totalError=0;
+        int ol = numLayers-1;
+        int nout = layerSizes[ol];
+        bool compact = ex.getStorage()==ExampleSetBase::COMPACT;
+        for(int e=0;e<num;e++){
+            // a COMPACT set gives a label, the index of the output which is 1
+            T *outs = compact ? NULL : ex.getOutputs(start+e);
+            int label = compact ? ex.getLabel(start+e) : -1;
+            T *o = batchOutputs[ol]+e*nout;
+            T *err = batchErrors[ol]+e*nout;
+            for(int i=0;i<nout;i++){
+                T y = outs ? outs[i] : (i==label ? 1 : 0);
+                err[i] = o[i]*(1-o[i])*(o[i]-y);
+                T d = (o[i]-y);
+                totalError += d*d;
+            }
+        }
+        
+        // then work backwards through the other layers
+        for(int l=ol-1;l>0;l--){
+            int n = layerSizes[l];
+            matMulNN(num,n,layerSizes[l+1],
+                     batchErrors[l+1],layerSizes[l+1],
+                     weights[l+1],n,
+                     batchErrors[l],n);
+            for(int e=0;e<num;e++){
+                T *o = batchOutputs[l]+e*n;
+                T *err = batchErrors[l]+e*n;
+                T hfactor = batchHFactors[e];
+                for(int j=0;j<n;j++)
+                    err[j] = err[j] * hfactor * o[j] * (1-o[j]);
+            }
+        }
+        
+        // sum the gradients over the batch
+        for(int i=0;i<numParams;i++)
+            gradAvgsBlock[i]=0;
+        for(int l=1;l<numLayers;l++){
+            int n = layerSizes[l];
+            int nprev = layerSizes[l-1];
+            matMulTNAcc(num,nprev,n,
+                        batchErrors[l],n,
+                        batchOutputs[l-1],nprev,
+                        batchHFactors,
+                        gradAvgsWeights[l],nprev);
+            for(int e=0;e<num;e++){
+                T *err = batchErrors[l]+e*n;
+                for(int i=0;i<n;i++)
+                    gradAvgsBiases[l][i] += err[i];
+            }
+        }
+        return totalError;
+    }
+    
+    /**
+     * \brief Add up arrays in a fixed order: a pairwise tree, so that the
+     * result is always the same for a given number of arrays.
+     * \param bufs the arrays, the first of which receives the sum
+     * \param n number of arrays
+     * \param from index of the first element to add
+     * \param to index after the last element to add
+     */
+    static void treeSum(T **bufs,int n,int from,int to){
+        for(int s=1;s<n;s*=2){
+            for(int k=0;k+s<n;k+=2*s){
+                T *a = bufs[k];
+                const T *b = bufs[k+s];
+                for(int i=from;i<to;i++)
+                    a[i] += b[i];
+            }
+        }
+    }
+    
+    /**
+     * \brief Train a mini-batch split across the batch threads, as
+     * trainMiniBatch() (see SGDParams::batchThreads).
+     */
+    double trainMiniBatchThreaded(ExampleSetT<T>& ex,int start,int num,double eta){
+        BatchWorkers *bw = batchWorkers;
+        // one shard for each thread, unless the batch is very small
+        int n = (int)bw->nets.size();
+        if(n>num)
+            n=num;
+        
+        // sum the gradients of each shard
+        for(int k=0,first=start;k<n;k++){
+            int count = num/n + (k<num%n ? 1 : 0);
+            bw->pool.submit([bw,k,&ex,first,count]{
+                bw->errors[k] = bw->nets[k]->batchGradients(ex,first,count);
+            });
+            first += count;
+        }
+        bw->pool.wait();
+        
+        // add the gradients into ours (the first shard's) and apply them,
+        // splitting the parameters into a range for each thread
+        double factor = 1.0/(double)num;
+        std::vector<T *> bufs(n);
+        for(int k=0;k<n;k++)
+            bufs[k] = bw->nets[k]->gradAvgsBlock;
+        int nthreads = bw->pool.getThreadCount();
+        if(optimizerState)
+            optimizerState->begin();
+        for(int r=0;r<nthreads;r++){
+            int from = (int)((long)numParams*r/nthreads);
+            int to = (int)((long)numParams*(r+1)/nthreads);
+            bw->pool.submit([this,&bufs,n,from,to,eta,factor]{
+                treeSum(bufs.data(),n,from,to);
+                if(optimizerState)
+                    optimizerState->apply(paramBlock,gradAvgsBlock,factor,eta,from,to);
+                else
+                    vecAxpy((T)(-eta*factor),gradAvgsBlock+from,
+                            paramBlock+from,to-from);
+            });
+        }
+        bw->pool.wait();
+        
+        // leave the modulator set as training one at a time would
+        setH(ex.getH(start+num-1));
+        
+        double totalError=0;
+        for(int k=0;k<n;k++)
+            totalError += bw->errors[k];
+        return totalError*factor;
+    }
+    
+public:
+    
+    virtual void runBatch(const T *in,const double *h,int num,T *out){
+        int nin = this->getInputCount();
+        int nout = this->getOutputCount();
+        double curh = getH();
+        for(int s=0;s<num;s+=RUNBATCHCHUNK){
+            int n = num-s < RUNBATCHCHUNK ? num-s : RUNBATCHCHUNK;
+            reserveBatch(n);
+            for(int e=0;e<n;e++){
+                double eh = h ? h[s+e] : curh;
+                batchHFactors[e] = modFactor(eh);
+                setInputRow(batchOutputs[0]+e*layerSizes[0],in+(s+e)*nin,eh);
+            }
+            runBatchChunk(n,out+s*nout);
+        }
+    }
+    
+    virtual void runBatch(ExampleSetT<T>& examples,int start,int num,T *out){
+        int nout = this->getOutputCount();
+        for(int s=0;s<num;s+=RUNBATCHCHUNK){
+            int n = num-s < RUNBATCHCHUNK ? num-s : RUNBATCHCHUNK;
+            reserveBatch(n);
+            for(int e=0;e<n;e++){
+                int idx = start+s+e;
+                double eh = examples.getH(idx);
+                batchHFactors[e] = modFactor(eh);
+                setExampleRow(batchOutputs[0]+e*layerSizes[0],examples,idx,eh);
+            }
+            runBatchChunk(n,out+s*nout);
+        }
+    }
+    
+protected:
+    
+    virtual double trainBatch(ExampleSetT<T>& ex,int start,int num,double eta){
+        // a single example (i.e. SGD) can skip the accumulators, unless
+        // the optimizer needs the gradients
+        if(num==1 && !optimizerState)
+            return trainSingle(ex,start,eta);
+        else
+            return trainMiniBatch(ex,start,num,eta);
+    }
 };
 
+/**
+ * \brief the double-precision plain backprop network
+ */
+typedef BPNetT<double> BPNet;
 
 #endif /* __BPNET_HPP */
@@ -0,0 +1,182 @@
+/**
+ * @file checkpoint.hpp
+ * @brief The files in which Net::trainSGD() saves the state of training,
+ * so that an interrupted run can be resumed (see
+ * Net::SGDParams::setCheckpoint()).
+ *
+ */
+
+#ifndef __CHECKPOINT_HPP
+#define __CHECKPOINT_HPP
+
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <string>
+#include <vector>
+#include <stdexcept>
+
+#include "threadPool.hpp"
+
+/** \brief magic number at the start of a checkpoint file */
+#define CHECKPOINT_MAGIC 0x504b4355
+
+/** \brief version of the checkpoint format, changed whenever the format does */
+#define CHECKPOINT_VERSION 1
+
+/**
+ * \brief A checkpoint as a block of bytes, built up with put() and read
+ * back in the same order with get(). The layout is that of the machine,
+ * so a checkpoint can only be resumed on the same kind of machine with
+ * the same build.
+ */
+class Checkpoint {
+public:
+    Checkpoint(){
+        pos=0;
+    }
+
+    /**
+     * \brief empty the checkpoint, ready to put() a new one
+     */
+    void clear(){
+        bytes.clear();
+        pos=0;
+    }
+
+    /**
+     * \brief append some bytes
+     * \param p the bytes
+     * \param n how many
+     */
+    void put(const void *p,size_t n){
+        const char *c = (const char *)p;
+        bytes.insert(bytes.end(),c,c+n);
+    }
+
+    /**
+     * \brief append a value, which must be of a plain (trivially copyable) type
+     */
+    template <class V> void put(const V& v){
+        put(&v,sizeof(V));
+    }
+
+    /**
+     * \brief read the next bytes
+     * \param p where to put them
+     * \param n how many
+     * \throws std::runtime_error if there aren't that many left
+     */
+    void get(void *p,size_t n){
+        if(pos+n>bytes.size())
+            throw std::runtime_error("checkpoint is truncated");
+        memcpy(p,bytes.data()+pos,n);
+        pos+=n;
+    }
+
+    /**
+     * \brief read the next value, as written by put()
+     */
+    template <class V> V get(){
+        V v;
+        get(&v,sizeof(V));
+        return v;
+    }
+
+    /**
+     * \brief read a checkpoint file
+     * \param fn the file name
+     * \return false if there is no such file
+     * \throws std::runtime_error if the file can't be read
+     */
+    bool read(const std::string& fn){
+        clear();
+        FILE *a = fopen(fn.c_str(),"rb");
+        if(!a)
+            return false;
+        char buf[65536];
+        size_t n;
+        while((n=fread(buf,1,sizeof(buf),a))>0)
+            put(buf,n);
+        bool ok = !ferror(a);
+        fclose(a);
+        if(!ok)
+            throw std::runtime_error("cannot read checkpoint "+fn);
+        return true;
+    }
+
+    /**
+     * \brief write the checkpoint to a file. It is written to a temporary file
+     * which is then renamed, so the file always holds a complete checkpoint
+     * even if we are killed while writing.
+     * \param fn the file name
+     * \throws std::runtime_error if the file can't be written
+     */
+    void write(const std::string& fn) const {
+        std::string tmp = fn+".tmp";
+        FILE *a = fopen(tmp.c_str(),"wb");
+        if(!a)
+            throw std::runtime_error("cannot write checkpoint "+tmp);
+        bool ok = fwrite(bytes.data(),1,bytes.size(),a)==bytes.size();
+        ok = !fclose(a) && ok;
+        if(!ok || rename(tmp.c_str(),fn.c_str()))
+            throw std::runtime_error("cannot write checkpoint "+fn);
+    }
+
+private:
+    std::vector<char> bytes; //!< the data
+    size_t pos; //!< position of the next get()
+};
+
+/**
+ * \brief Writes checkpoints to a file in a background thread, so that
+ * training only waits while the state is copied into memory. Only one
+ * checkpoint is written at a time: starting the next waits for the last
+ * to be written.
+ */
+class CheckpointWriter {
+public:
+    /**
+     * \brief Constructor
+     * \param fn the file to write
+     */
+    CheckpointWriter(const std::string& fn) : fn(fn),pool(1) {
+    }
+
+    /**
+     * \brief wait for the last checkpoint to be written, and get an empty
+     * one to fill in and pass to write()
+     * \throws std::runtime_error if the last checkpoint couldn't be written
+     */
+    Checkpoint& next(){
+        pool.wait();
+        cp.clear();
+        return cp;
+    }
+
+    /**
+     * \brief start writing the checkpoint got from next()
+     */
+    void write(){
+        pool.submit([this]{
+            cp.write(fn);
+        });
+    }
+
+    /**
+     * \brief wait for the last checkpoint to be written
+     * \throws std::runtime_error if it couldn't be written
+     */
+    void finish(){
+        pool.wait();
+    }
+
+private:
+    std::string fn; //!< the file name
+    Checkpoint cp; //!< the checkpoint being filled in or written
+    /// \brief the writing thread, last so that it is destroyed (waiting for
+    /// any write to finish) before the checkpoint is
+    ThreadPool pool;
+};
+
+#endif /* __CHECKPOINT_HPP */
@@ -9,8 +9,21 @@
 
 #include <assert.h>
 #include <stdint.h>
+#include <string.h>
+#include <vector>
+#include <queue>
+#include <functional>
+#include <algorithm>
 
 #include "mnist.hpp"
+#include "stream.hpp"
+#include "mappedFile.hpp"
+
+/** \brief magic string at the start of an example set file */
+#define EXAMPLEFILE_MAGIC "UESEXSET"
+
+/** \brief version of the example set file format */
+#define EXAMPLEFILE_VERSION 1
 
 /**
  * \brief Ensure array has cycling values of some function f mod n.
@@ -20,43 +33,190 @@
  * This is done in-place.
  * 
  * The input function has the signature (int)(T). In the shuffling code we use it
- * takes a pointer to the data of the example.
+ * takes the index of the example in the data.
+ *
+ * Each item which isn't the value needed at its position is swapped with
+ * the first item after it which is, and this stops at the first position for
+ * which there isn't one. Rather than scanning for that item, we keep the
+ * positions of the items of each value in a heap, so this takes time
+ * proportional to n log n for n items.
  */
 
 template <class T,class TestFunc> void alternate(T *arr,int nitems,int cycle,TestFunc f){
-    // for each item, if it is not the appropriate value,
-    // scan forward until we find one which is and swap with that.
-    // Leave if we can't find one.
+    // find each item's value; values which are negative mod the cycle never
+    // match, so they are -1 and aren't in any heap
+    std::vector<int> vals(nitems);
+    typedef std::priority_queue<int,std::vector<int>,std::greater<int>> Heap;
+    std::vector<Heap> positions(cycle);
     for(int i=0;i<nitems;i++){
-        if(f(arr[i])%cycle!=(i%cycle)){
-            // doesn't match; swap.
-            for(int j=i;;j++){
-                if(j>=nitems)return; // can't find a match, exit.
-                // scan for one that does
-                if(f(arr[j])%cycle==i%cycle){
-                    // and swap and leave loop
-                    T v=arr[i];
-                    arr[i]=arr[j];
-                    arr[j]=v;
-                    break;
-                }
-            }
+        int v = f(arr[i])%cycle;
+        vals[i] = v<0 ? -1 : v;
+        if(v>=0)
+            positions[v].push(i);
+    }
+    
+    // each heap holds the positions at or after i of the items of its value
+    for(int i=0;i<nitems;i++){
+        int w = i%cycle;
+        int v = vals[i];
+        if(v==w){
+            positions[w].pop(); // which was i
+            continue;
+        }
+        // doesn't match; swap with the first which does, or leave if none
+        if(positions[w].empty())
+            return;
+        int j = positions[w].top();
+        positions[w].pop();
+        std::swap(arr[i],arr[j]);
+        std::swap(vals[i],vals[j]);
+        // and the item which was at i is now at j
+        if(v>=0){
+            positions[v].pop();
+            positions[v].push(j);
         }
     }
 }
 
 
+/**
+ * \brief The parts of an example set which don't depend on the
+ * scalar type: the shuffle mode, so that it can be given
+ * as ExampleSet::STRIDE (say) whatever type of set is being shuffled,
+ * the storage and the header of an example set file.
+ */
+
+class ExampleSetBase {
+public:
+    /**
+     * \brief The header of an example set file written by ExampleSetT::save(),
+     * which is followed at dataOffset by the examples as they are in a FULL set.
+     */
+    struct FileHeader {
+        char magic[8]; //!< EXAMPLEFILE_MAGIC
+        uint32_t version; //!< EXAMPLEFILE_VERSION
+        uint32_t byteOrder; //!< 0x01020304, to check the file is in this machine's byte order
+        uint32_t scalarSize; //!< the size of the scalar type
+        uint32_t count; //!< number of examples
+        uint32_t inputs; //!< number of inputs
+        uint32_t outputs; //!< number of outputs
+        uint32_t hLevels; //!< number of modulator levels
+        uint32_t reserved; //!< zero
+        double minH; //!< minimum modulator
+        double maxH; //!< maximum modulator
+        uint64_t dataOffset; //!< where the examples start, aligned to 64 bytes
+    };
+    static_assert(sizeof(FileHeader)==64,"example file header should be 64 bytes");
+    
+    /**
+     * \brief Shuffling mode for shuffle()
+     */
+    enum ShuffleMode { 
+        /**
+         * \brief Shuffle blocks of numHLevels examples, rather than single examples.
+         * This is intended for cases where examples with the same inputs are added contiguously
+         * at different modulator levels. 
+         * For this to work correctly, the modulator levels must be distributed evenly
+         * across their range. For example, for four modulator levels from 2-3:
+         * 
+         * * ensure that numHLevels is 4 
+         * * ensure that the values for 2,2.25,2.5 and 3 are equally represented in the data.
+         * * ensure that the data is provided in equally sized groups cycling through the
+         * modulator (similar to the output of the ALTERNATE mode)
+         * 
+         * It is possible to run a shuffle(rd,ALTERNATE) on the data after input, followed
+         * by training with this mode.
+         */
+        STRIDE,
+              /**
+               * \brief Shuffle single examples, but follow up by running a pass over the examples
+               * to ensure that they alternate by modulator level. This is useful where there are 
+               * discrete modulator levels but the examples are mixed
+               * up (as happens in the robot experiments). This doesn't require equal distribution
+               * of modulator levels, but the levels should be evenly spaced across the range.
+               * If the distribution is unequal, a portion at the end of the set will not alternate
+               * correctly.
+               */
+              ALTERNATE,
+              /**
+               * \brief Shuffle single examples, no matter the value of numHLevels.
+               */
+              SINGLE,
+              /**
+               * \brief Don't shuffle examples at all
+               */
+              NONE
+    };
+    
+    /**
+     * \brief How the examples in a set are stored
+     */
+    enum Storage {
+        /**
+         * \brief as values of the scalar type: inputs, then outputs, then the
+         * modulator for each example
+         */
+        FULL,
+        /**
+         * \brief as bytes, for sets of images with a single class label such as
+         * MNIST. Each example is stored as its pixels and label, and the inputs
+         * are the pixels divided by 255 and the outputs a one-hot encoding of
+         * the label. This takes about an eighth of the memory of a FULL set of
+         * doubles, and a set made from MNIST uses the mapped files in place
+         * without copying them. Networks which train in batches (such as BPNet) convert the
+         * pixels straight into their input layer and work out the output errors
+         * from the label; elsewhere the examples are converted as they are read
+         * (see ExampleSetT::getInputs()).
+         */
+        COMPACT,
+        /**
+         * \brief in files, read as they are needed (see ExampleStreamT), for sets
+         * too large to hold in memory. Only the modulators are held in memory.
+         * The examples can't be changed, and the pointers got from
+         * ExampleSetT::getInputs() and ExampleSetT::getOutputs() are only valid until
+         * the next call. These sets can't be trained on in several threads or
+         * cross-validated in the background.
+         */
+        STREAMED
+    };
+};
+
 /**
  * \brief
  * A set of example data. Each datum consists of 
  * hormone (i.e. modulator value), inputs and outputs.
- * The data is stored as a single double array, with each example made up
+ * The data is stored as a single array of the scalar type T (double or
+ * float), with each example made up
  * of inputs, followed by outputs, followed by modulator value (h).
+ * ExampleSet is the double version.
  */
 
-class ExampleSet {
-    double **examples; //!< pointers to each example, stored as inputs, then outputs, then h.
-    double *data; //!< pointer to block of floats containing all example data
+template <class T> class ExampleSetT : public ExampleSetBase {
+    template <class> friend class ExampleSetT;
+    
+    /// \brief the index of each example in the data, in the order they are
+    /// in this set (which is changed by shuffling)
+    int32_t *order;
+    T *data; //!< pointer to block of floats containing all example data
+    
+    Storage storage; //!< how the examples are stored
+    const uint8_t *pixels; //!< the inputs of each example in a COMPACT set
+    const uint8_t *labels; //!< the label of each example in a COMPACT set
+    /// \brief the files the pixels and labels of a COMPACT set are in, kept
+    /// mapped while the set is
+    std::shared_ptr<const IDXFile> pixelFile,labelFile;
+    /// \brief the file the data of a set loaded from a file is in
+    std::shared_ptr<MappedFile> dataFile;
+    /// \brief the files the examples of a STREAMED set are read from
+    std::shared_ptr<ExampleStreamT<T>> stream;
+    /// \brief how far through this set the chunks of a STREAMED set have
+    /// been asked for
+    int prefetchedTo;
+    /// \brief the last example got from a STREAMED set
+    int lastStreamed;
+    T *hs; //!< the modulator of each example in a COMPACT or STREAMED set
+    T *inBuf; //!< the inputs returned by getInputs() in a COMPACT set
+    T *outBuf; //!< the outputs returned by getOutputs() in a COMPACT set
     
     int ninputs; //!< number of inputs 
     int noutputs; //!< number of outputs
@@ -64,6 +224,7 @@ class ExampleSet {
     
     uint32_t outputOffset; //!< offset of outputs in example data
     uint32_t hOffset; //!< offset of h in example data
+    uint32_t exampleSize; //!< size of each example in the data
     
     /**
      * \brief Does this set own its data?
@@ -89,49 +250,166 @@ class ExampleSet {
      */
     double maxH;
     
-    
-public:
-    
-    
     /**
-     * \brief
-     * Constructor - creates but doesn't fill in the data
-     * \param n    number of examples
-     * \param nin  number of inputs to each example
-     * \param nout number of outputs from each example
-     * \param levels number of modulator levels (see numHLevels)
+     * \brief Set up the sizes and order of a new set, whose data is
+     * allocated by the caller
      */
-    ExampleSet(int n,int nin,int nout,int levels){
+    void init(int n,int nin,int nout,int levels,Storage st){
         ninputs=nin;
         noutputs=nout;
         ct=n;
         numHLevels = levels;
         minH=0;
         maxH=1;
-        
-//        printf("Allocating new set %d*(%d,%d)\n",
-//               n,ninputs,noutputs);
+        storage = st;
         
         // size of a single example: number of inputs plus number of outputs
         // plus one for the modulator.
-        
-        uint32_t exampleSize = ninputs+noutputs+1;
+        exampleSize = ninputs+noutputs+1;
         
         // calculate the offsets
         outputOffset = ninputs;
         hOffset = ninputs+noutputs;
         
-        data = new double[exampleSize*ct]; // allocate data
-        examples = new double*[ct]; // allocate example pointers
+        order = new int32_t[ct]; // allocate example order
+        for(int i=0;i<ct;i++)
+            order[i] = i;
         
-        for(int i=0;i<ct;i++){
-            // work out and store the example pointer
-            examples[i] = data+i*exampleSize;
-            
-        }
+        data = NULL;
+        pixels = NULL;
+        labels = NULL;
+        hs = NULL;
+        prefetchedTo = 0;
+        lastStreamed = 0;
+        allocBuffers();
         ownsData = true;
     }
     
+    /**
+     * \brief allocate the buffers for decoding COMPACT examples
+     */
+    void allocBuffers(){
+        if(storage==COMPACT){
+            inBuf = new T[ninputs];
+            outBuf = new T[noutputs];
+        } else {
+            inBuf = NULL;
+            outBuf = NULL;
+        }
+    }
+    
+    /**
+     * \brief the value of each pixel value in a COMPACT set, exactly as a FULL
+     * set made from the same images has it
+     */
+    static const T *pixelValues(){
+        // built the first time it's needed
+        static const struct Table {
+            T vals[256];
+            Table(){
+                for(int i=0;i<256;i++){
+                    double pixval = i;
+                    pixval /= 255.0;
+                    vals[i] = (T)pixval;
+                }
+            }
+        } table;
+        return table.vals;
+    }
+    
+    /**
+     * \brief get the modulator of an example by its index in the data
+     */
+    double getHByIndex(int32_t k) const {
+        return storage!=FULL ? hs[k] : data[k*exampleSize+hOffset];
+    }
+    
+    /**
+     * \brief get an example in a STREAMED set, first asking for the chunks of
+     * the examples up to a window ahead of it to be read in the background
+     * \return the inputs, followed by the outputs
+     */
+    T *getStreamed(int example){
+        // if we've gone back more than a little way (rather than to the start
+        // of a batch), we've started again
+        int chunkSize = stream->getChunkSize();
+        if(example+chunkSize<lastStreamed)
+            prefetchedTo = example;
+        lastStreamed = example;
+        
+        int ahead = example+chunkSize*stream->getWindowChunks();
+        if(ahead>ct)
+            ahead = ct;
+        // ask a chunk's worth of examples at a time, or when we get near the end
+        if(ahead-prefetchedTo>=chunkSize || (ahead==ct && prefetchedTo<ct)){
+            std::vector<int> chunks;
+            for(int i=std::max(prefetchedTo,example);i<ahead;i++){
+                int c = order[i]/chunkSize;
+                if(std::find(chunks.begin(),chunks.end(),c)==chunks.end())
+                    chunks.push_back(c);
+            }
+            for(int c: chunks)
+                stream->prefetch(c);
+            prefetchedTo = ahead;
+        }
+        return stream->get(order[example]);
+    }
+    
+    /**
+     * \brief shuffle some of the order, as shuffle() does the whole of it
+     * \param o the order to shuffle
+     * \param n the number of examples in it
+     */
+    void shuffleOrder(int32_t *o,int n,drand48_data *rd,ShuffleMode mode){
+        int blockSize; // size of the blocks we are shuffling, in bytes
+        if(mode == STRIDE)
+            blockSize = numHLevels;
+        else
+            blockSize = 1;
+        int32_t *tmp = new int32_t[blockSize]; // temporary storage for swapping
+        
+        for(int i=(n/blockSize)-1;i>=1;i--){
+            long lr;
+            lrand48_r(rd,&lr);
+            int j = lr%(i+1);
+            memcpy(tmp,o+i*blockSize,blockSize*sizeof(int32_t));
+            memcpy(o+i*blockSize,o+j*blockSize,blockSize*sizeof(int32_t));
+            memcpy(o+j*blockSize,tmp,blockSize*sizeof(int32_t));
+        }
+        // if this mode is set, rearrange the shuffled data so that the h-levels cycle
+        if(mode == ALTERNATE){
+            alternate<int32_t>(o, n, numHLevels,
+                               // abominations like this are why I used an overcomplicated
+                               // example system at first...
+                               [this](int32_t k){
+                               double d = (getHByIndex(k)-minH)/(maxH-minH);
+                               int i = (int)(d*(numHLevels-1));
+                               return i;
+                           });
+        }
+        delete [] tmp;
+    }
+    
+public:
+    
+    
+    /**
+     * \brief
+     * Constructor - creates but doesn't fill in the data
+     * \param n    number of examples
+     * \param nin  number of inputs to each example
+     * \param nout number of outputs from each example
+     * \param levels number of modulator levels (see numHLevels)
+     */
+    ExampleSetT(int n,int nin,int nout,int levels){
+        init(n,nin,nout,levels,FULL);
+        
+//        printf("Allocating new set %d*(%d,%d)\n",
+//               n,ninputs,noutputs);
+        
+        data = new T[exampleSize*ct]; // allocate data
+    }
+    
     /**
      * \brief Constructor for making a subset of another set.
      * This uses the actual data in the parent, but creates a fresh
@@ -140,7 +418,7 @@ public:
      * \param start the start index of the data in the parent.
      * \param length the length of the subset.
      */
-    ExampleSet(const ExampleSet &parent,int start,int length){
+    ExampleSetT(const ExampleSetT &parent,int start,int length){
         if(length > parent.ct - start || start<0 || length<1)
             throw std::out_of_range("subset out of range");
         ownsData = false;
@@ -148,15 +426,27 @@ public:
         noutputs = parent.noutputs;
         outputOffset = ninputs;
         hOffset = ninputs+noutputs;
+        exampleSize = parent.exampleSize;
+        storage = parent.storage;
         data = parent.data;
-        examples = new double*[length];
+        pixels = parent.pixels;
+        labels = parent.labels;
+        pixelFile = parent.pixelFile;
+        labelFile = parent.labelFile;
+        dataFile = parent.dataFile;
+        stream = parent.stream;
+        prefetchedTo = 0;
+        lastStreamed = 0;
+        hs = parent.hs;
+        allocBuffers();
+        order = new int32_t[length];
         ct = length;
         numHLevels = parent.numHLevels;
         minH = parent.minH;
         maxH = parent.maxH;
         
         for(int i=0;i<ct;i++){
-            examples[i] = parent.examples[start+i];
+            order[i] = parent.order[start+i];
         }
     }
     
@@ -166,31 +456,117 @@ public:
      * for use in non-modulatory training). We copy the data
      * from the MNIST object. The outputs will use a one-hot encoding.
      * This example set will have no modulation.
+     * \param mnist the images and labels
+     * \param st how to store the examples, FULL (the default) or COMPACT
      */
-    ExampleSet(const MNIST& mnist) : ExampleSet(
-                                                mnist.getCount(), // number of examples
-                                                mnist.r()*mnist.c(), // input count
-                                                mnist.getMaxLabel()+1, // output count
-                                                1 // single modulation level
-                                                ){
+    ExampleSetT(const MNIST& mnist,Storage st=FULL){
+        int nin = mnist.r()*mnist.c();
+        init(mnist.getCount(), // number of examples
+             nin, // input count
+             mnist.getMaxLabel()+1, // output count
+             1, // single modulation level
+             st);
+        if(storage==COMPACT){
+            // use the pixels and labels where they are
+            pixels = mnist.getImg(0);
+            labels = mnist.getLabels();
+            pixelFile = mnist.getImageFile();
+            labelFile = mnist.getLabelFile();
+            hs = new T[ct];
+            for(int i=0;i<ct;i++)
+                hs[i] = 0;
+            return;
+        }
+        
+        data = new T[exampleSize*ct];
         // fill in the data
         for(int i=0;i<ct;i++){
             // convert each pixel into a 0-1 double and store
-            uint8_t *imgpix = mnist.getImg(i);
-            double *inpix = getInputs(i);
+            const uint8_t *imgpix = mnist.getImg(i);
+            T *inpix = getInputs(i);
             for(int i=0;i<ninputs;i++){
                 double pixval = *imgpix++;
                 pixval /= 255.0;
-                *inpix++ = pixval; 
+                *inpix++ = (T)pixval; 
             }
             // fill in the one-hot encoded output
-            double *out = getOutputs(i);
+            T *out = getOutputs(i);
             for(int outIdx=0;outIdx<noutputs;outIdx++){
                 out[outIdx] = mnist.getLabel(i)==outIdx?1:0;
             }
             setH(i,0); // set nominal modulator value
         }
-        ownsData=true;
+    }
+    
+    /**
+     * \brief Constructor for a STREAMED set, whose examples are read from
+     * files as they are needed (see ExampleStreamT). The modulators are read
+     * from the stream into memory.
+     * \param st the stream, which may be shared with other sets
+     * \param levels number of modulator levels (see numHLevels)
+     * \throws std::logic_error if the stream's chunks can't be divided into
+     * blocks of one example at each level
+     */
+    ExampleSetT(std::shared_ptr<ExampleStreamT<T>> st,int levels=1){
+        init(st->getCount(),st->getInputCount(),st->getOutputCount(),levels,STREAMED);
+        if(st->getChunkSize()%levels)
+            throw std::logic_error("chunk size must be a multiple of the number of modulator levels");
+        stream = st;
+        hs = new T[ct];
+        for(int i=0;i<ct;i++)
+            hs[i] = stream->getH(i);
+    }
+    
+    /**
+     * \brief Constructor which loads a set saved with save(). The file is
+     * mapped into memory and the examples used where they are, so this takes
+     * almost no time and the examples are only read from the file as they are
+     * used. The examples can be changed, but this only changes them in memory.
+     * The set is FULL, in the order the examples were in when saved.
+     * \param fn the file name
+     * \throws std::runtime_error if the file can't be read, isn't an example
+     * set file, or is of a set of a different scalar type (which can be loaded
+     * as that type and converted)
+     */
+    explicit ExampleSetT(const std::string& fn){
+        std::shared_ptr<MappedFile> f(new MappedFile(fn));
+        FileHeader h;
+        if(f->getSize()<sizeof(h))
+            throw std::runtime_error("bad example file "+fn);
+        memcpy(&h,f->getData(),sizeof(h));
+        if(memcmp(h.magic,EXAMPLEFILE_MAGIC,8) || h.version!=EXAMPLEFILE_VERSION ||
+           h.byteOrder!=0x01020304)
+            throw std::runtime_error("bad example file "+fn);
+        if(h.scalarSize!=sizeof(T))
+            throw std::runtime_error("example file "+fn+" is of a different scalar type");
+        uint64_t size = (uint64_t)h.count*(h.inputs+h.outputs+1)*sizeof(T);
+        if(h.dataOffset%64 || h.dataOffset>f->getSize() || f->getSize()-h.dataOffset!=size)
+            throw std::runtime_error("size of example file "+fn+" does not agree with its header");
+        
+        init(h.count,h.inputs,h.outputs,h.hLevels,FULL);
+        minH = h.minH;
+        maxH = h.maxH;
+        data = (T *)(f->getData()+h.dataOffset);
+        dataFile = f;
+    }
+    
+    /**
+     * \brief Constructor which copies and converts the examples in
+     * a set of another scalar type (in their current order), so that
+     * the same data can be used to train double and float networks.
+     * The copy is always a FULL set.
+     * \param src the set to copy
+     */
+    template <class S> explicit ExampleSetT(const ExampleSetT<S>& src) : ExampleSetT(
+                                                src.ct,src.ninputs,src.noutputs,
+                                                src.numHLevels){
+        minH = src.minH;
+        maxH = src.maxH;
+        for(int i=0;i<ct;i++){
+            src.copyInputs(i,getInputs(i));
+            src.copyOutputs(i,getOutputs(i));
+            setH(i,src.getH(i));
+        }
     }
     
     /**
@@ -198,55 +574,19 @@ public:
      * Destructor - deletes data and offset array
      */
     
-    ~ExampleSet(){
+    ~ExampleSetT(){
         if(ownsData){ // only delete the data if we aren't a subset
-            delete [] data;
+            if(!dataFile) // or it is in a file
+                delete [] data;
+            delete [] hs;
         }
+        delete [] order;
+        delete [] inBuf;
+        delete [] outBuf;
     }
     
 public:
     
-    /**
-     * \brief Shuffling mode for shuffle()
-     */
-    enum ShuffleMode { 
-        /**
-         * \brief Shuffle blocks of numHLevels examples, rather than single examples.
-         * This is intended for cases where examples with the same inputs are added contiguously
-         * at different modulator levels. 
-         * For this to work correctly, the modulator levels must be distributed evenly
-         * across their range. For example, for four modulator levels from 2-3:
-         * 
-         * * ensure that numHLevels is 4 
-         * * ensure that the values for 2,2.25,2.5 and 3 are equally represented in the data.
-         * * ensure that the data is provided in equally sized groups cycling through the
-         * modulator (similar to the output of the ALTERNATE mode)
-         * 
-         * It is possible to run a shuffle(rd,ALTERNATE) on the data after input, followed
-         * by training with this mode.
-         */
-        STRIDE,
-              /**
-               * \brief Shuffle single examples, but follow up by running a pass over the examples
-               * to ensure that they alternate by modulator level. This is useful where there are 
-               * discrete modulator levels but the examples are mixed
-               * up (as happens in the robot experiments). This doesn't require equal distribution
-               * of modulator levels, but the levels should be evenly spaced across the range.
-               * If the distribution is unequal, a portion at the end of the set will not alternate
-               * correctly.
-               */
-              ALTERNATE,
-              /**
-               * \brief Shuffle single examples, no matter the value of numHLevels.
-               */
-              SINGLE,
-              /**
-               * \brief Don't shuffle examples at all
-               */
-              NONE
-    };
-        
-    
     /**
      * \brief
      * Shuffle the example using a PRNG and a Fisher-Yates shuffle.
@@ -263,33 +603,44 @@ public:
         if(!nExamples)
             nExamples=ct;
         
-        int blockSize; // size of the blocks we are shuffling, in bytes
-        if(mode == STRIDE)
-            blockSize = numHLevels;
-        else
-            blockSize = 1;
-        double **tmp = new double*[blockSize]; // temporary storage for swapping
+        if(storage!=STREAMED){
+            shuffleOrder(order,nExamples,rd,mode);
+            return;
+        }
         
-        for(int i=(nExamples/blockSize)-1;i>=1;i--){
+        // In a STREAMED set, gather the examples by chunk (keeping their order
+        // within each, so STRIDE blocks stay together), shuffle the order of the
+        // chunks, and then shuffle within each window of a few chunks.
+        int chunkSize = stream->getChunkSize();
+        std::vector<int> chunks; // the chunks in the order, in order of first appearance
+        std::vector<int> first(stream->getCount()/chunkSize+1,-1); // where each chunk starts
+        std::vector<int> count(first.size(),0); // and how many examples it has
+        for(int i=0;i<nExamples;i++){
+            int c = order[i]/chunkSize;
+            if(!count[c]++)
+                chunks.push_back(c);
+        }
+        for(int i=(int)chunks.size()-1;i>=1;i--){
             long lr;
             lrand48_r(rd,&lr);
-            int j = lr%(i+1);
-            memcpy(tmp,examples+i*blockSize,blockSize*sizeof(double*));
-            memcpy(examples+i*blockSize,examples+j*blockSize,blockSize*sizeof(double*));
-            memcpy(examples+j*blockSize,tmp,blockSize*sizeof(double*));
+            std::swap(chunks[i],chunks[lr%(i+1)]);
         }
-        // if this mode is set, rearrange the shuffled data so that the h-levels cycle
-        if(mode == ALTERNATE){
-            alternate<double*>(examples, nExamples, numHLevels,
-                               // abominations like this are why I used an overcomplicated
-                               // example system at first...
-                               [this](double *e){
-                               double d = (e[hOffset]-minH)/(maxH-minH);
-                               int i = (int)(d*(numHLevels-1));
-                               return i;
-                           });
+        std::vector<int> windows; // where each window starts
+        int pos=0;
+        for(size_t i=0;i<chunks.size();i++){
+            if(i%stream->getWindowChunks()==0)
+                windows.push_back(pos);
+            first[chunks[i]] = pos;
+            pos += count[chunks[i]];
         }
-        delete [] tmp;
+        windows.push_back(nExamples);
+        std::vector<int32_t> tmp(order,order+nExamples);
+        for(int i=0;i<nExamples;i++){
+            int c = tmp[i]/chunkSize;
+            order[first[c]++] = tmp[i];
+        }
+        for(size_t w=0;w+1<windows.size();w++)
+            shuffleOrder(order+windows[w],windows[w+1]-windows[w],rd,mode);
     }
     
     /**
@@ -297,11 +648,25 @@ public:
      * \param mn minimum H value in set domain
      * \param mx maximum H value in set domain
      */
-    ExampleSet& setHRange(double mn,double mx){
+    ExampleSetT& setHRange(double mn,double mx){
         minH = mn;
         maxH = mx;
         return *this;
     }
+    
+    /**
+     * \brief get the minimum of the h range (see setHRange())
+     */
+    double getMinH() const {
+        return minH;
+    }
+    
+    /**
+     * \brief get the maximum of the h range (see setHRange())
+     */
+    double getMaxH() const {
+        return maxH;
+    }
         
     
     /**
@@ -328,27 +693,162 @@ public:
         return ct;
     }
     
+    /**
+     * \brief get the order of the examples, as the index of each in the
+     * data shared by this set and any it is a subset of, so that
+     * the order can be saved and put back with setOrder()
+     * \param o array of getCount() values to receive the indices
+     */
+    void getOrder(int32_t *o) const {
+        memcpy(o,order,ct*sizeof(int32_t));
+    }
+    
+    /**
+     * \brief put the examples into an order got from getOrder() on this set,
+     * or on another sharing its data
+     * \param o array of getCount() indices
+     * \param limit the number of examples in the data; the indices must
+     * be less than this
+     * \throws std::out_of_range if an index is out of range
+     */
+    void setOrder(const int32_t *o,int limit){
+        for(int i=0;i<ct;i++){
+            if(o[i]<0 || o[i]>=limit)
+                throw std::out_of_range("example order out of range");
+        }
+        memcpy(order,o,ct*sizeof(int32_t));
+    }
+    
+    /**
+     * \brief save the examples, in their current order, to a file which can
+     * be loaded quickly with the constructor taking a file name. The file
+     * holds the examples as they are in a FULL set of this scalar type, and
+     * also the number of modulator levels and the modulator range.
+     * \param fn the file name
+     * \throws std::runtime_error if the file can't be written
+     */
+    void save(const std::string& fn) const {
+        FileHeader h;
+        memset(&h,0,sizeof(h));
+        memcpy(h.magic,EXAMPLEFILE_MAGIC,8);
+        h.version = EXAMPLEFILE_VERSION;
+        h.byteOrder = 0x01020304;
+        h.scalarSize = sizeof(T);
+        h.count = ct;
+        h.inputs = ninputs;
+        h.outputs = noutputs;
+        h.hLevels = numHLevels;
+        h.minH = minH;
+        h.maxH = maxH;
+        h.dataOffset = sizeof(h);
+        
+        FILE *a = fopen(fn.c_str(),"wb");
+        if(!a)
+            throw std::runtime_error("cannot write example file "+fn);
+        bool ok = fwrite(&h,sizeof(h),1,a)==1;
+        std::vector<T> ex(exampleSize);
+        for(int i=0;ok && i<ct;i++){
+            copyInputs(i,ex.data());
+            copyOutputs(i,ex.data()+outputOffset);
+            ex[hOffset] = getH(i);
+            ok = fwrite(ex.data(),sizeof(T),exampleSize,a)==exampleSize;
+        }
+        ok = !fclose(a) && ok;
+        if(!ok)
+            throw std::runtime_error("cannot write example file "+fn);
+    }
+    
+    /**
+     * \brief get how the examples are stored
+     */
+    Storage getStorage() const {
+        return storage;
+    }
     
     /**
      * \brief
-     * Get a pointer to the inputs for a given example, for reading or writing
+     * Get a pointer to the inputs for a given example, for reading or writing.
+     * In a COMPACT set the inputs are converted into a buffer belonging to this
+     * set, which is only valid until the next call and can't be written to.
      * \param example   index of the example
      */
     
-    double *getInputs(int example) {
+    T *getInputs(int example) {
         assert(example<ct);
-        return examples[example]; // inputs are first in each block
+        if(storage==COMPACT){
+            copyInputs(example,inBuf);
+            return inBuf;
+        }
+        if(storage==STREAMED)
+            return getStreamed(example);
+        return data+order[example]*exampleSize; // inputs are first in each block
     }
     
     /**
      * \brief
-     * Get a pointer to the outputs for a given example, for reading or writing
+     * Get a pointer to the outputs for a given example, for reading or writing.
+     * In a COMPACT set this is a buffer as for getInputs().
      * \param example   index of the example
      */
     
-    double *getOutputs(int example) {
+    T *getOutputs(int example) {
+        assert(example<ct);
+        if(storage==COMPACT){
+            copyOutputs(example,outBuf);
+            return outBuf;
+        }
+        if(storage==STREAMED)
+            return getStreamed(example)+ninputs;
+        return data+order[example]*exampleSize + outputOffset;
+    }
+    
+    /**
+     * \brief copy the inputs of an example, converting them
+     * \param example index of the example
+     * \param dest array of getInputCount() values to copy them to
+     */
+    template <class D> void copyInputs(int example,D *dest) const {
+        assert(example<ct);
+        if(storage==COMPACT){
+            const T *vals = pixelValues();
+            const uint8_t *p = pixels+(long)order[example]*ninputs;
+            for(int i=0;i<ninputs;i++)
+                dest[i] = (D)vals[p[i]];
+        } else {
+            const T *in = storage==STREAMED ? stream->get(order[example]) :
+                  data+order[example]*exampleSize;
+            for(int i=0;i<ninputs;i++)
+                dest[i] = (D)in[i];
+        }
+    }
+    
+    /**
+     * \brief copy the outputs of an example, converting them
+     * \param example index of the example
+     * \param dest array of getOutputCount() values to copy them to
+     */
+    template <class D> void copyOutputs(int example,D *dest) const {
         assert(example<ct);
-        return examples[example] + outputOffset;
+        if(storage==COMPACT){
+            int label = labels[order[example]];
+            for(int i=0;i<noutputs;i++)
+                dest[i] = i==label ? 1 : 0;
+        } else {
+            const T *out = storage==STREAMED ? stream->get(order[example])+ninputs :
+                  data+order[example]*exampleSize+outputOffset;
+            for(int i=0;i<noutputs;i++)
+                dest[i] = (D)out[i];
+        }
+    }
+    
+    /**
+     * \brief get the label of an example in a COMPACT set, which is the index
+     * of the output which is 1
+     * \param example index of the example
+     */
+    int getLabel(int example) const {
+        assert(example<ct && storage==COMPACT);
+        return labels[order[example]];
     }
     
     /**
@@ -358,7 +858,7 @@ public:
      */
     double getH(int example) const {
         assert(example<ct);
-        return *(examples[example] + hOffset);
+        return getHByIndex(order[example]);
     }
     
     /**
@@ -377,7 +877,10 @@ public:
      */
     void setH(int example, double h){
         assert(example<ct);
-        *(examples[example] + hOffset) = h;
+        if(storage!=FULL)
+            hs[order[example]] = h;
+        else
+            *(data+order[example]*exampleSize + hOffset) = h;
     }
     
     /**
@@ -388,8 +891,8 @@ public:
     void dump(int start=0,int end=-1){
         if(end<0)end=ct;
         for(int i=start;i<end;i++){
-            double *ins = getInputs(i);
-            double *outs = getOutputs(i);
+            T *ins = getInputs(i);
+            T *outs = getOutputs(i);
             for(int j=0;j<ninputs;j++){
                 printf("%f ",ins[j]);
             }
@@ -403,6 +906,9 @@ public:
     
 };
 
-
+/**
+ * \brief an example set of doubles, the type used by default throughout
+ */
+typedef ExampleSetT<double> ExampleSet;
 
 #endif /* __DATA_H */
@@ -0,0 +1,145 @@
+/**
+ * @file ensemble.hpp
+ * @brief Training several networks at once on the same examples, for
+ * example to try different seeds or training parameters.
+ *
+ */
+
+#ifndef __ENSEMBLE_HPP
+#define __ENSEMBLE_HPP
+
+#include <vector>
+#include "net.hpp"
+#include "threadPool.hpp"
+
+/**
+ * \brief Trains a number of networks concurrently with trainSGD(), each
+ * with its own parameters, on a single example set. Each network shuffles
+ * its own view of the examples (which is just an array of pointers), so
+ * there is only one copy of the example data however many networks there
+ * are. EnsembleTrainer is the double version.
+ *
+ * The networks and parameters are not owned by the trainer, and must
+ * exist until training has finished. Each network trains just as it
+ * would on its own, so the results are the same whatever the number of
+ * threads.
+ *
+ * The examples can't be a STREAMED set, which has only one window of
+ * examples in memory for all its views (see ExampleStreamT).
+ */
+
+template <class T> class EnsembleTrainerT {
+public:
+    /**
+     * \brief Constructor
+     * \param examples the examples, which must exist until training has finished
+     * \param nthreads the number of threads to train in, or 0 for one per core
+     */
+    EnsembleTrainerT(const ExampleSetT<T>& examples,int nthreads=0) : examples(examples) {
+        threads = nthreads;
+    }
+
+    /**
+     * \brief add a network to be trained
+     * \param net the network
+     * \param params its training parameters
+     * \return the index of the network
+     */
+    int add(NetT<T> *net,typename NetT<T>::SGDParams& params){
+        Member m;
+        m.net = net;
+        m.params = &params;
+        m.score = -1;
+        members.push_back(m);
+        return (int)members.size()-1;
+    }
+
+    /**
+     * \brief train all the networks added, in parallel, waiting for them to
+     * finish
+     * \throws std::logic_error if the examples are a STREAMED set
+     * \throws the first exception thrown by any of the networks' training
+     */
+    void train(){
+        if(examples.getStorage()==ExampleSetBase::STREAMED)
+            throw std::logic_error("cannot train several networks at once on a streamed set");
+        ThreadPool pool(threads);
+        for(size_t i=0;i<members.size();i++){
+            Member *m = &members[i];
+            pool.submit([this,m]{
+                m->score = m->net->trainSGD(examples,*m->params);
+            });
+        }
+        pool.wait();
+    }
+
+    /**
+     * \brief get the number of networks
+     */
+    int getCount() const {
+        return (int)members.size();
+    }
+
+    /**
+     * \brief get a network
+     * \param i index of the network, in the order they were added
+     */
+    NetT<T> *getNet(int i) const {
+        return get(i).net;
+    }
+
+    /**
+     * \brief get a network's score, which is the MSE returned by trainSGD(),
+     * or -1 if it has not been trained
+     * \param i index of the network, in the order they were added
+     */
+    double getScore(int i) const {
+        return get(i).score;
+    }
+
+    /**
+     * \brief get the index of the network with the lowest score
+     * \throws std::logic_error if no networks have been trained
+     */
+    int getBest() const {
+        int best=-1;
+        for(int i=0;i<getCount();i++){
+            double s = members[i].score;
+            if(s>=0 && (best<0 || s<members[best].score))
+                best=i;
+        }
+        if(best<0)
+            throw std::logic_error("no networks have been trained");
+        return best;
+    }
+
+private:
+    /**
+     * \brief a network being trained, with its parameters and result
+     */
+    struct Member {
+        NetT<T> *net; //!< the network
+        typename NetT<T>::SGDParams *params; //!< its training parameters
+        double score; //!< the MSE after training, or -1
+    };
+
+    const ExampleSetT<T>& examples; //!< the examples
+    int threads; //!< number of threads, or 0 for one per core
+    std::vector<Member> members; //!< the networks
+
+    /**
+     * \brief get a member, checking the index
+     */
+    const Member& get(int i) const {
+        if(i<0 || i>=getCount())
+            throw std::out_of_range("ensemble index out of range");
+        return members[i];
+    }
+};
+
+/**
+ * \brief the double-precision ensemble trainer
+ */
+typedef EnsembleTrainerT<double> EnsembleTrainer;
+
+#endif /* __ENSEMBLE_HPP */
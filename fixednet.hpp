@@ -0,0 +1,660 @@
+/**
+ * @file fixednet.hpp
+ * @brief A plain or UESMANN network whose layer sizes are fixed at
+ * compile time, for training very large numbers of very small networks.
+ *
+ */
+
+#ifndef __FIXEDNET_HPP
+#define __FIXEDNET_HPP
+
+#include "net.hpp"
+
+/**
+ * \brief Sizes derived from a list of layer sizes at compile time, used
+ * by FixedNetT.
+ */
+template <int... Sizes> struct FixedShape;
+
+/** \brief FixedShape for a single (input) layer */
+template <int A> struct FixedShape<A> {
+    static const int WEIGHTS=0; //!< number of weights
+    static const int NODES=A; //!< total number of nodes in all layers
+    static const int LARGEST=A; //!< size of the largest layer
+};
+
+/** \brief FixedShape for two or more layers */
+template <int A,int B,int... Rest> struct FixedShape<A,B,Rest...> {
+    typedef FixedShape<B,Rest...> Next; //!< the shape without the first layer
+    static const int WEIGHTS=A*B+Next::WEIGHTS; //!< number of weights
+    static const int NODES=A+Next::NODES; //!< total number of nodes in all layers
+    static const int LARGEST=A>Next::LARGEST ? A : Next::LARGEST; //!< size of the largest layer
+};
+
+/**
+ * \brief A network of fixed shape, given as template parameters: the
+ * scalar type, the network type (NetType::PLAIN or NetType::UESMANN) and
+ * the layer sizes. For example, a UESMANN network with 2 inputs, 2 hidden
+ * nodes and a single output is FixedNet<NetType::UESMANN,2,2,1>.
+ *
+ * All the parameters and working values are arrays inside the object, and
+ * all the loop bounds are constants, so for very small networks (such as
+ * those in genBoolMap) this is much faster than BPNet or UESNet. It trains
+ * with exactly the same semantics: the weights are initialised with the same
+ * random number sequence, single examples and mini-batches are trained in the
+ * same way, and the networks are saved in the same format (so they load as
+ * a BPNet or UESNet). The results are identical to those of the general
+ * networks using the scalar kernels (see Kernels), except that mini-batch
+ * gradients may be summed in a different order. The vector kernels fuse
+ * multiplies and adds, so they may differ in the last bit.
+ */
+template <class T,NetType TP,int... Sizes> class FixedNetT : public NetT<T> {
+    static_assert(TP==NetType::PLAIN || TP==NetType::UESMANN,
+                  "FixedNet must be a plain or UESMANN network");
+    static_assert(sizeof...(Sizes)>=2,
+                  "FixedNet must have at least two layers");
+
+    typedef FixedShape<Sizes...> Shape; //!< sizes derived from the layer sizes
+    static const int NUMLAYERS=sizeof...(Sizes); //!< number of layers
+    static const int NODES=Shape::NODES; //!< total number of nodes in all layers
+    static const int WEIGHTS=Shape::WEIGHTS; //!< total number of weights
+    static const int LARGEST=Shape::LARGEST; //!< size of the largest layer
+    static const int NIN=Shape::NODES-Shape::Next::NODES; //!< number of inputs
+    static constexpr int sizes[NUMLAYERS]={Sizes...}; //!< the layer sizes
+    static const bool MODULATED=TP==NetType::UESMANN; //!< true for UESMANN
+
+public:
+    /**
+     * \brief Constructor - as with the other networks, this does not
+     * initialise the weights, which is done at the start of training.
+     */
+    FixedNetT() : NetT<T>(TP), modulator(0) {
+        for(int i=0;i<NODES;i++)
+            outputs[i]=0;
+    }
+
+    virtual void setH(double h){
+        // plain networks ignore the modulator
+        if(MODULATED)
+            modulator = h;
+    }
+
+    virtual double getH() const {
+        return modulator;
+    }
+
+    virtual int getLayerSize(int n) const {
+        return sizes[n];
+    }
+
+    virtual int getLayerCount() const {
+        return NUMLAYERS;
+    }
+
+    virtual void setInputs(T *d){
+        for(int i=0;i<NIN;i++)
+            outputs[i]=d[i];
+    }
+
+    virtual T *getOutputs() const {
+        return const_cast<T *>(outputs+NODES-sizes[NUMLAYERS-1]);
+    }
+
+    virtual int getDataSize() const {
+        return NODES+WEIGHTS;
+    }
+
+    virtual void save(T *buf) const {
+        // same layout as BPNet: by layers, with nodes within layers,
+        // and each node is bias then weights.
+        T *g=buf;
+        const T *b=biases;
+        const T *w=weights;
+        for(int l=0;l<NUMLAYERS;l++){
+            for(int j=0;j<sizes[l];j++){
+                *g++ = *b++;
+                if(l){
+                    for(int k=0;k<sizes[l-1];k++)
+                        *g++ = *w++;
+                }
+            }
+        }
+    }
+
+    virtual void load(T *buf){
+        T *g=buf;
+        T *b=biases;
+        T *w=weights;
+        for(int l=0;l<NUMLAYERS;l++){
+            for(int j=0;j<sizes[l];j++){
+                *b++ = *g++;
+                if(l){
+                    for(int k=0;k<sizes[l-1];k++)
+                        *w++ = *g++;
+                }
+            }
+        }
+    }
+
+    /**
+     * \brief Train a batch of networks which differ only in their seeds, as
+     * given by params.seed and params.seedCount. Network i gets the same
+     * parameters as calling trainSGD() on it with seed params.seed+i, and with
+     * the examples in the order they are in now; the examples are left in
+     * that order.
+     *
+     * The networks are trained LANES at a time, with the parameters of each
+     * network in a lane of an array of vectors, so the loops over the lanes
+     * vectorise and the latencies of the (otherwise serial) calculations
+     * of each network overlap. Each network keeps its own PRNG and its own
+     * shuffled view of the examples. All the networks use the sigmoid mode
+     * of the first.
+     *
+     * Only single-example training with plain gradient descent in a single
+     * thread, without cross-validation, a time limit or a best network interval
+     * (see SGDParams::bestInterval), is done in lanes, and not on a STREAMED
+     * set (whose lanes would each need a different window of it in memory);
+     * otherwise each network is trained with trainSGD() in turn.
+     * \param examples the training set
+     * \param params training parameters
+     * \param nets array of params.seedCount networks to train
+     * Networks which stop early (see SGDParams::stopPatience) are taken out
+     * of their lanes when they stop, although the lanes are still run until
+     * all the networks in them have stopped.
+     * \param mses if not NULL, array to receive each network's final MSE, as
+     * returned by trainSGD()
+     * \param stoppedAt if not NULL, array to receive the number of iterations
+     * each network was trained for, as SGDParams::stoppedAt
+     */
+    template <int LANES=8> static void trainSGDSeeds(ExampleSetT<T>& examples,
+                                                     typename NetT<T>::SGDParams& params,
+                                                     FixedNetT *nets,double *mses=NULL,
+                                                     int *stoppedAt=NULL){
+        if(!params.checkpointFile.empty())
+            throw std::logic_error("cannot checkpoint when training several seeds");
+        if(params.batchSize>1 || params.nSlices*params.nPerSlice>0 ||
+           params.optimizer!=Optimizer::SGD || params.timeLimit>0 ||
+           params.bestInterval>1 || params.threads>1 || params.batchThreads>1 ||
+           examples.getStorage()==ExampleSetBase::STREAMED){
+            long seed = params.seed;
+            for(int i=0;i<params.seedCount;i++){
+                params.seed = seed+i;
+                double mse = nets[i].trainSGD(examples,params);
+                if(mses)mses[i]=mse;
+                if(stoppedAt)stoppedAt[i]=params.stoppedAt;
+            }
+            params.seed = seed;
+            return;
+        }
+        
+        // the lane data is large for bigger networks, so it isn't on the stack
+        Lanes<LANES> *lanes = new Lanes<LANES>;
+        for(int s=0;s<params.seedCount;s+=LANES){
+            int n = params.seedCount-s < LANES ? params.seedCount-s : LANES;
+            lanes->train(examples,params,nets+s,params.seed+s,n,
+                         mses?mses+s:NULL,stoppedAt?stoppedAt+s:NULL);
+        }
+        delete lanes;
+    }
+
+protected:
+    virtual void initWeights(double initr){
+        // this draws exactly the same random numbers as BPNet::initWeights(),
+        // so a given seed gives the same network.
+        T *b=biases;
+        T *w=weights;
+        for(int l=0;l<NUMLAYERS;l++){
+            double initrange;
+            if(l){
+                if(initr>0)
+                    initrange = initr;
+                else
+                    initrange = 1.0/sqrt((double)sizes[l-1]); // from Bishop
+            } else
+                initrange = 0.1;
+            for(int j=0;j<sizes[l];j++)
+                b[j]=this->drand(-initrange,initrange);
+            for(int j=0;j<LARGEST*LARGEST;j++){
+                double v = this->drand(-initrange,initrange);
+                int to = j%LARGEST;
+                int from = j/LARGEST;
+                if(l && to<sizes[l] && from<sizes[l-1])
+                    w[to*sizes[l-1]+from]=v;
+            }
+            b+=sizes[l];
+            if(l)
+                w+=sizes[l]*sizes[l-1];
+        }
+        // zero the input layer biases, which should be unused.
+        for(int j=0;j<NIN;j++)
+            biases[j]=0;
+    }
+
+    virtual void update(){
+        forward();
+    }
+
+    virtual NetT<T> *makeSimilar() const {
+        return new FixedNetT;
+    }
+
+    virtual double trainBatch(ExampleSetT<T>& ex,int start,int num,double eta){
+        if(num==1)
+            return trainSingle(ex,start,eta);
+
+        // accumulate the gradients over the examples, then apply the means
+        for(int i=0;i<WEIGHTS;i++)
+            gradWeights[i]=0;
+        for(int i=0;i<NODES;i++)
+            gradBiases[i]=0;
+
+        double totalError=0;
+        for(int e=0;e<num;e++){
+            FixedNetT::setH(ex.getH(start+e));
+            T *outs = ex.getOutputs(start+e);
+            calcError(ex.getInputs(start+e),outs);
+            T hfactor = modFactor();
+
+            T *gw=gradWeights;
+            const T *o=outputs;
+            int n=NIN;
+            for(int l=1;l<NUMLAYERS;l++){
+                for(int i=0;i<sizes[l];i++){
+                    T d = errors[n+i]*hfactor;
+                    for(int k=0;k<sizes[l-1];k++)
+                        *gw++ += d*o[k];
+                    gradBiases[n+i] += errors[n+i];
+                }
+                o+=sizes[l-1];
+                n+=sizes[l];
+            }
+            totalError += outputError(outs);
+        }
+
+        double factor = 1.0/(double)num;
+        for(int i=0;i<WEIGHTS;i++)
+            weights[i] -= (T)(eta*factor)*gradWeights[i];
+        for(int i=NIN;i<NODES;i++){
+            T bdelta = eta*gradBiases[i]*factor;
+            biases[i] -= bdelta;
+        }
+        return totalError*factor;
+    }
+
+private:
+    double modulator; //!< the modulator, always 0 for plain networks
+
+    T outputs[NODES]; //!< the outputs of all the nodes, layer by layer
+    T errors[NODES]; //!< the errors of all the nodes, laid out as outputs
+    T biases[NODES]; //!< the biases of all the nodes, laid out as outputs
+    /// \brief the weights, a matrix for each layer after the input as in BPNet:
+    /// a row per node, holding its incoming weights.
+    T weights[WEIGHTS];
+    T gradWeights[WEIGHTS]; //!< weight gradients summed over a batch
+    T gradBiases[NODES]; //!< bias gradients summed over a batch
+
+    /**
+     * \brief The state of LANES networks being trained together by
+     * trainSGDSeeds(). Each array holds the values of each network in
+     * turn for an element (a weight, say), and the calculations are those of
+     * forward(), calcError() and trainSingle() done for all the networks at once.
+     */
+    template <int LANES> struct Lanes {
+        T weights[WEIGHTS][LANES]; //!< the weights, laid out as FixedNetT::weights
+        T biases[NODES][LANES]; //!< the biases
+        T outputs[NODES][LANES]; //!< the outputs
+        T errors[NODES][LANES]; //!< the errors
+        T bestWeights[WEIGHTS][LANES]; //!< weights of the best network found
+        T bestBiases[NODES][LANES]; //!< biases of the best network found
+        T targets[NODES][LANES]; //!< required outputs of the current examples
+        double modulator[LANES]; //!< the modulator of the current examples
+        double minError[LANES]; //!< the lowest training error so far
+
+        /**
+         * \brief train up to LANES networks, as trainSGDSeeds() describes
+         * \param examples the training set
+         * \param params training parameters
+         * \param nets the networks to train
+         * \param firstSeed the seed of the first network, the others following on
+         * \param n number of networks; lanes beyond this repeat the first
+         * \param mses array for the final MSEs, or NULL
+         * \param stoppedAt array for the iterations trained, or NULL
+         */
+        void train(ExampleSetT<T>& examples,typename NetT<T>::SGDParams& params,
+                   FixedNetT *nets,long firstSeed,int n,double *mses,int *stoppedAt){
+            int nExamples = examples.getCount();
+            ExampleSetT<T> *views[LANES];
+            SigmoidMode mode = nets[0].sigmoidMode;
+            
+            // initialise each network just as trainSGD() does, and copy it
+            // into its lane
+            for(int lane=0;lane<n;lane++){
+                views[lane] = new ExampleSetT<T>(examples,0,nExamples);
+                nets[lane].setSeed(firstSeed+lane);
+                nets[lane].initWeights(params.initrange);
+            }
+            for(int lane=0;lane<LANES;lane++){
+                int src = lane<n ? lane : 0;
+                for(int i=0;i<WEIGHTS;i++)
+                    weights[i][lane] = nets[src].weights[i];
+                for(int i=0;i<NODES;i++)
+                    biases[i][lane] = nets[src].biases[i];
+                minError[lane] = -1;
+            }
+            
+            // early stopping checks for each network, as trainSGD() does
+            // them, and their training errors so far this epoch
+            std::vector<typename NetT<T>::StopCheck> checks(n,typename NetT<T>::StopCheck(params));
+            double epochError[LANES];
+            bool stopped[LANES];
+            for(int lane=0;lane<n;lane++){
+                epochError[lane]=0;
+                stopped[lane]=false;
+                if(stoppedAt)
+                    stoppedAt[lane]=params.iterations;
+            }
+            int running=n;
+            
+            int exampleIndex=0;
+            for(int it=0;it<params.iterations;it++){
+                // reshuffle each network's view at the start of each epoch
+                if(exampleIndex==0){
+                    for(int lane=0;lane<n;lane++)
+                        views[lane]->shuffle(&nets[lane].rd,params.shuffleMode,nExamples);
+                }
+                
+                // get the example for each network
+                for(int lane=0;lane<LANES;lane++){
+                    ExampleSetT<T> *v = views[lane<n ? lane : 0];
+                    modulator[lane] = MODULATED ? v->getH(exampleIndex) : 0;
+                    T *in = v->getInputs(exampleIndex);
+                    for(int i=0;i<NIN;i++)
+                        outputs[i][lane] = in[i];
+                    T *out = v->getOutputs(exampleIndex);
+                    for(int i=0;i<sizes[NUMLAYERS-1];i++)
+                        targets[i][lane] = out[i];
+                }
+                
+                trainStep(params.getEta(it,(double)it/params.iterations),mode);
+                
+                // keep the best of each network by training error
+                int ol = NODES-sizes[NUMLAYERS-1];
+                for(int lane=0;lane<n;lane++){
+                    if(stopped[lane])
+                        continue;
+                    double totalError=0;
+                    for(int i=0;i<sizes[NUMLAYERS-1];i++){
+                        T e = outputs[ol+i][lane]-targets[i][lane];
+                        totalError += e*e;
+                    }
+                    if(minError[lane]<0 || totalError<minError[lane]){
+                        if(params.storeBestNet){
+                            for(int i=0;i<WEIGHTS;i++)
+                                bestWeights[i][lane] = weights[i][lane];
+                            for(int i=0;i<NODES;i++)
+                                bestBiases[i][lane] = biases[i][lane];
+                        }
+                        minError[lane] = totalError;
+                    }
+                    epochError[lane] += totalError;
+                }
+                exampleIndex = (exampleIndex+1)%nExamples;
+                
+                // at the end of each epoch, see which networks stop
+                if(exampleIndex==0 && checks[0].enabled()){
+                    for(int lane=0;lane<n;lane++){
+                        if(!stopped[lane] && checks[lane].check(epochError[lane]/nExamples)){
+                            finish(params,nets,lane,*views[lane],mses);
+                            stopped[lane]=true;
+                            running--;
+                            if(stoppedAt)
+                                stoppedAt[lane]=it+1;
+                        }
+                        epochError[lane]=0;
+                    }
+                    if(!running)
+                        break;
+                }
+            }
+            
+            for(int lane=0;lane<n;lane++){
+                if(!stopped[lane])
+                    finish(params,nets,lane,*views[lane],mses);
+                delete views[lane];
+            }
+        }
+        
+        /**
+         * \brief copy the final (or best) network out of a lane
+         * \param params training parameters
+         * \param nets the networks being trained
+         * \param lane the lane
+         * \param view the network's view of the examples
+         * \param mses array for the final MSEs, or NULL
+         */
+        void finish(typename NetT<T>::SGDParams& params,FixedNetT *nets,int lane,
+                    ExampleSetT<T>& view,double *mses){
+            FixedNetT& net = nets[lane];
+            bool best = params.storeBestNet && minError[lane]>=0;
+            for(int i=0;i<WEIGHTS;i++)
+                net.weights[i] = best ? bestWeights[i][lane] : weights[i][lane];
+            for(int i=0;i<NODES;i++)
+                net.biases[i] = best ? bestBiases[i][lane] : biases[i][lane];
+            net.modulator = modulator[lane];
+            if(mses)
+                mses[lane] = net.test(view);
+        }
+        
+        /**
+         * \brief train every lane on its current example, which is in the
+         * input layer of outputs and in targets.
+         */
+        void trainStep(double eta,SigmoidMode mode){
+            // run forwards
+            T hf[LANES];
+            for(int lane=0;lane<LANES;lane++)
+                hf[lane] = MODULATED ? modulator[lane]+1.0 : 1.0;
+            int wi=0;
+            int in=0;
+            int on=NIN;
+            for(int l=1;l<NUMLAYERS;l++){
+                for(int j=0;j<sizes[l];j++){
+                    T v[LANES];
+                    for(int lane=0;lane<LANES;lane++)
+                        v[lane]=0;
+                    for(int k=0;k<sizes[l-1];k++,wi++){
+                        for(int lane=0;lane<LANES;lane++)
+                            v[lane] += weights[wi][lane] * outputs[in+k][lane];
+                    }
+                    for(int lane=0;lane<LANES;lane++)
+                        outputs[on+j][lane] = v[lane]*hf[lane]+biases[on+j][lane];
+                    activate(mode,outputs[on+j],LANES);
+                }
+                in=on;
+                on+=sizes[l];
+            }
+            
+            // errors in the output layer
+            int n=NODES-sizes[NUMLAYERS-1];
+            for(int i=0;i<sizes[NUMLAYERS-1];i++){
+                for(int lane=0;lane<LANES;lane++){
+                    T o = outputs[n+i][lane];
+                    errors[n+i][lane] = o*(1-o)*(o-targets[i][lane]);
+                }
+            }
+            // and in the hidden layers
+            int wn=WEIGHTS;
+            for(int l=NUMLAYERS-2;l>0;l--){
+                int nnext=n;
+                n-=sizes[l];
+                wn-=sizes[l+1]*sizes[l];
+                for(int j=0;j<sizes[l];j++){
+                    for(int lane=0;lane<LANES;lane++)
+                        errors[n+j][lane]=0;
+                }
+                int w=wn;
+                for(int i=0;i<sizes[l+1];i++){
+                    for(int j=0;j<sizes[l];j++,w++){
+                        for(int lane=0;lane<LANES;lane++)
+                            errors[n+j][lane] += errors[nnext+i][lane]*weights[w][lane];
+                    }
+                }
+                for(int j=0;j<sizes[l];j++){
+                    for(int lane=0;lane<LANES;lane++){
+                        T e = errors[n+j][lane];
+                        T o = outputs[n+j][lane];
+                        if(MODULATED)
+                            errors[n+j][lane] = e * (modulator[lane]+1.0) * o * (1-o);
+                        else
+                            errors[n+j][lane] = e * o * (1-o);
+                    }
+                }
+            }
+            
+            // and apply them
+            wi=0;
+            in=0;
+            n=NIN;
+            for(int l=1;l<NUMLAYERS;l++){
+                for(int i=0;i<sizes[l];i++){
+                    // rounded as vecDelta() does
+                    T h[LANES];
+                    for(int lane=0;lane<LANES;lane++)
+                        h[lane] = (T)(MODULATED ? modulator[lane]+1.0 : 1.0);
+                    for(int k=0;k<sizes[l-1];k++,wi++){
+                        for(int lane=0;lane<LANES;lane++){
+                            T d = (T)eta*(errors[n+i][lane]*outputs[in+k][lane])*h[lane];
+                            weights[wi][lane] -= d;
+                        }
+                    }
+                    for(int lane=0;lane<LANES;lane++)
+                        biases[n+i][lane] -= eta*errors[n+i][lane];
+                }
+                in=n;
+                n+=sizes[l];
+            }
+        }
+    };
+
+    /**
+     * \brief the factor by which the weights are multiplied: h+1 for UESMANN,
+     * 1 for plain networks.
+     */
+    double modFactor() const {
+        return MODULATED ? modulator+1.0 : 1.0;
+    }
+
+    /**
+     * \brief run the network forwards, a non-virtual version of update()
+     */
+    void forward(){
+        T hfactor = modFactor();
+        const T *w=weights;
+        const T *in=outputs;
+        T *o=outputs+NIN;
+        const T *b=biases+NIN;
+        for(int l=1;l<NUMLAYERS;l++){
+            for(int j=0;j<sizes[l];j++){
+                T v=0;
+                for(int k=0;k<sizes[l-1];k++)
+                    v += *w++ * in[k];
+                o[j] = v*hfactor+b[j];
+            }
+            activate(this->sigmoidMode,o,sizes[l]);
+            in=o;
+            o+=sizes[l];
+            b+=sizes[l];
+        }
+    }
+
+    /**
+     * \brief run a single example and calculate the errors, as
+     * UESNet::calcError() does.
+     */
+    void calcError(T *in,T *out){
+        FixedNetT::setInputs(in);
+        forward();
+
+        // the output layer
+        int n=NODES-sizes[NUMLAYERS-1];
+        for(int i=0;i<sizes[NUMLAYERS-1];i++){
+            T o = outputs[n+i];
+            errors[n+i] = o*(1-o)*(o-out[i]);
+        }
+
+        // and the hidden layers, working backwards
+        int wn=WEIGHTS;
+        for(int l=NUMLAYERS-2;l>0;l--){
+            int nnext=n;
+            n-=sizes[l];
+            wn-=sizes[l+1]*sizes[l];
+            T *e=errors+n;
+            for(int j=0;j<sizes[l];j++)
+                e[j]=0;
+            const T *w=weights+wn;
+            for(int i=0;i<sizes[l+1];i++){
+                T d=errors[nnext+i];
+                for(int j=0;j<sizes[l];j++)
+                    e[j] += d * *w++;
+            }
+            for(int j=0;j<sizes[l];j++){
+                T o=outputs[n+j];
+                if(MODULATED)
+                    e[j] = e[j] * modFactor() * o * (1-o);
+                else
+                    e[j] = e[j] * o * (1-o);
+            }
+        }
+    }
+
+    /**
+     * \brief the sum of squared errors in the output layer
+     */
+    double outputError(const T *out) const {
+        double totalError=0;
+        const T *o=outputs+NODES-sizes[NUMLAYERS-1];
+        for(int i=0;i<sizes[NUMLAYERS-1];i++){
+            T e = o[i]-out[i];
+            totalError += e*e;
+        }
+        return totalError;
+    }
+
+    /**
+     * \brief train on a single example, as UESNet::trainSingle() does
+     */
+    double trainSingle(ExampleSetT<T>& ex,int idx,double eta){
+        FixedNetT::setH(ex.getH(idx));
+        T *outs = ex.getOutputs(idx);
+        calcError(ex.getInputs(idx),outs);
+
+        double hfactor = modFactor();
+        T *w=weights;
+        const T *o=outputs;
+        int n=NIN;
+        for(int l=1;l<NUMLAYERS;l++){
+            for(int i=0;i<sizes[l];i++){
+                T e = errors[n+i];
+                // rounded as vecDelta() does
+                for(int k=0;k<sizes[l-1];k++){
+                    T d = (T)eta*(e*o[k])*(T)hfactor;
+                    *w++ -= d;
+                }
+                biases[n+i] -= eta*e;
+            }
+            o+=sizes[l-1];
+            n+=sizes[l];
+        }
+        return outputError(outs);
+    }
+};
+
+template <class T,NetType TP,int... Sizes>
+constexpr int FixedNetT<T,TP,Sizes...>::sizes[];
+
+/**
+ * \brief the double-precision fixed network
+ */
+template <NetType TP,int... Sizes> using FixedNet = FixedNetT<double,TP,Sizes...>;
+
+#endif /* __FIXEDNET_HPP */
@@ -4,17 +4,43 @@
  * a grid can be generated) of how many trials of UESMANN on
  * every combination of binary boolean functions succeed.
  * 
- * This should (and does) generate approximately the same
- * data as in Fig. 5.3a of the thesis (p.100). The variation is
- * no greater than 0.001 (i.e. a single network) in each pairing
- * tested.
+ * This generates data much like that in Fig. 5.3a of the thesis
+ * (p.100), but not network for network. The original code trained
+ * each seed's network starting from the example order left by the
+ * previous network's training; here every network starts from the
+ * same order, so individual networks differ. On the four pairings
+ * checked (xor/and, and/xor, or/nor and xnor/nand) the proportions
+ * differed from the original code's by at most 0.001 (a single network).
+ * 
+ * Usage: genBoolMap [-t threads] [-j journal] [-p patience] [-d delta]
+ * 
+ * The networks are trained in blocks of seeds spread across a
+ * number of threads (by default, one per core). The output is the
+ * same whatever the number of threads. If a journal file is given,
+ * each pairing's result is added to it as it is finished, and
+ * pairings already in it are not run again - so a run which was
+ * killed can be resumed by running it again with the same journal.
+ * 
+ * With -p, each network stops training when its mean error over an
+ * epoch hasn't fallen by more than delta (given by -d, 0 by default)
+ * for that many epochs (see Net::SGDParams::stopPatience). This is
+ * much quicker, but the results move further from those of the
+ * thesis: with -p 500 -d 0.0001 a few networks stop before they succeed.
  */
 
+#include <unistd.h>
+#include <atomic>
+
 #include "netFactory.hpp"
+#include "fixednet.hpp"
+#include "threadPool.hpp"
 
 /** \brief How many networks to attempt for each pairing in genBoolMap */
 #define NUM_ATTEMPTS 1000
 
+/** \brief How many networks (seeds) each task trains in genBoolMap */
+#define SEEDS_PER_TASK 40
+
 /** \brief the learning rate for genBoolMap */
 #define ETA 0.1
 
@@ -25,6 +51,18 @@
  */
 #define EPOCHS 75000
 
+/** \brief early stopping patience in epochs, or 0 for none (set by -p) */
+static int stopPatience = 0;
+/** \brief fall in error counted as an improvement for early stopping (set by -d) */
+static double stopDelta = 0;
+
+/**
+ * \brief the network genBoolMap trains: 2-2-1 UESMANN, exactly as NetFactory
+ * would make for the examples, but with a fixed shape, which is much faster
+ * - and networks with a fixed shape can be trained several at a time.
+ */
+typedef FixedNet<NetType::UESMANN,2,2,1> BoolNet;
+
 /**
  * \brief possible inputs to boolean functions
  */
@@ -101,13 +139,18 @@ bool success(int f1,int f2,Net *n){
 
 
 /**
- * \brief Train a large number of networks to do a particular
+ * \brief Train a number of networks to do a particular
  * pairing of boolean functions (provided as indices into simpleNames)
- * and return what proportion successfully perform that pairing under
- * modulation
+ * and return how many successfully perform that pairing under
+ * modulation. The networks have consecutive seeds, and the result
+ * for each seed doesn't depend on which others are trained with it.
+ * \param f1 function at h=0
+ * \param f2 function at h=1
+ * \param firstSeed seed of the first network
+ * \param count number of networks
  */
 
-double doPairing(int f1,int f2){
+int doSeeds(int f1,int f2,int firstSeed,int count){
     // first we need to build the examples.
     // 8 examples (4 at each mod level), 2 in, 1 out, 2 mod levels
     ExampleSet e(8,2,1,2);
@@ -133,38 +176,176 @@ double doPairing(int f1,int f2){
     // single examples. This is true to the method given in the thesis,
     // alternating training between h=0 and h=1 examples.
     
-    params.storeBest().setShuffle(ExampleSet::STRIDE);
+    params.storeBest().setShuffle(ExampleSet::STRIDE)
+          .setEarlyStopping(stopPatience,stopDelta);
     
+    // train all the networks at once
+    params.setSeeds(firstSeed,count);
+    BoolNet *nets = new BoolNet[count];
+    BoolNet::trainSGDSeeds(e,params,nets);
     
     int successful = 0; // number of networks which worked
-    for(int i=0;i<NUM_ATTEMPTS;i++){
-        // make a new network
-        Net *n = NetFactory::makeNet(NetType::UESMANN,e,2);
-        // set a new PRNG and train it (this will also set the init
-        // weights)
-        params.setSeed(i);
-        // train the network
-        n->trainSGD(e,params);
-        // and increment the count if it was good
-        if(success(f1,f2,n))
+    for(int i=0;i<count;i++){
+        // increment the count if it was good
+        if(success(f1,f2,nets+i))
             successful++;
-        delete n; // remember to delete the network
     }
-    // return successful proportion
-    return ((double)successful)/(double)NUM_ATTEMPTS;
+    delete [] nets;
+    return successful;
+}
+
+/**
+ * \brief The progress of a pairing in genBoolMap, which is trained by
+ * several tasks.
+ */
+struct Pairing {
+    std::atomic<int> successful; //!< number of successful networks so far
+    std::atomic<int> tasksLeft; //!< number of tasks still to finish
+    bool done; //!< true when the result is known, protected by doneLock
+};
+
+/** \brief the 256 pairings, indexed by f1*16+f2 */
+static Pairing pairings[256];
+/** \brief protects Pairing::done and the journal */
+static std::mutex doneLock;
+/** \brief signalled when a pairing is done */
+static std::condition_variable doneCond;
+/** \brief set if a task failed, protected by doneLock */
+static bool failed = false;
+
+/**
+ * \brief Read a journal written by an earlier run, marking the pairings
+ * in it as done. Only whole lines of three numbers count: a run which was
+ * killed may have left half a line at the end, and reading stops there.
+ * \return the length of the journal up to the end of the last line read
+ */
+static long readJournal(const char *fn){
+    FILE *a = fopen(fn,"r");
+    if(!a)
+        return 0; // no journal yet, which is fine.
+    char buf[256];
+    long good=0;
+    while(fgets(buf,sizeof(buf),a)){
+        // the line must be complete, and be all numbers
+        size_t len = strlen(buf);
+        if(!len || buf[len-1]!='\n')
+            break;
+        int f1,f2,successful,n=-1;
+        if(sscanf(buf,"%d,%d,%d\n%n",&f1,&f2,&successful,&n)!=3 || n!=(int)len)
+            break;
+        if(f1<0 || f1>15 || f2<0 || f2>15 || successful<0 || successful>NUM_ATTEMPTS)
+            break;
+        Pairing& p = pairings[f1*16+f2];
+        p.successful = successful;
+        p.done = true;
+        good = ftell(a);
+    }
+    fclose(a);
+    return good;
 }
 
 /**
  * \brief The main function for genBoolMap
  */
 int main(int argc,char *argv[]){
-    // output is function 1, function 2, and correct network
-    // proportion
-    printf("a,b,correct\n");
-    // run the 256 pairings and output their correctness proportion.
+    int nthreads = 0;
+    const char *journalName = NULL;
+    int c;
+    while((c=getopt(argc,argv,"t:j:p:d:"))!=-1){
+        switch(c){
+        case 't':nthreads = atoi(optarg);break;
+        case 'j':journalName = optarg;break;
+        case 'p':stopPatience = atoi(optarg);break;
+        case 'd':stopDelta = atof(optarg);break;
+        default:
+            fprintf(stderr,"Usage: genBoolMap [-t threads] [-j journal] [-p patience] [-d delta]\n");
+            return 1;
+        }
+    }
+    if(stopPatience<0 || stopDelta<0){
+        fprintf(stderr,"patience and delta must not be negative\n");
+        return 1;
+    }
+    
+    for(int i=0;i<256;i++){
+        pairings[i].successful = 0;
+        pairings[i].done = false;
+    }
+    FILE *journal = NULL;
+    if(journalName){
+        // throw away anything after the last whole line, so that new
+        // lines don't run on from half of one
+        long len = readJournal(journalName);
+        if(access(journalName,F_OK)==0 && truncate(journalName,len)<0){
+            fprintf(stderr,"cannot truncate journal %s\n",journalName);
+            return 1;
+        }
+        journal = fopen(journalName,"a");
+        if(!journal){
+            fprintf(stderr,"cannot open journal %s\n",journalName);
+            return 1;
+        }
+    }
+    
+    // add tasks to train blocks of seeds for all the pairings not done,
+    // in order so that the results tend to arrive in order.
+    ThreadPool pool(nthreads);
+    int tasksPerPairing = (NUM_ATTEMPTS+SEEDS_PER_TASK-1)/SEEDS_PER_TASK;
     for(int f1=0;f1<16;f1++){
         for(int f2=0;f2<16;f2++){
-            printf("%d,%d,%f\n",f1,f2, doPairing(f1,f2));
+            Pairing& p = pairings[f1*16+f2];
+            if(p.done)
+                continue;
+            p.tasksLeft = tasksPerPairing;
+            for(int s=0;s<NUM_ATTEMPTS;s+=SEEDS_PER_TASK){
+                int count = NUM_ATTEMPTS-s < SEEDS_PER_TASK ? NUM_ATTEMPTS-s : SEEDS_PER_TASK;
+                pool.submit([f1,f2,s,count,&p,journal]{
+                    try {
+                        p.successful += doSeeds(f1,f2,s,count);
+                    } catch(...) {
+                        // stop main waiting; pool.wait() rethrows this
+                        std::unique_lock<std::mutex> lk(doneLock);
+                        failed = true;
+                        doneCond.notify_all();
+                        throw;
+                    }
+                    if(--p.tasksLeft==0){
+                        // the last task for the pairing records the result
+                        std::unique_lock<std::mutex> lk(doneLock);
+                        if(journal){
+                            fprintf(journal,"%d,%d,%d\n",f1,f2,(int)p.successful);
+                            fflush(journal);
+                        }
+                        p.done = true;
+                        doneCond.notify_all();
+                    }
+                });
+            }
+        }
+    }
+    
+    // output is function 1, function 2, and correct network
+    // proportion, for the 256 pairings in order as they finish.
+    printf("a,b,correct\n");
+    for(int i=0;i<256;i++){
+        Pairing& p = pairings[i];
+        {
+            std::unique_lock<std::mutex> lk(doneLock);
+            doneCond.wait(lk,[&p]{return p.done || failed;});
+            if(!p.done)
+                break;
         }
+        printf("%d,%d,%f\n",i/16,i%16,((double)p.successful)/(double)NUM_ATTEMPTS);
+        fflush(stdout);
+    }
+    int rv=0;
+    try {
+        pool.wait();
+    } catch(std::exception& e){
+        fprintf(stderr,"training failed: %s\n",e.what());
+        rv=1;
     }
+    if(journal)
+        fclose(journal);
+    return rv;
 }
@@ -11,10 +11,10 @@
 
 /**
  * \brief A modulatory network architecture which uses a plain backprop network
- * with an extra input to carry the modulator.
+ * with an extra input to carry the modulator. HInputNet is the double version.
  */
 
-class HInputNet : public BPNet {
+template <class T> class HInputNetT : public BPNetT<T> {
     /**
      * \brief The current modulator value, which is sent to the last input
      * when we train/run the network
@@ -29,9 +29,9 @@ public:
      * \param nlayers number of layers
      * \param layerCounts array of layer counts
      */
-    HInputNet(int nlayers,const int *layerCounts) : BPNet() {
+    HInputNetT(int nlayers,const int *layerCounts) : BPNetT<T>() {
         // replace the net type, it's not a plain net any more
-        type = NetType::HINPUT;
+        this->type = NetType::HINPUT;
         
         // you may have noticed that I tend to use arrays a lot rather than
         // std::vector. Sorry, I do this without realising because I'm very,
@@ -43,7 +43,7 @@ public:
         }
         ll[0]++; // add an extra input
         
-        init(nlayers,ll);
+        this->init(nlayers,ll);
         
         
     }
@@ -51,11 +51,11 @@ public:
     /**
      * \brief destructor
      */
-    virtual ~HInputNet(){
+    virtual ~HInputNetT(){
     }
     
     virtual int getLayerSize(int n) const {
-        int ct = layerSizes[n];
+        int ct = this->layerSizes[n];
         // subtract one if it's the input layer, so we
         // don't see the hidden input.
         return (n==0)?ct-1:ct;
@@ -69,18 +69,40 @@ public:
         return modulator;
     }
     
-    virtual void setInputs(double *d) {
+    virtual void setInputs(T *d) {
         // get the number of input which are not the modulator input
-        int nins = layerSizes[0]-1;
+        int nins = this->layerSizes[0]-1;
         for(int i=0;i<nins;i++){
-            setInput(i,*d++); // set manually
+            this->setInput(i,*d++); // set manually
         }
         
         // now set the final input
-        setInput(nins,modulator);
+        this->setInput(nins,modulator);
+    }
+    
+protected:
+    virtual NetT<T> *makeSimilar() const {
+        // the constructor adds the modulator input itself
+        int *ll = new int[this->numLayers];
+        for(int i=0;i<this->numLayers;i++)
+            ll[i] = getLayerSize(i);
+        NetT<T> *n = new HInputNetT(this->numLayers,ll);
+        delete [] ll;
+        return n;
+    }
+    
+    virtual void setInputRow(T *row,const T *in,double h){
+        // as setInputs(), but the modulator comes from the example
+        int nins = this->layerSizes[0]-1;
+        for(int i=0;i<nins;i++)
+            row[i] = in[i];
+        row[nins] = h;
     }
 };
 
-
+/**
+ * \brief the double-precision h-as-input network
+ */
+typedef HInputNetT<double> HInputNet;
 
 #endif /* __HINET_HPP */
@@ -0,0 +1,253 @@
+/**
+ * @file idx.hpp
+ * @brief Reading files in the IDX format used by MNIST, by mapping them
+ * into memory.
+ */
+
+#ifndef __IDX_HPP
+#define __IDX_HPP
+
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <arpa/inet.h>
+#include <string>
+#include <vector>
+#include <stdexcept>
+#include <type_traits>
+
+#include "mappedFile.hpp"
+
+/**
+ * \brief The type of the elements in an IDX file, which is the third
+ * byte of the file
+ */
+enum class IDXType {
+    UBYTE = 0x08, //!< unsigned byte
+    SBYTE = 0x09, //!< signed byte
+    SHORT = 0x0B, //!< 16-bit integer
+    INT = 0x0C, //!< 32-bit integer
+    FLOAT = 0x0D, //!< 32-bit float
+    DOUBLE = 0x0E //!< 64-bit float
+};
+
+/**
+ * \brief An IDX file (see http://yann.lecun.com/exdb/mnist/), mapped into
+ * memory so that the data is read from the file only as it is used, and
+ * shared with any other process using the same file. An IDX file holds
+ * an array of any number of dimensions, which we think of as a number
+ * of items (the first dimension), each an array of the rest. Multi-byte
+ * elements are big-endian in the file; get() converts them.
+ */
+class IDXFile {
+public:
+    /**
+     * \brief Constructor, which maps the file and checks that its size
+     * agrees with its header
+     * \param fn the file name
+     * \throws std::runtime_error if the file can't be opened or mapped, or
+     * isn't a valid IDX file
+     */
+    IDXFile(const std::string& fn) : file(fn) {
+        const uint8_t *base = file.getData();
+        size_t size = file.getSize();
+        
+        // the header is two zero bytes, the type, the number of dimensions
+        // and then each dimension as a big-endian 32-bit value
+        if(size<4)
+            throw std::runtime_error("bad IDX file "+fn);
+        type = (IDXType)base[2];
+        int ndims = base[3];
+        if(base[0] || base[1] || !elementSize(type) || !ndims)
+            throw std::runtime_error("bad magic number in IDX file "+fn);
+        size_t header = 4+4*ndims;
+        if(size<header)
+            throw std::runtime_error("truncated header in IDX file "+fn);
+
+        // the size of the elements, which once it is too big for the file
+        // is only multiplied further by zero, so it can't overflow
+        uint64_t n = elementSize(type);
+        for(int i=0;i<ndims;i++){
+            uint32_t d;
+            memcpy(&d,base+4+4*i,4);
+            dims.push_back(ntohl(d));
+            if(n<=size || !dims.back())
+                n *= dims.back();
+        }
+        if(n!=size-header)
+            throw std::runtime_error("size of IDX file "+fn+" does not agree with its header");
+        data = base+header;
+    }
+
+    /**
+     * \brief get the size in bytes of an element of a given type
+     * \return the size, or 0 if the type isn't a valid IDX type
+     */
+    static int elementSize(IDXType t){
+        switch(t){
+        case IDXType::UBYTE:
+        case IDXType::SBYTE:
+            return 1;
+        case IDXType::SHORT:
+            return 2;
+        case IDXType::INT:
+        case IDXType::FLOAT:
+            return 4;
+        case IDXType::DOUBLE:
+            return 8;
+        default:
+            return 0;
+        }
+    }
+
+    /**
+     * \brief get the type of the elements
+     */
+    IDXType getType() const {
+        return type;
+    }
+
+    /**
+     * \brief get the number of dimensions
+     */
+    int getDimCount() const {
+        return (int)dims.size();
+    }
+
+    /**
+     * \brief get the size of a dimension
+     * \param i the dimension, from 0 to getDimCount()-1
+     */
+    uint32_t getDim(int i) const {
+        return dims[i];
+    }
+
+    /**
+     * \brief get the number of items, which is the first dimension
+     */
+    uint32_t getCount() const {
+        return dims[0];
+    }
+
+    /**
+     * \brief get the number of elements in each item, which is the product
+     * of all the dimensions but the first
+     */
+    size_t getItemSize() const {
+        size_t n=1;
+        for(size_t i=1;i<dims.size();i++)
+            n*=dims[i];
+        return n;
+    }
+
+    /**
+     * \brief get the elements as they are in the file, after the header
+     */
+    const uint8_t *getData() const {
+        return data;
+    }
+
+    /**
+     * \brief get an element, converted from the file's byte order and type
+     * \param i the index of the element in the whole array
+     */
+    double get(size_t i) const {
+        switch(type){
+        case IDXType::UBYTE:
+            return data[i];
+        case IDXType::SBYTE:
+            return (int8_t)data[i];
+        case IDXType::SHORT:{
+            uint16_t v;
+            memcpy(&v,data+i*2,2);
+            return (int16_t)ntohs(v);
+        }
+        case IDXType::INT:{
+            uint32_t v;
+            memcpy(&v,data+i*4,4);
+            return (int32_t)ntohl(v);
+        }
+        case IDXType::FLOAT:{
+            uint32_t v;
+            memcpy(&v,data+i*4,4);
+            v = ntohl(v);
+            float f;
+            memcpy(&f,&v,4);
+            return f;
+        }
+        default:{
+            uint32_t v[2];
+            memcpy(v,data+i*8,8);
+            uint64_t u = ((uint64_t)ntohl(v[0])<<32)|ntohl(v[1]);
+            double d;
+            memcpy(&d,&u,8);
+            return d;
+        }
+        }
+    }
+
+    /**
+     * \brief copy a run of elements, converted as by get()
+     * \param first the index of the first element in the whole array
+     * \param n how many to copy
+     * \param dest where to copy them to
+     */
+    template <class D> void copy(size_t first,size_t n,D *dest) const {
+        if(type==IDXType::UBYTE){
+            const uint8_t *p = data+first;
+            for(size_t i=0;i<n;i++)
+                dest[i] = (D)p[i];
+        } else {
+            for(size_t i=0;i<n;i++)
+                dest[i] = (D)get(first+i);
+        }
+    }
+    
+    /**
+     * \brief write an IDX file of floats or doubles
+     * \param fn the file name
+     * \param dims the size of each dimension
+     * \param vals the elements, as many as the product of the dimensions
+     * \throws std::runtime_error if the file can't be written
+     */
+    template <class D> static void write(const std::string& fn,
+                                         const std::vector<uint32_t>& dims,
+                                         const D *vals){
+        static_assert(std::is_same<D,float>::value || std::is_same<D,double>::value,
+                      "IDX files can only be written from floats or doubles");
+        FILE *a = fopen(fn.c_str(),"wb");
+        if(!a)
+            throw std::runtime_error("cannot write IDX file "+fn);
+        uint8_t magic[] = {0,0,(uint8_t)(sizeof(D)==4 ? IDXType::FLOAT : IDXType::DOUBLE),
+            (uint8_t)dims.size()};
+        bool ok = fwrite(magic,4,1,a)==1;
+        size_t n=1;
+        for(uint32_t d: dims){
+            uint32_t v = htonl(d);
+            ok = ok && fwrite(&v,4,1,a)==1;
+            n*=d;
+        }
+        // each element big-endian
+        for(size_t i=0;ok && i<n;i++){
+            typename std::conditional<sizeof(D)==4,uint32_t,uint64_t>::type u;
+            memcpy(&u,vals+i,sizeof(D));
+            uint8_t b[sizeof(D)];
+            for(int j=sizeof(D)-1;j>=0;j--){
+                b[j] = u&255;
+                u >>= 8;
+            }
+            ok = fwrite(b,sizeof(D),1,a)==1;
+        }
+        ok = !fclose(a) && ok;
+        if(!ok)
+            throw std::runtime_error("cannot write IDX file "+fn);
+    }
+
+private:
+    MappedFile file; //!< the file
+    const uint8_t *data; //!< the elements, after the header
+    IDXType type; //!< the type of the elements
+    std::vector<uint32_t> dims; //!< the size of each dimension
+};
+
+#endif /* __IDX_HPP */
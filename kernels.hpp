@@ -0,0 +1,1261 @@
+/**
+ * @file kernels.hpp
+ * @brief Vector kernels used in the inner loops of the networks: dot
+ * product, "axpy" (add a scaled vector to another), the delta rule
+ * update of a row of weights, and an approximate sigmoid, in double
+ * and float versions. There are plain scalar versions, and SSE2, AVX2
+ * and AVX-512 versions on x86 which are chosen at run time according to
+ * what the processor supports. There are also some blocked matrix
+ * products built from these, used in batch training.
+ */
+
+#ifndef __KERNELS_HPP
+#define __KERNELS_HPP
+
+#include <stdexcept>
+#include <stdint.h>
+#include <string.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#define UESMANN_X86_KERNELS
+#include <immintrin.h>
+#endif
+
+/**
+ * \brief stops GCC fusing a multiply and an add into a fused multiply-add
+ * in a function, which it otherwise does when FMA is enabled even for
+ * separate intrinsics, and which changes the rounding. Clang only fuses
+ * within a single expression, so it doesn't need this.
+ */
+#if defined(__GNUC__) && !defined(__clang__)
+#define UESMANN_NO_FMA __attribute__((optimize("fp-contract=off")))
+#else
+#define UESMANN_NO_FMA
+#endif
+
+/**
+ * \brief The instruction set level used by the kernels. Higher levels
+ * are only available if the processor supports them.
+ */
+enum class KernelLevel {
+    SCALAR, /// \brief plain C++ loops, summing in order
+          SSE2, /// \brief 2 doubles (or 4 floats) at a time
+          AVX2, /// \brief 4 doubles (or 8 floats) at a time, with fused multiply-add
+          AVX512 /// \brief 8 doubles (or 16 floats) at a time, with fused multiply-add
+};
+
+/**
+ * \brief Plain C++ versions of the kernels, which are also used for the
+ * leftover elements in the vector versions.
+ */
+namespace scalarKernels {
+/**
+ * \brief dot product of two vectors
+ * \param a first vector
+ * \param b second vector
+ * \param n length of vectors
+ */
+inline double dot(const double *a,const double *b,int n){
+    double s = 0;
+    for(int i=0;i<n;i++)
+        s += a[i]*b[i];
+    return s;
+}
+
+/**
+ * \brief add a scaled vector to another vector, y += alpha*x
+ * \param alpha scaling factor
+ * \param x vector to scale and add
+ * \param y vector to add to
+ * \param n length of vectors
+ */
+inline void axpy(double alpha,const double *x,double *y,int n){
+    for(int i=0;i<n;i++)
+        y[i] += alpha*x[i];
+}
+
+/**
+ * \brief four dot products of vectors with the same vector,
+ * out[r] = dot(a+r*lda,b,n), with exactly the same arithmetic as dot().
+ * The vector versions share the loads of b between the four.
+ * \param a first of the four vectors
+ * \param lda distance between the four vectors
+ * \param b vector to multiply them all by
+ * \param n length of vectors
+ * \param out array of four results
+ */
+inline void dot4(const double *a,int lda,const double *b,int n,double *out){
+    for(int r=0;r<4;r++)
+        out[r] = dot(a+r*lda,b,n);
+}
+
+/**
+ * \brief add four scaled vectors to another vector, y += sum_r alpha[r]*x_r
+ * where x_r is x+r*ldx, with exactly the same arithmetic as four
+ * calls to axpy(). The vector versions only load and store y once.
+ * \param alpha array of four scaling factors
+ * \param x first of the four vectors to scale and add
+ * \param ldx distance between the four vectors
+ * \param y vector to add to
+ * \param n length of vectors
+ */
+inline void axpy4(const double *alpha,const double *x,int ldx,double *y,int n){
+    for(int r=0;r<4;r++)
+        axpy(alpha[r],x+r*ldx,y,n);
+}
+
+/**
+ * \brief the delta rule update of a row of weights from a single example,
+ * y -= eta*(e*x)*f, multiplying in that order and without fused
+ * multiply-adds in any version, so that it rounds exactly as the
+ * original element-by-element loop did.
+ * \param eta learning rate
+ * \param e error of the node
+ * \param f factor to multiply by (1 for none, which is exact)
+ * \param x outputs of the previous layer
+ * \param y weights to update
+ * \param n length of vectors
+ */
+UESMANN_NO_FMA
+inline void delta(double eta,double e,double f,const double *x,double *y,int n){
+    for(int i=0;i<n;i++){
+        double d = eta*(e*x[i])*f;
+        y[i] -= d;
+    }
+}
+
+/** \brief float dot product, see dot() */
+inline float dot(const float *a,const float *b,int n){
+    float s = 0;
+    for(int i=0;i<n;i++)
+        s += a[i]*b[i];
+    return s;
+}
+
+/** \brief float y += alpha*x, see axpy() */
+inline void axpy(float alpha,const float *x,float *y,int n){
+    for(int i=0;i<n;i++)
+        y[i] += alpha*x[i];
+}
+
+/** \brief four float dot products, see dot4() */
+inline void dot4(const float *a,int lda,const float *b,int n,float *out){
+    for(int r=0;r<4;r++)
+        out[r] = dot(a+r*lda,b,n);
+}
+
+/** \brief four float axpys into one vector, see axpy4() */
+inline void axpy4(const float *alpha,const float *x,int ldx,float *y,int n){
+    for(int r=0;r<4;r++)
+        axpy(alpha[r],x+r*ldx,y,n);
+}
+
+/** \brief float delta rule update, see delta() */
+UESMANN_NO_FMA
+inline void delta(float eta,float e,float f,const float *x,float *y,int n){
+    for(int i=0;i<n;i++){
+        float d = eta*(e*x[i])*f;
+        y[i] -= d;
+    }
+}
+
+/**
+ * \brief constants for the polynomial sigmoid, sigmoidPoly(). We work out
+ * \f$e^{-x}\f$ by splitting it into \f$2^k e^r\f$ where k is an integer
+ * and \f$|r|\le\ln 2/2\f$, building \f$2^k\f$ directly in the exponent bits
+ * and \f$e^r\f$ with a Taylor polynomial.
+ */
+namespace sigmoidPolyConsts {
+/// \brief inputs are clamped to [-CLAMP,CLAMP], where the sigmoid is 0 or 1 to within \f$10^{-34}\f$
+static const double CLAMP = 80.0;
+static const double LOG2E = 1.4426950408889634; //!< \f$\log_2 e\f$
+static const double LN2HI = 6.93147180369123816490e-01; //!< high part of \f$\ln 2\f$
+static const double LN2LO = 1.90821492927058770002e-10; //!< low part of \f$\ln 2\f$
+/// \brief adding this rounds to an integer, which is left in the low mantissa bits
+static const double ROUND = 6755399441055744.0;
+/// \brief number of terms of the double polynomial
+static const int NCOEFFS = 12;
+/// \brief Taylor coefficients 1/k! for the double polynomial, highest first
+static const double COEFFS[NCOEFFS] = {
+    1.0/39916800.0, 1.0/3628800.0, 1.0/362880.0, 1.0/40320.0,
+    1.0/5040.0, 1.0/720.0, 1.0/120.0, 1.0/24.0, 1.0/6.0, 0.5, 1.0, 1.0
+};
+static const float CLAMPF = 80.0f; //!< float version of CLAMP
+static const float LOG2EF = 1.44269504f; //!< float version of LOG2E
+static const float LN2HIF = 0.693359375f; //!< float version of LN2HI
+static const float LN2LOF = -2.12194440e-4f; //!< float version of LN2LO
+static const float ROUNDF = 12582912.0f; //!< float version of ROUND
+/// \brief number of terms of the float polynomial
+static const int NCOEFFSF = 7;
+/// \brief Taylor coefficients for the float polynomial, highest first
+static const float COEFFSF[NCOEFFSF] = {
+    1.0f/720.0f, 1.0f/120.0f, 1.0f/24.0f, 1.0f/6.0f, 0.5f, 1.0f, 1.0f
+};
+}
+
+/**
+ * \brief logistic sigmoid of each element of a vector, in place, using
+ * a polynomial approximation to the exponential (see sigmoidPolyConsts).
+ * \param x vector
+ * \param n length of vector
+ */
+inline void sigmoidPoly(double *x,int n){
+    using namespace sigmoidPolyConsts;
+    for(int i=0;i<n;i++){
+        double v = -x[i];
+        v = v>CLAMP ? CLAMP : (v<-CLAMP ? -CLAMP : v);
+        double t = v*LOG2E+ROUND;
+        double k = t-ROUND;
+        double r = v-k*LN2HI-k*LN2LO;
+        double p = COEFFS[0];
+        for(int j=1;j<NCOEFFS;j++)
+            p = p*r+COEFFS[j];
+        uint64_t bits;
+        memcpy(&bits,&t,sizeof(bits));
+        bits = (bits+1023)<<52;
+        double scale;
+        memcpy(&scale,&bits,sizeof(scale));
+        x[i] = 1.0/(1.0+p*scale);
+    }
+}
+
+/** \brief float sigmoidPoly() */
+inline void sigmoidPoly(float *x,int n){
+    using namespace sigmoidPolyConsts;
+    for(int i=0;i<n;i++){
+        float v = -x[i];
+        v = v>CLAMPF ? CLAMPF : (v<-CLAMPF ? -CLAMPF : v);
+        float t = v*LOG2EF+ROUNDF;
+        float k = t-ROUNDF;
+        float r = v-k*LN2HIF-k*LN2LOF;
+        float p = COEFFSF[0];
+        for(int j=1;j<NCOEFFSF;j++)
+            p = p*r+COEFFSF[j];
+        uint32_t bits;
+        memcpy(&bits,&t,sizeof(bits));
+        bits = (bits+127)<<23;
+        float scale;
+        memcpy(&scale,&bits,sizeof(scale));
+        x[i] = 1.0f/(1.0f+p*scale);
+    }
+}
+}
+
+#ifdef UESMANN_X86_KERNELS
+
+/**
+ * \brief SSE2 versions of the kernels; SSE2 is always present on x86-64.
+ */
+namespace sse2Kernels {
+/** \brief dot product, see scalarKernels::dot() */
+__attribute__((target("sse2")))
+inline double dot(const double *a,const double *b,int n){
+    __m128d s0 = _mm_setzero_pd();
+    __m128d s1 = _mm_setzero_pd();
+    int i=0;
+    for(;i+4<=n;i+=4){
+        s0 = _mm_add_pd(s0,_mm_mul_pd(_mm_loadu_pd(a+i),_mm_loadu_pd(b+i)));
+        s1 = _mm_add_pd(s1,_mm_mul_pd(_mm_loadu_pd(a+i+2),_mm_loadu_pd(b+i+2)));
+    }
+    s0 = _mm_add_pd(s0,s1);
+    double tmp[2];
+    _mm_storeu_pd(tmp,s0);
+    return tmp[0]+tmp[1]+scalarKernels::dot(a+i,b+i,n-i);
+}
+
+/** \brief y += alpha*x, see scalarKernels::axpy() */
+__attribute__((target("sse2")))
+inline void axpy(double alpha,const double *x,double *y,int n){
+    __m128d a = _mm_set1_pd(alpha);
+    int i=0;
+    for(;i+2<=n;i+=2)
+        _mm_storeu_pd(y+i,_mm_add_pd(_mm_loadu_pd(y+i),
+                                     _mm_mul_pd(a,_mm_loadu_pd(x+i))));
+    scalarKernels::axpy(alpha,x+i,y+i,n-i);
+}
+
+/** \brief four dot products, see scalarKernels::dot4() */
+__attribute__((target("sse2")))
+inline void dot4(const double *a,int lda,const double *b,int n,double *out){
+    __m128d s0[4],s1[4];
+    for(int r=0;r<4;r++)
+        s0[r] = s1[r] = _mm_setzero_pd();
+    int i=0;
+    for(;i+4<=n;i+=4){
+        __m128d b0 = _mm_loadu_pd(b+i);
+        __m128d b1 = _mm_loadu_pd(b+i+2);
+        for(int r=0;r<4;r++){
+            const double *ar = a+r*lda;
+            s0[r] = _mm_add_pd(s0[r],_mm_mul_pd(_mm_loadu_pd(ar+i),b0));
+            s1[r] = _mm_add_pd(s1[r],_mm_mul_pd(_mm_loadu_pd(ar+i+2),b1));
+        }
+    }
+    for(int r=0;r<4;r++){
+        double tmp[2];
+        _mm_storeu_pd(tmp,_mm_add_pd(s0[r],s1[r]));
+        out[r] = tmp[0]+tmp[1]+scalarKernels::dot(a+r*lda+i,b+i,n-i);
+    }
+}
+
+/** \brief four axpys into one vector, see scalarKernels::axpy4() */
+__attribute__((target("sse2")))
+inline void axpy4(const double *alpha,const double *x,int ldx,double *y,int n){
+    __m128d a[4];
+    for(int r=0;r<4;r++)
+        a[r] = _mm_set1_pd(alpha[r]);
+    int i=0;
+    for(;i+2<=n;i+=2){
+        __m128d v = _mm_loadu_pd(y+i);
+        for(int r=0;r<4;r++)
+            v = _mm_add_pd(v,_mm_mul_pd(a[r],_mm_loadu_pd(x+r*ldx+i)));
+        _mm_storeu_pd(y+i,v);
+    }
+    for(int r=0;r<4;r++)
+        scalarKernels::axpy(alpha[r],x+r*ldx+i,y+i,n-i);
+}
+
+/** \brief delta rule update, see scalarKernels::delta() */
+__attribute__((target("sse2"))) UESMANN_NO_FMA
+inline void delta(double eta,double e,double f,const double *x,double *y,int n){
+    __m128d a = _mm_set1_pd(eta);
+    __m128d b = _mm_set1_pd(e);
+    __m128d c = _mm_set1_pd(f);
+    int i=0;
+    for(;i+2<=n;i+=2){
+        __m128d d = _mm_mul_pd(_mm_mul_pd(a,_mm_mul_pd(b,_mm_loadu_pd(x+i))),c);
+        _mm_storeu_pd(y+i,_mm_sub_pd(_mm_loadu_pd(y+i),d));
+    }
+    scalarKernels::delta(eta,e,f,x+i,y+i,n-i);
+}
+
+/** \brief float dot product, see scalarKernels::dot() */
+__attribute__((target("sse2")))
+inline float dot(const float *a,const float *b,int n){
+    __m128 s0 = _mm_setzero_ps();
+    __m128 s1 = _mm_setzero_ps();
+    int i=0;
+    for(;i+8<=n;i+=8){
+        s0 = _mm_add_ps(s0,_mm_mul_ps(_mm_loadu_ps(a+i),_mm_loadu_ps(b+i)));
+        s1 = _mm_add_ps(s1,_mm_mul_ps(_mm_loadu_ps(a+i+4),_mm_loadu_ps(b+i+4)));
+    }
+    s0 = _mm_add_ps(s0,s1);
+    float tmp[4];
+    _mm_storeu_ps(tmp,s0);
+    return (tmp[0]+tmp[1])+(tmp[2]+tmp[3])+scalarKernels::dot(a+i,b+i,n-i);
+}
+
+/** \brief float y += alpha*x, see scalarKernels::axpy() */
+__attribute__((target("sse2")))
+inline void axpy(float alpha,const float *x,float *y,int n){
+    __m128 a = _mm_set1_ps(alpha);
+    int i=0;
+    for(;i+4<=n;i+=4)
+        _mm_storeu_ps(y+i,_mm_add_ps(_mm_loadu_ps(y+i),
+                                     _mm_mul_ps(a,_mm_loadu_ps(x+i))));
+    scalarKernels::axpy(alpha,x+i,y+i,n-i);
+}
+
+/** \brief four float dot products, see scalarKernels::dot4() */
+__attribute__((target("sse2")))
+inline void dot4(const float *a,int lda,const float *b,int n,float *out){
+    __m128 s0[4],s1[4];
+    for(int r=0;r<4;r++)
+        s0[r] = s1[r] = _mm_setzero_ps();
+    int i=0;
+    for(;i+8<=n;i+=8){
+        __m128 b0 = _mm_loadu_ps(b+i);
+        __m128 b1 = _mm_loadu_ps(b+i+4);
+        for(int r=0;r<4;r++){
+            const float *ar = a+r*lda;
+            s0[r] = _mm_add_ps(s0[r],_mm_mul_ps(_mm_loadu_ps(ar+i),b0));
+            s1[r] = _mm_add_ps(s1[r],_mm_mul_ps(_mm_loadu_ps(ar+i+4),b1));
+        }
+    }
+    for(int r=0;r<4;r++){
+        float tmp[4];
+        _mm_storeu_ps(tmp,_mm_add_ps(s0[r],s1[r]));
+        out[r] = (tmp[0]+tmp[1])+(tmp[2]+tmp[3])+
+              scalarKernels::dot(a+r*lda+i,b+i,n-i);
+    }
+}
+
+/** \brief four float axpys into one vector, see scalarKernels::axpy4() */
+__attribute__((target("sse2")))
+inline void axpy4(const float *alpha,const float *x,int ldx,float *y,int n){
+    __m128 a[4];
+    for(int r=0;r<4;r++)
+        a[r] = _mm_set1_ps(alpha[r]);
+    int i=0;
+    for(;i+4<=n;i+=4){
+        __m128 v = _mm_loadu_ps(y+i);
+        for(int r=0;r<4;r++)
+            v = _mm_add_ps(v,_mm_mul_ps(a[r],_mm_loadu_ps(x+r*ldx+i)));
+        _mm_storeu_ps(y+i,v);
+    }
+    for(int r=0;r<4;r++)
+        scalarKernels::axpy(alpha[r],x+r*ldx+i,y+i,n-i);
+}
+
+/** \brief float delta rule update, see scalarKernels::delta() */
+__attribute__((target("sse2"))) UESMANN_NO_FMA
+inline void delta(float eta,float e,float f,const float *x,float *y,int n){
+    __m128 a = _mm_set1_ps(eta);
+    __m128 b = _mm_set1_ps(e);
+    __m128 c = _mm_set1_ps(f);
+    int i=0;
+    for(;i+4<=n;i+=4){
+        __m128 d = _mm_mul_ps(_mm_mul_ps(a,_mm_mul_ps(b,_mm_loadu_ps(x+i))),c);
+        _mm_storeu_ps(y+i,_mm_sub_ps(_mm_loadu_ps(y+i),d));
+    }
+    scalarKernels::delta(eta,e,f,x+i,y+i,n-i);
+}
+}
+
+/**
+ * \brief AVX2 versions of the kernels, which also use FMA.
+ */
+namespace avx2Kernels {
+/** \brief dot product, see scalarKernels::dot() */
+__attribute__((target("avx2,fma")))
+inline double dot(const double *a,const double *b,int n){
+    __m256d s0 = _mm256_setzero_pd();
+    __m256d s1 = _mm256_setzero_pd();
+    int i=0;
+    for(;i+8<=n;i+=8){
+        s0 = _mm256_fmadd_pd(_mm256_loadu_pd(a+i),_mm256_loadu_pd(b+i),s0);
+        s1 = _mm256_fmadd_pd(_mm256_loadu_pd(a+i+4),_mm256_loadu_pd(b+i+4),s1);
+    }
+    if(i+4<=n){
+        s0 = _mm256_fmadd_pd(_mm256_loadu_pd(a+i),_mm256_loadu_pd(b+i),s0);
+        i+=4;
+    }
+    s0 = _mm256_add_pd(s0,s1);
+    __m128d s = _mm_add_pd(_mm256_castpd256_pd128(s0),
+                           _mm256_extractf128_pd(s0,1));
+    double tmp[2];
+    _mm_storeu_pd(tmp,s);
+    return tmp[0]+tmp[1]+scalarKernels::dot(a+i,b+i,n-i);
+}
+
+/** \brief y += alpha*x, see scalarKernels::axpy() */
+__attribute__((target("avx2,fma")))
+inline void axpy(double alpha,const double *x,double *y,int n){
+    __m256d a = _mm256_set1_pd(alpha);
+    int i=0;
+    for(;i+4<=n;i+=4)
+        _mm256_storeu_pd(y+i,_mm256_fmadd_pd(a,_mm256_loadu_pd(x+i),
+                                             _mm256_loadu_pd(y+i)));
+    scalarKernels::axpy(alpha,x+i,y+i,n-i);
+}
+
+/** \brief four dot products, see scalarKernels::dot4() */
+__attribute__((target("avx2,fma")))
+inline void dot4(const double *a,int lda,const double *b,int n,double *out){
+    __m256d s0[4],s1[4];
+    for(int r=0;r<4;r++)
+        s0[r] = s1[r] = _mm256_setzero_pd();
+    int i=0;
+    for(;i+8<=n;i+=8){
+        __m256d b0 = _mm256_loadu_pd(b+i);
+        __m256d b1 = _mm256_loadu_pd(b+i+4);
+        for(int r=0;r<4;r++){
+            const double *ar = a+r*lda;
+            s0[r] = _mm256_fmadd_pd(_mm256_loadu_pd(ar+i),b0,s0[r]);
+            s1[r] = _mm256_fmadd_pd(_mm256_loadu_pd(ar+i+4),b1,s1[r]);
+        }
+    }
+    if(i+4<=n){
+        __m256d b0 = _mm256_loadu_pd(b+i);
+        for(int r=0;r<4;r++)
+            s0[r] = _mm256_fmadd_pd(_mm256_loadu_pd(a+r*lda+i),b0,s0[r]);
+        i+=4;
+    }
+    for(int r=0;r<4;r++){
+        __m256d t = _mm256_add_pd(s0[r],s1[r]);
+        __m128d s = _mm_add_pd(_mm256_castpd256_pd128(t),
+                               _mm256_extractf128_pd(t,1));
+        double tmp[2];
+        _mm_storeu_pd(tmp,s);
+        out[r] = tmp[0]+tmp[1]+scalarKernels::dot(a+r*lda+i,b+i,n-i);
+    }
+}
+
+/** \brief four axpys into one vector, see scalarKernels::axpy4() */
+__attribute__((target("avx2,fma")))
+inline void axpy4(const double *alpha,const double *x,int ldx,double *y,int n){
+    __m256d a[4];
+    for(int r=0;r<4;r++)
+        a[r] = _mm256_set1_pd(alpha[r]);
+    int i=0;
+    for(;i+4<=n;i+=4){
+        __m256d v = _mm256_loadu_pd(y+i);
+        for(int r=0;r<4;r++)
+            v = _mm256_fmadd_pd(a[r],_mm256_loadu_pd(x+r*ldx+i),v);
+        _mm256_storeu_pd(y+i,v);
+    }
+    for(int r=0;r<4;r++)
+        scalarKernels::axpy(alpha[r],x+r*ldx+i,y+i,n-i);
+}
+
+/** \brief delta rule update, see scalarKernels::delta() */
+__attribute__((target("avx2,fma"))) UESMANN_NO_FMA
+inline void delta(double eta,double e,double f,const double *x,double *y,int n){
+    __m256d a = _mm256_set1_pd(eta);
+    __m256d b = _mm256_set1_pd(e);
+    __m256d c = _mm256_set1_pd(f);
+    int i=0;
+    for(;i+4<=n;i+=4){
+        __m256d d = _mm256_mul_pd(_mm256_mul_pd(a,_mm256_mul_pd(b,_mm256_loadu_pd(x+i))),c);
+        _mm256_storeu_pd(y+i,_mm256_sub_pd(_mm256_loadu_pd(y+i),d));
+    }
+    scalarKernels::delta(eta,e,f,x+i,y+i,n-i);
+}
+
+/** \brief sum the elements of a vector of 8 floats */
+__attribute__((target("avx2,fma")))
+inline float hsum(__m256 t){
+    __m128 s = _mm_add_ps(_mm256_castps256_ps128(t),_mm256_extractf128_ps(t,1));
+    float tmp[4];
+    _mm_storeu_ps(tmp,s);
+    return (tmp[0]+tmp[1])+(tmp[2]+tmp[3]);
+}
+
+/** \brief float dot product, see scalarKernels::dot() */
+__attribute__((target("avx2,fma")))
+inline float dot(const float *a,const float *b,int n){
+    __m256 s0 = _mm256_setzero_ps();
+    __m256 s1 = _mm256_setzero_ps();
+    int i=0;
+    for(;i+16<=n;i+=16){
+        s0 = _mm256_fmadd_ps(_mm256_loadu_ps(a+i),_mm256_loadu_ps(b+i),s0);
+        s1 = _mm256_fmadd_ps(_mm256_loadu_ps(a+i+8),_mm256_loadu_ps(b+i+8),s1);
+    }
+    if(i+8<=n){
+        s0 = _mm256_fmadd_ps(_mm256_loadu_ps(a+i),_mm256_loadu_ps(b+i),s0);
+        i+=8;
+    }
+    return hsum(_mm256_add_ps(s0,s1))+scalarKernels::dot(a+i,b+i,n-i);
+}
+
+/** \brief float y += alpha*x, see scalarKernels::axpy() */
+__attribute__((target("avx2,fma")))
+inline void axpy(float alpha,const float *x,float *y,int n){
+    __m256 a = _mm256_set1_ps(alpha);
+    int i=0;
+    for(;i+8<=n;i+=8)
+        _mm256_storeu_ps(y+i,_mm256_fmadd_ps(a,_mm256_loadu_ps(x+i),
+                                             _mm256_loadu_ps(y+i)));
+    scalarKernels::axpy(alpha,x+i,y+i,n-i);
+}
+
+/** \brief four float dot products, see scalarKernels::dot4() */
+__attribute__((target("avx2,fma")))
+inline void dot4(const float *a,int lda,const float *b,int n,float *out){
+    __m256 s0[4],s1[4];
+    for(int r=0;r<4;r++)
+        s0[r] = s1[r] = _mm256_setzero_ps();
+    int i=0;
+    for(;i+16<=n;i+=16){
+        __m256 b0 = _mm256_loadu_ps(b+i);
+        __m256 b1 = _mm256_loadu_ps(b+i+8);
+        for(int r=0;r<4;r++){
+            const float *ar = a+r*lda;
+            s0[r] = _mm256_fmadd_ps(_mm256_loadu_ps(ar+i),b0,s0[r]);
+            s1[r] = _mm256_fmadd_ps(_mm256_loadu_ps(ar+i+8),b1,s1[r]);
+        }
+    }
+    if(i+8<=n){
+        __m256 b0 = _mm256_loadu_ps(b+i);
+        for(int r=0;r<4;r++)
+            s0[r] = _mm256_fmadd_ps(_mm256_loadu_ps(a+r*lda+i),b0,s0[r]);
+        i+=8;
+    }
+    for(int r=0;r<4;r++)
+        out[r] = hsum(_mm256_add_ps(s0[r],s1[r]))+
+              scalarKernels::dot(a+r*lda+i,b+i,n-i);
+}
+
+/** \brief four float axpys into one vector, see scalarKernels::axpy4() */
+__attribute__((target("avx2,fma")))
+inline void axpy4(const float *alpha,const float *x,int ldx,float *y,int n){
+    __m256 a[4];
+    for(int r=0;r<4;r++)
+        a[r] = _mm256_set1_ps(alpha[r]);
+    int i=0;
+    for(;i+8<=n;i+=8){
+        __m256 v = _mm256_loadu_ps(y+i);
+        for(int r=0;r<4;r++)
+            v = _mm256_fmadd_ps(a[r],_mm256_loadu_ps(x+r*ldx+i),v);
+        _mm256_storeu_ps(y+i,v);
+    }
+    for(int r=0;r<4;r++)
+        scalarKernels::axpy(alpha[r],x+r*ldx+i,y+i,n-i);
+}
+
+/** \brief float delta rule update, see scalarKernels::delta() */
+__attribute__((target("avx2,fma"))) UESMANN_NO_FMA
+inline void delta(float eta,float e,float f,const float *x,float *y,int n){
+    __m256 a = _mm256_set1_ps(eta);
+    __m256 b = _mm256_set1_ps(e);
+    __m256 c = _mm256_set1_ps(f);
+    int i=0;
+    for(;i+8<=n;i+=8){
+        __m256 d = _mm256_mul_ps(_mm256_mul_ps(a,_mm256_mul_ps(b,_mm256_loadu_ps(x+i))),c);
+        _mm256_storeu_ps(y+i,_mm256_sub_ps(_mm256_loadu_ps(y+i),d));
+    }
+    scalarKernels::delta(eta,e,f,x+i,y+i,n-i);
+}
+
+/** \brief polynomial sigmoid in place, see scalarKernels::sigmoidPoly() */
+__attribute__((target("avx2,fma")))
+inline void sigmoidPoly(double *x,int n){
+    using namespace scalarKernels::sigmoidPolyConsts;
+    const __m256d clamp = _mm256_set1_pd(CLAMP);
+    const __m256d nclamp = _mm256_set1_pd(-CLAMP);
+    const __m256d one = _mm256_set1_pd(1.0);
+    int i=0;
+    for(;i+4<=n;i+=4){
+        __m256d v = _mm256_sub_pd(_mm256_setzero_pd(),_mm256_loadu_pd(x+i));
+        v = _mm256_min_pd(_mm256_max_pd(v,nclamp),clamp);
+        __m256d t = _mm256_fmadd_pd(v,_mm256_set1_pd(LOG2E),_mm256_set1_pd(ROUND));
+        __m256d k = _mm256_sub_pd(t,_mm256_set1_pd(ROUND));
+        __m256d r = _mm256_fnmadd_pd(k,_mm256_set1_pd(LN2HI),v);
+        r = _mm256_fnmadd_pd(k,_mm256_set1_pd(LN2LO),r);
+        __m256d p = _mm256_set1_pd(COEFFS[0]);
+        for(int j=1;j<NCOEFFS;j++)
+            p = _mm256_fmadd_pd(p,r,_mm256_set1_pd(COEFFS[j]));
+        __m256i e = _mm256_slli_epi64(_mm256_add_epi64(_mm256_castpd_si256(t),
+                                                       _mm256_set1_epi64x(1023)),52);
+        p = _mm256_mul_pd(p,_mm256_castsi256_pd(e));
+        _mm256_storeu_pd(x+i,_mm256_div_pd(one,_mm256_add_pd(one,p)));
+    }
+    scalarKernels::sigmoidPoly(x+i,n-i);
+}
+
+/** \brief float polynomial sigmoid in place, see scalarKernels::sigmoidPoly() */
+__attribute__((target("avx2,fma")))
+inline void sigmoidPoly(float *x,int n){
+    using namespace scalarKernels::sigmoidPolyConsts;
+    const __m256 clamp = _mm256_set1_ps(CLAMPF);
+    const __m256 nclamp = _mm256_set1_ps(-CLAMPF);
+    const __m256 one = _mm256_set1_ps(1.0f);
+    int i=0;
+    for(;i+8<=n;i+=8){
+        __m256 v = _mm256_sub_ps(_mm256_setzero_ps(),_mm256_loadu_ps(x+i));
+        v = _mm256_min_ps(_mm256_max_ps(v,nclamp),clamp);
+        __m256 t = _mm256_fmadd_ps(v,_mm256_set1_ps(LOG2EF),_mm256_set1_ps(ROUNDF));
+        __m256 k = _mm256_sub_ps(t,_mm256_set1_ps(ROUNDF));
+        __m256 r = _mm256_fnmadd_ps(k,_mm256_set1_ps(LN2HIF),v);
+        r = _mm256_fnmadd_ps(k,_mm256_set1_ps(LN2LOF),r);
+        __m256 p = _mm256_set1_ps(COEFFSF[0]);
+        for(int j=1;j<NCOEFFSF;j++)
+            p = _mm256_fmadd_ps(p,r,_mm256_set1_ps(COEFFSF[j]));
+        __m256i e = _mm256_slli_epi32(_mm256_add_epi32(_mm256_castps_si256(t),
+                                                       _mm256_set1_epi32(127)),23);
+        p = _mm256_mul_ps(p,_mm256_castsi256_ps(e));
+        _mm256_storeu_ps(x+i,_mm256_div_ps(one,_mm256_add_ps(one,p)));
+    }
+    scalarKernels::sigmoidPoly(x+i,n-i);
+}
+}
+
+/**
+ * \brief AVX-512 versions of the kernels.
+ */
+namespace avx512Kernels {
+/** \brief dot product, see scalarKernels::dot() */
+__attribute__((target("avx512f")))
+inline double dot(const double *a,const double *b,int n){
+    __m512d s0 = _mm512_setzero_pd();
+    __m512d s1 = _mm512_setzero_pd();
+    int i=0;
+    for(;i+16<=n;i+=16){
+        s0 = _mm512_fmadd_pd(_mm512_loadu_pd(a+i),_mm512_loadu_pd(b+i),s0);
+        s1 = _mm512_fmadd_pd(_mm512_loadu_pd(a+i+8),_mm512_loadu_pd(b+i+8),s1);
+    }
+    if(i+8<=n){
+        s0 = _mm512_fmadd_pd(_mm512_loadu_pd(a+i),_mm512_loadu_pd(b+i),s0);
+        i+=8;
+    }
+    return _mm512_reduce_add_pd(_mm512_add_pd(s0,s1))+
+          scalarKernels::dot(a+i,b+i,n-i);
+}
+
+/** \brief y += alpha*x, see scalarKernels::axpy() */
+__attribute__((target("avx512f")))
+inline void axpy(double alpha,const double *x,double *y,int n){
+    __m512d a = _mm512_set1_pd(alpha);
+    int i=0;
+    for(;i+8<=n;i+=8)
+        _mm512_storeu_pd(y+i,_mm512_fmadd_pd(a,_mm512_loadu_pd(x+i),
+                                             _mm512_loadu_pd(y+i)));
+    scalarKernels::axpy(alpha,x+i,y+i,n-i);
+}
+
+/** \brief four dot products, see scalarKernels::dot4() */
+__attribute__((target("avx512f")))
+inline void dot4(const double *a,int lda,const double *b,int n,double *out){
+    __m512d s0[4],s1[4];
+    for(int r=0;r<4;r++)
+        s0[r] = s1[r] = _mm512_setzero_pd();
+    int i=0;
+    for(;i+16<=n;i+=16){
+        __m512d b0 = _mm512_loadu_pd(b+i);
+        __m512d b1 = _mm512_loadu_pd(b+i+8);
+        for(int r=0;r<4;r++){
+            const double *ar = a+r*lda;
+            s0[r] = _mm512_fmadd_pd(_mm512_loadu_pd(ar+i),b0,s0[r]);
+            s1[r] = _mm512_fmadd_pd(_mm512_loadu_pd(ar+i+8),b1,s1[r]);
+        }
+    }
+    if(i+8<=n){
+        __m512d b0 = _mm512_loadu_pd(b+i);
+        for(int r=0;r<4;r++)
+            s0[r] = _mm512_fmadd_pd(_mm512_loadu_pd(a+r*lda+i),b0,s0[r]);
+        i+=8;
+    }
+    for(int r=0;r<4;r++)
+        out[r] = _mm512_reduce_add_pd(_mm512_add_pd(s0[r],s1[r]))+
+              scalarKernels::dot(a+r*lda+i,b+i,n-i);
+}
+
+/** \brief four axpys into one vector, see scalarKernels::axpy4() */
+__attribute__((target("avx512f")))
+inline void axpy4(const double *alpha,const double *x,int ldx,double *y,int n){
+    __m512d a[4];
+    for(int r=0;r<4;r++)
+        a[r] = _mm512_set1_pd(alpha[r]);
+    int i=0;
+    for(;i+8<=n;i+=8){
+        __m512d v = _mm512_loadu_pd(y+i);
+        for(int r=0;r<4;r++)
+            v = _mm512_fmadd_pd(a[r],_mm512_loadu_pd(x+r*ldx+i),v);
+        _mm512_storeu_pd(y+i,v);
+    }
+    for(int r=0;r<4;r++)
+        scalarKernels::axpy(alpha[r],x+r*ldx+i,y+i,n-i);
+}
+
+/** \brief delta rule update, see scalarKernels::delta() */
+__attribute__((target("avx512f"))) UESMANN_NO_FMA
+inline void delta(double eta,double e,double f,const double *x,double *y,int n){
+    __m512d a = _mm512_set1_pd(eta);
+    __m512d b = _mm512_set1_pd(e);
+    __m512d c = _mm512_set1_pd(f);
+    int i=0;
+    for(;i+8<=n;i+=8){
+        __m512d d = _mm512_mul_pd(_mm512_mul_pd(a,_mm512_mul_pd(b,_mm512_loadu_pd(x+i))),c);
+        _mm512_storeu_pd(y+i,_mm512_sub_pd(_mm512_loadu_pd(y+i),d));
+    }
+    scalarKernels::delta(eta,e,f,x+i,y+i,n-i);
+}
+
+/** \brief float dot product, see scalarKernels::dot() */
+__attribute__((target("avx512f")))
+inline float dot(const float *a,const float *b,int n){
+    __m512 s0 = _mm512_setzero_ps();
+    __m512 s1 = _mm512_setzero_ps();
+    int i=0;
+    for(;i+32<=n;i+=32){
+        s0 = _mm512_fmadd_ps(_mm512_loadu_ps(a+i),_mm512_loadu_ps(b+i),s0);
+        s1 = _mm512_fmadd_ps(_mm512_loadu_ps(a+i+16),_mm512_loadu_ps(b+i+16),s1);
+    }
+    if(i+16<=n){
+        s0 = _mm512_fmadd_ps(_mm512_loadu_ps(a+i),_mm512_loadu_ps(b+i),s0);
+        i+=16;
+    }
+    return _mm512_reduce_add_ps(_mm512_add_ps(s0,s1))+
+          scalarKernels::dot(a+i,b+i,n-i);
+}
+
+/** \brief float y += alpha*x, see scalarKernels::axpy() */
+__attribute__((target("avx512f")))
+inline void axpy(float alpha,const float *x,float *y,int n){
+    __m512 a = _mm512_set1_ps(alpha);
+    int i=0;
+    for(;i+16<=n;i+=16)
+        _mm512_storeu_ps(y+i,_mm512_fmadd_ps(a,_mm512_loadu_ps(x+i),
+                                             _mm512_loadu_ps(y+i)));
+    scalarKernels::axpy(alpha,x+i,y+i,n-i);
+}
+
+/** \brief four float dot products, see scalarKernels::dot4() */
+__attribute__((target("avx512f")))
+inline void dot4(const float *a,int lda,const float *b,int n,float *out){
+    __m512 s0[4],s1[4];
+    for(int r=0;r<4;r++)
+        s0[r] = s1[r] = _mm512_setzero_ps();
+    int i=0;
+    for(;i+32<=n;i+=32){
+        __m512 b0 = _mm512_loadu_ps(b+i);
+        __m512 b1 = _mm512_loadu_ps(b+i+16);
+        for(int r=0;r<4;r++){
+            const float *ar = a+r*lda;
+            s0[r] = _mm512_fmadd_ps(_mm512_loadu_ps(ar+i),b0,s0[r]);
+            s1[r] = _mm512_fmadd_ps(_mm512_loadu_ps(ar+i+16),b1,s1[r]);
+        }
+    }
+    if(i+16<=n){
+        __m512 b0 = _mm512_loadu_ps(b+i);
+        for(int r=0;r<4;r++)
+            s0[r] = _mm512_fmadd_ps(_mm512_loadu_ps(a+r*lda+i),b0,s0[r]);
+        i+=16;
+    }
+    for(int r=0;r<4;r++)
+        out[r] = _mm512_reduce_add_ps(_mm512_add_ps(s0[r],s1[r]))+
+              scalarKernels::dot(a+r*lda+i,b+i,n-i);
+}
+
+/** \brief four float axpys into one vector, see scalarKernels::axpy4() */
+__attribute__((target("avx512f")))
+inline void axpy4(const float *alpha,const float *x,int ldx,float *y,int n){
+    __m512 a[4];
+    for(int r=0;r<4;r++)
+        a[r] = _mm512_set1_ps(alpha[r]);
+    int i=0;
+    for(;i+16<=n;i+=16){
+        __m512 v = _mm512_loadu_ps(y+i);
+        for(int r=0;r<4;r++)
+            v = _mm512_fmadd_ps(a[r],_mm512_loadu_ps(x+r*ldx+i),v);
+        _mm512_storeu_ps(y+i,v);
+    }
+    for(int r=0;r<4;r++)
+        scalarKernels::axpy(alpha[r],x+r*ldx+i,y+i,n-i);
+}
+
+/** \brief float delta rule update, see scalarKernels::delta() */
+__attribute__((target("avx512f"))) UESMANN_NO_FMA
+inline void delta(float eta,float e,float f,const float *x,float *y,int n){
+    __m512 a = _mm512_set1_ps(eta);
+    __m512 b = _mm512_set1_ps(e);
+    __m512 c = _mm512_set1_ps(f);
+    int i=0;
+    for(;i+16<=n;i+=16){
+        __m512 d = _mm512_mul_ps(_mm512_mul_ps(a,_mm512_mul_ps(b,_mm512_loadu_ps(x+i))),c);
+        _mm512_storeu_ps(y+i,_mm512_sub_ps(_mm512_loadu_ps(y+i),d));
+    }
+    scalarKernels::delta(eta,e,f,x+i,y+i,n-i);
+}
+
+/** \brief polynomial sigmoid in place, see scalarKernels::sigmoidPoly() */
+__attribute__((target("avx512f")))
+inline void sigmoidPoly(double *x,int n){
+    using namespace scalarKernels::sigmoidPolyConsts;
+    const __m512d clamp = _mm512_set1_pd(CLAMP);
+    const __m512d nclamp = _mm512_set1_pd(-CLAMP);
+    const __m512d one = _mm512_set1_pd(1.0);
+    int i=0;
+    for(;i+8<=n;i+=8){
+        __m512d v = _mm512_sub_pd(_mm512_setzero_pd(),_mm512_loadu_pd(x+i));
+        v = _mm512_min_pd(_mm512_max_pd(v,nclamp),clamp);
+        __m512d t = _mm512_fmadd_pd(v,_mm512_set1_pd(LOG2E),_mm512_set1_pd(ROUND));
+        __m512d k = _mm512_sub_pd(t,_mm512_set1_pd(ROUND));
+        __m512d r = _mm512_fnmadd_pd(k,_mm512_set1_pd(LN2HI),v);
+        r = _mm512_fnmadd_pd(k,_mm512_set1_pd(LN2LO),r);
+        __m512d p = _mm512_set1_pd(COEFFS[0]);
+        for(int j=1;j<NCOEFFS;j++)
+            p = _mm512_fmadd_pd(p,r,_mm512_set1_pd(COEFFS[j]));
+        __m512i e = _mm512_slli_epi64(_mm512_add_epi64(_mm512_castpd_si512(t),
+                                                       _mm512_set1_epi64(1023)),52);
+        p = _mm512_mul_pd(p,_mm512_castsi512_pd(e));
+        _mm512_storeu_pd(x+i,_mm512_div_pd(one,_mm512_add_pd(one,p)));
+    }
+    scalarKernels::sigmoidPoly(x+i,n-i);
+}
+
+/** \brief float polynomial sigmoid in place, see scalarKernels::sigmoidPoly() */
+__attribute__((target("avx512f")))
+inline void sigmoidPoly(float *x,int n){
+    using namespace scalarKernels::sigmoidPolyConsts;
+    const __m512 clamp = _mm512_set1_ps(CLAMPF);
+    const __m512 nclamp = _mm512_set1_ps(-CLAMPF);
+    const __m512 one = _mm512_set1_ps(1.0f);
+    int i=0;
+    for(;i+16<=n;i+=16){
+        __m512 v = _mm512_sub_ps(_mm512_setzero_ps(),_mm512_loadu_ps(x+i));
+        v = _mm512_min_ps(_mm512_max_ps(v,nclamp),clamp);
+        __m512 t = _mm512_fmadd_ps(v,_mm512_set1_ps(LOG2EF),_mm512_set1_ps(ROUNDF));
+        __m512 k = _mm512_sub_ps(t,_mm512_set1_ps(ROUNDF));
+        __m512 r = _mm512_fnmadd_ps(k,_mm512_set1_ps(LN2HIF),v);
+        r = _mm512_fnmadd_ps(k,_mm512_set1_ps(LN2LOF),r);
+        __m512 p = _mm512_set1_ps(COEFFSF[0]);
+        for(int j=1;j<NCOEFFSF;j++)
+            p = _mm512_fmadd_ps(p,r,_mm512_set1_ps(COEFFSF[j]));
+        __m512i e = _mm512_slli_epi32(_mm512_add_epi32(_mm512_castps_si512(t),
+                                                       _mm512_set1_epi32(127)),23);
+        p = _mm512_mul_ps(p,_mm512_castsi512_ps(e));
+        _mm512_storeu_ps(x+i,_mm512_div_ps(one,_mm512_add_ps(one,p)));
+    }
+    scalarKernels::sigmoidPoly(x+i,n-i);
+}
+}
+
+#endif /* UESMANN_X86_KERNELS */
+
+/**
+ * \brief The kernel dispatch table. On first use this selects the best
+ * level supported by the processor, but this can be overridden with
+ * setLevel() (for example, to use SCALAR so that sums are done in
+ * the same order as the original code).
+ */
+class Kernels {
+public:
+    /// \brief type of dot product functions
+    typedef double (*DotFunc)(const double *,const double *,int);
+    /// \brief type of axpy functions
+    typedef void (*AxpyFunc)(double,const double *,double *,int);
+    /// \brief type of four-way dot product functions
+    typedef void (*Dot4Func)(const double *,int,const double *,int,double *);
+    /// \brief type of four-way axpy functions
+    typedef void (*Axpy4Func)(const double *,const double *,int,double *,int);
+    /// \brief type of delta rule update functions
+    typedef void (*DeltaFunc)(double,double,double,const double *,double *,int);
+
+    /// \brief type of float dot product functions
+    typedef float (*DotFuncF)(const float *,const float *,int);
+    /// \brief type of float axpy functions
+    typedef void (*AxpyFuncF)(float,const float *,float *,int);
+    /// \brief type of float four-way dot product functions
+    typedef void (*Dot4FuncF)(const float *,int,const float *,int,float *);
+    /// \brief type of float four-way axpy functions
+    typedef void (*Axpy4FuncF)(const float *,const float *,int,float *,int);
+    /// \brief type of float delta rule update functions
+    typedef void (*DeltaFuncF)(float,float,float,const float *,float *,int);
+    /// \brief type of in-place polynomial sigmoid functions
+    typedef void (*SigmoidFunc)(double *,int);
+    /// \brief type of in-place float polynomial sigmoid functions
+    typedef void (*SigmoidFuncF)(float *,int);
+
+    DotFunc dot; //!< the current dot product
+    AxpyFunc axpy; //!< the current axpy
+    Dot4Func dot4; //!< the current four-way dot product
+    Axpy4Func axpy4; //!< the current four-way axpy
+    DeltaFunc delta; //!< the current delta rule update
+    DotFuncF dotf; //!< the current float dot product
+    AxpyFuncF axpyf; //!< the current float axpy
+    Dot4FuncF dot4f; //!< the current float four-way dot product
+    Axpy4FuncF axpy4f; //!< the current float four-way axpy
+    DeltaFuncF deltaf; //!< the current float delta rule update
+    SigmoidFunc sigmoidPoly; //!< the current polynomial sigmoid
+    SigmoidFuncF sigmoidPolyf; //!< the current float polynomial sigmoid
+
+    /**
+     * \brief get the dispatch table, initialising it if required
+     */
+    static Kernels& get(){
+        static Kernels k;
+        return k;
+    }
+
+    /**
+     * \brief is a given level supported by this processor?
+     */
+    static bool supported(KernelLevel l){
+        switch(l){
+        case KernelLevel::SCALAR:
+            return true;
+#ifdef UESMANN_X86_KERNELS
+        case KernelLevel::SSE2:
+            return __builtin_cpu_supports("sse2");
+        case KernelLevel::AVX2:
+            return __builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma");
+        case KernelLevel::AVX512:
+            return __builtin_cpu_supports("avx512f");
+#endif
+        default:
+            return false;
+        }
+    }
+
+    /**
+     * \brief get the best level this processor supports
+     */
+    static KernelLevel best(){
+        if(supported(KernelLevel::AVX512))return KernelLevel::AVX512;
+        if(supported(KernelLevel::AVX2))return KernelLevel::AVX2;
+        if(supported(KernelLevel::SSE2))return KernelLevel::SSE2;
+        return KernelLevel::SCALAR;
+    }
+
+    /**
+     * \brief select a kernel level for all subsequent operations. This is
+     * not thread safe, and should be done before any networks are run.
+     * \throws std::runtime_error the processor does not support this level
+     */
+    static void setLevel(KernelLevel l){
+        if(!supported(l))
+            throw std::runtime_error("kernel level not supported by this processor");
+        get().select(l);
+    }
+
+    /**
+     * \brief get the current kernel level
+     */
+    static KernelLevel getLevel(){
+        return get().level;
+    }
+
+private:
+    KernelLevel level; //!< the current level
+
+    /**
+     * \brief private constructor, which selects the best available level.
+     */
+    Kernels(){
+        select(best());
+    }
+
+    /**
+     * \brief set up the function pointers for a given level
+     */
+    void select(KernelLevel l){
+        level = l;
+        switch(l){
+#ifdef UESMANN_X86_KERNELS
+        case KernelLevel::SSE2:
+            dot = sse2Kernels::dot;
+            axpy = sse2Kernels::axpy;
+            dot4 = sse2Kernels::dot4;
+            axpy4 = sse2Kernels::axpy4;
+            dotf = sse2Kernels::dot;
+            axpyf = sse2Kernels::axpy;
+            dot4f = sse2Kernels::dot4;
+            axpy4f = sse2Kernels::axpy4;
+            delta = sse2Kernels::delta;
+            deltaf = sse2Kernels::delta;
+            sigmoidPoly = scalarKernels::sigmoidPoly;
+            sigmoidPolyf = scalarKernels::sigmoidPoly;
+            break;
+        case KernelLevel::AVX2:
+            dot = avx2Kernels::dot;
+            axpy = avx2Kernels::axpy;
+            dot4 = avx2Kernels::dot4;
+            axpy4 = avx2Kernels::axpy4;
+            dotf = avx2Kernels::dot;
+            axpyf = avx2Kernels::axpy;
+            dot4f = avx2Kernels::dot4;
+            axpy4f = avx2Kernels::axpy4;
+            delta = avx2Kernels::delta;
+            deltaf = avx2Kernels::delta;
+            sigmoidPoly = avx2Kernels::sigmoidPoly;
+            sigmoidPolyf = avx2Kernels::sigmoidPoly;
+            break;
+        case KernelLevel::AVX512:
+            dot = avx512Kernels::dot;
+            axpy = avx512Kernels::axpy;
+            dot4 = avx512Kernels::dot4;
+            axpy4 = avx512Kernels::axpy4;
+            dotf = avx512Kernels::dot;
+            axpyf = avx512Kernels::axpy;
+            dot4f = avx512Kernels::dot4;
+            axpy4f = avx512Kernels::axpy4;
+            delta = avx512Kernels::delta;
+            deltaf = avx512Kernels::delta;
+            sigmoidPoly = avx512Kernels::sigmoidPoly;
+            sigmoidPolyf = avx512Kernels::sigmoidPoly;
+            break;
+#endif
+        default:
+            dot = scalarKernels::dot;
+            axpy = scalarKernels::axpy;
+            dot4 = scalarKernels::dot4;
+            axpy4 = scalarKernels::axpy4;
+            dotf = scalarKernels::dot;
+            axpyf = scalarKernels::axpy;
+            dot4f = scalarKernels::dot4;
+            axpy4f = scalarKernels::axpy4;
+            delta = scalarKernels::delta;
+            deltaf = scalarKernels::delta;
+            sigmoidPoly = scalarKernels::sigmoidPoly;
+            sigmoidPolyf = scalarKernels::sigmoidPoly;
+            break;
+        }
+    }
+};
+
+/**
+ * \brief dot product of two vectors using the current kernels
+ * \param a first vector
+ * \param b second vector
+ * \param n length of vectors
+ */
+inline double vecDot(const double *a,const double *b,int n){
+    return Kernels::get().dot(a,b,n);
+}
+
+/**
+ * \brief y += alpha*x using the current kernels
+ * \param alpha scaling factor
+ * \param x vector to scale and add
+ * \param y vector to add to
+ * \param n length of vectors
+ */
+inline void vecAxpy(double alpha,const double *x,double *y,int n){
+    Kernels::get().axpy(alpha,x,y,n);
+}
+
+/**
+ * \brief four dot products with the same vector using the current
+ * kernels, see scalarKernels::dot4()
+ */
+inline void vecDot4(const double *a,int lda,const double *b,int n,double *out){
+    Kernels::get().dot4(a,lda,b,n,out);
+}
+
+/**
+ * \brief four axpys into the same vector using the current kernels,
+ * see scalarKernels::axpy4()
+ */
+inline void vecAxpy4(const double *alpha,const double *x,int ldx,double *y,int n){
+    Kernels::get().axpy4(alpha,x,ldx,y,n);
+}
+
+/**
+ * \brief the delta rule update y -= eta*(e*x)*f using the current kernels,
+ * see scalarKernels::delta()
+ */
+inline void vecDelta(double eta,double e,double f,const double *x,double *y,int n){
+    Kernels::get().delta(eta,e,f,x,y,n);
+}
+
+/** \brief float dot product using the current kernels */
+inline float vecDot(const float *a,const float *b,int n){
+    return Kernels::get().dotf(a,b,n);
+}
+
+/** \brief float y += alpha*x using the current kernels */
+inline void vecAxpy(float alpha,const float *x,float *y,int n){
+    Kernels::get().axpyf(alpha,x,y,n);
+}
+
+/** \brief float delta rule update using the current kernels */
+inline void vecDelta(float eta,float e,float f,const float *x,float *y,int n){
+    Kernels::get().deltaf(eta,e,f,x,y,n);
+}
+
+/** \brief four float dot products using the current kernels */
+inline void vecDot4(const float *a,int lda,const float *b,int n,float *out){
+    Kernels::get().dot4f(a,lda,b,n,out);
+}
+
+/** \brief four float axpys using the current kernels */
+inline void vecAxpy4(const float *alpha,const float *x,int ldx,float *y,int n){
+    Kernels::get().axpy4f(alpha,x,ldx,y,n);
+}
+
+/**
+ * \brief polynomial sigmoid of a vector in place using the current
+ * kernels, see scalarKernels::sigmoidPoly(). There is no SSE2 version,
+ * so that level uses the scalar one.
+ */
+inline void vecSigmoidPoly(double *x,int n){
+    Kernels::get().sigmoidPoly(x,n);
+}
+
+/** \brief float polynomial sigmoid in place using the current kernels */
+inline void vecSigmoidPoly(float *x,int n){
+    Kernels::get().sigmoidPolyf(x,n);
+}
+
+/**
+ * \brief how many rows of a row-major matrix with n columns to process at
+ * a time in the blocked matrix routines, so that the block fits in the
+ * L1 cache (roughly).
+ */
+template <class T> int matBlockRows(int n){
+    int r = (32768/sizeof(T))/(n>0?n:1);
+    return r<1 ? 1 : r;
+}
+
+/**
+ * \brief matrix product \f$C=AB^T\f$, where A is m x k, B is n x k and C is
+ * m x n, all row-major with leading dimensions lda, ldb and ldc. Each element
+ * is a single vecDot() so the result is the same as doing the rows one at a
+ * time. This is blocked over rows of B, so each block of B stays in cache
+ * while all the rows of A go past it.
+ */
+template <class T> void matMulNT(int m,int n,int k,
+                                const T *a,int lda,
+                                const T *b,int ldb,
+                                T *c,int ldc){
+    int nb = matBlockRows<T>(k);
+    for(int j0=0;j0<n;j0+=nb){
+        int j1 = j0+nb<n ? j0+nb : n;
+        int i=0;
+        // four rows of A at a time, sharing the loads of B
+        for(;i+4<=m;i+=4){
+            for(int j=j0;j<j1;j++){
+                T out[4];
+                vecDot4(a+i*lda,lda,b+j*ldb,k,out);
+                for(int r=0;r<4;r++)
+                    c[(i+r)*ldc+j] = out[r];
+            }
+        }
+        for(;i<m;i++){
+            const T *arow = a+i*lda;
+            for(int j=j0;j<j1;j++)
+                c[i*ldc+j] = vecDot(arow,b+j*ldb,k);
+        }
+    }
+}
+
+/**
+ * \brief matrix product \f$C=AB\f$, where A is m x k, B is k x n and C is
+ * m x n, all row-major with leading dimensions lda, ldb and ldc. Each row
+ * of C is built up by adding rows of B in order.
+ */
+template <class T> void matMulNN(int m,int n,int k,
+                                const T *a,int lda,
+                                const T *b,int ldb,
+                                T *c,int ldc){
+    for(int i=0;i<m;i++){
+        T *crow = c+i*ldc;
+        for(int j=0;j<n;j++)
+            crow[j]=0;
+        const T *arow = a+i*lda;
+        for(int p=0;p<k;p++)
+            vecAxpy(arow[p],b+p*ldb,crow,n);
+    }
+}
+
+/**
+ * \brief accumulating matrix product \f$C=C+A^TSB\f$, where A is m x k, B is
+ * m x n, C is k x n and S is an optional diagonal matrix of row scales
+ * (NULL for none); all row-major with leading dimensions lda, ldb and ldc.
+ * Each element of C has the rows added in order. This is blocked over rows
+ * of C so that each block stays in cache while all the rows of A and B go
+ * past it.
+ */
+template <class T> void matMulTNAcc(int m,int n,int k,
+                                   const T *a,int lda,
+                                   const T *b,int ldb,
+                                   const T *s,
+                                   T *c,int ldc){
+    int kb = matBlockRows<T>(n);
+    for(int p0=0;p0<k;p0+=kb){
+        int p1 = p0+kb<k ? p0+kb : k;
+        int i=0;
+        // four rows of A and B at a time, so each row of C is
+        // only loaded and stored once for the four
+        for(;i+4<=m;i+=4){
+            for(int p=p0;p<p1;p++){
+                T v[4];
+                for(int r=0;r<4;r++){
+                    v[r] = a[(i+r)*lda+p];
+                    if(s)v[r]*=s[i+r];
+                }
+                vecAxpy4(v,b+i*ldb,ldb,c+p*ldc,n);
+            }
+        }
+        for(;i<m;i++){
+            const T *arow = a+i*lda;
+            const T *brow = b+i*ldb;
+            for(int p=p0;p<p1;p++){
+                T v = s ? arow[p]*s[i] : arow[p];
+                vecAxpy(v,brow,c+p*ldc,n);
+            }
+        }
+    }
+}
+
+#endif /* __KERNELS_HPP */
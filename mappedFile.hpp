@@ -0,0 +1,77 @@
+/**
+ * @file mappedFile.hpp
+ * @brief A file mapped into memory, used for reading data files in place.
+ */
+
+#ifndef __MAPPEDFILE_HPP
+#define __MAPPEDFILE_HPP
+
+#include <stdint.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <string>
+#include <stdexcept>
+
+/**
+ * \brief A whole file mapped into memory, so that it is read only as it is
+ * used and shares the page cache with any other process using the file.
+ * The mapping is private: the contents can be changed in memory, but this
+ * only copies the pages changed and never changes the file.
+ */
+class MappedFile {
+public:
+    /**
+     * \brief Constructor, which maps the file
+     * \param fn the file name
+     * \throws std::runtime_error if the file can't be opened or mapped
+     */
+    MappedFile(const std::string& fn){
+        int fd = open(fn.c_str(),O_RDONLY);
+        if(fd<0)
+            throw std::runtime_error("cannot open "+fn+": "+strerror(errno));
+        struct stat st;
+        if(fstat(fd,&st)<0 || st.st_size==0){
+            close(fd);
+            throw std::runtime_error("cannot map empty file "+fn);
+        }
+        size = st.st_size;
+        base = (uint8_t *)mmap(NULL,size,PROT_READ|PROT_WRITE,MAP_PRIVATE,fd,0);
+        close(fd); // the mapping keeps the file open
+        if(base==MAP_FAILED)
+            throw std::runtime_error("cannot map "+fn+": "+strerror(errno));
+    }
+
+    /**
+     * \brief Destructor, which unmaps the file
+     */
+    ~MappedFile(){
+        munmap(base,size);
+    }
+
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+
+    /**
+     * \brief get the contents of the file
+     */
+    uint8_t *getData() const {
+        return base;
+    }
+
+    /**
+     * \brief get the size of the file in bytes
+     */
+    size_t getSize() const {
+        return size;
+    }
+
+private:
+    uint8_t *base; //!< the start of the mapping
+    size_t size; //!< the size of the file
+};
+
+#endif /* __MAPPEDFILE_HPP */
@@ -0,0 +1,239 @@
+/**
+ * @file metrics.hpp
+ * @brief Sinks for the metrics recorded during training, such as the
+ * cross-validation error, which can be kept in memory or written to a file.
+ *
+ */
+
+#ifndef __METRICS_HPP
+#define __METRICS_HPP
+
+#include <stdio.h>
+#include <vector>
+#include <deque>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <stdexcept>
+
+/**
+ * \brief A single metrics record, written at each cross-validation event
+ * during Net::trainSGD().
+ */
+struct MetricsRecord {
+    int iteration; //!< the training iteration at which it was recorded
+    int slice; //!< the cross-validation slice tested
+    double error; //!< the MSE on that slice
+
+    MetricsRecord(){}
+
+    /**
+     * \brief Constructor
+     * \param it iteration
+     * \param s cross-validation slice
+     * \param e MSE
+     */
+    MetricsRecord(int it,int s,double e) : iteration(it),slice(s),error(e) {}
+};
+
+/**
+ * \brief The abstract metrics sink, which receives records from training
+ * when set in the training parameters with SGDParams::setMetrics(). If
+ * no sink is set, nothing is recorded. Records may be sent by several
+ * training threads at once.
+ */
+class MetricsSink {
+public:
+    virtual ~MetricsSink(){}
+
+    /**
+     * \brief add a record
+     */
+    virtual void record(const MetricsRecord& r)=0;
+
+    /**
+     * \brief make sure all the records added so far have been dealt with;
+     * this is called at the end of training.
+     */
+    virtual void flush(){}
+};
+
+/**
+ * \brief A metrics sink which keeps the most recent records in memory, up to
+ * a fixed number.
+ */
+class RingBufferMetrics : public MetricsSink {
+public:
+    /**
+     * \brief Constructor
+     * \param capacity the number of records to keep
+     */
+    explicit RingBufferMetrics(int capacity){
+        if(capacity<1)
+            throw std::out_of_range("metrics capacity must be at least 1");
+        buf.resize(capacity);
+        start=0;
+        ct=0;
+        total=0;
+    }
+
+    virtual void record(const MetricsRecord& r){
+        std::unique_lock<std::mutex> lk(lock);
+        int cap = buf.size();
+        if(ct<cap)
+            buf[(start+ct++)%cap]=r;
+        else {
+            // full, so overwrite the oldest
+            buf[start]=r;
+            start=(start+1)%cap;
+        }
+        total++;
+    }
+
+    /**
+     * \brief get the number of records held, which is at most the capacity
+     */
+    int getCount() {
+        std::unique_lock<std::mutex> lk(lock);
+        return ct;
+    }
+
+    /**
+     * \brief get the number of records ever added
+     */
+    long getTotal() {
+        std::unique_lock<std::mutex> lk(lock);
+        return total;
+    }
+
+    /**
+     * \brief get a record
+     * \param i index of the record, 0 being the oldest held
+     */
+    MetricsRecord get(int i) {
+        std::unique_lock<std::mutex> lk(lock);
+        if(i<0 || i>=ct)
+            throw std::out_of_range("metrics record index out of range");
+        return buf[(start+i)%buf.size()];
+    }
+
+    /**
+     * \brief remove all the records
+     */
+    void clear() {
+        std::unique_lock<std::mutex> lk(lock);
+        start=0;
+        ct=0;
+        total=0;
+    }
+
+private:
+    std::mutex lock; //!< protects everything below
+    std::vector<MetricsRecord> buf; //!< the records
+    int start; //!< index of the oldest record
+    int ct; //!< number of records held
+    long total; //!< number of records ever added
+};
+
+/**
+ * \brief A metrics sink which writes records to a CSV file, with the columns
+ * "x,slice,y" (iteration, cross-validation slice and MSE). Records are
+ * collected into batches, which are written by a background thread,
+ * so training doesn't wait for the file.
+ */
+class FileMetrics : public MetricsSink {
+public:
+    /**
+     * \brief Constructor, which opens (and truncates) the file and starts the
+     * writing thread.
+     * \param fn file name
+     * \param batch number of records in each batch handed to the writer
+     * \throws std::runtime_error if the file can't be opened
+     */
+    explicit FileMetrics(const char *fn,int batch=256){
+        f = fopen(fn,"w");
+        if(!f)
+            throw std::runtime_error("cannot open metrics file");
+        fprintf(f,"x,slice,y\n");
+        batchSize = batch>0 ? batch : 1;
+        stopping = false;
+        writing = false;
+        writer = std::thread(&FileMetrics::run,this);
+    }
+
+    /**
+     * \brief Destructor, which writes any remaining records and closes the file
+     */
+    virtual ~FileMetrics(){
+        flush();
+        {
+            std::unique_lock<std::mutex> lk(lock);
+            stopping = true;
+        }
+        cond.notify_one();
+        writer.join();
+        fclose(f);
+    }
+
+    virtual void record(const MetricsRecord& r){
+        std::unique_lock<std::mutex> lk(lock);
+        current.push_back(r);
+        if((int)current.size()>=batchSize){
+            // hand the batch to the writer
+            batches.push_back(std::vector<MetricsRecord>());
+            batches.back().swap(current);
+            cond.notify_one();
+        }
+    }
+
+    /**
+     * \brief hand over any partial batch and wait for the writer to write
+     * everything so far
+     */
+    virtual void flush(){
+        std::unique_lock<std::mutex> lk(lock);
+        if(!current.empty()){
+            batches.push_back(std::vector<MetricsRecord>());
+            batches.back().swap(current);
+            cond.notify_one();
+        }
+        drained.wait(lk,[this]{return batches.empty() && !writing;});
+        fflush(f);
+    }
+
+private:
+    FILE *f; //!< the file
+    int batchSize; //!< records in each batch
+    std::thread writer; //!< the writer thread
+    std::mutex lock; //!< protects everything below
+    std::condition_variable cond; //!< signalled when there's a batch or we are stopping
+    std::condition_variable drained; //!< signalled when the writer has written a batch
+    std::vector<MetricsRecord> current; //!< the batch being filled
+    std::deque<std::vector<MetricsRecord> > batches; //!< batches waiting to be written
+    bool writing; //!< true while the writer is writing a batch
+    bool stopping; //!< set to make the writer exit
+
+    /**
+     * \brief the body of the writer thread
+     */
+    void run(){
+        std::unique_lock<std::mutex> lk(lock);
+        for(;;){
+            cond.wait(lk,[this]{return stopping || !batches.empty();});
+            if(batches.empty())
+                return; // stopping, and nothing left to write
+            std::vector<MetricsRecord> b;
+            b.swap(batches.front());
+            batches.pop_front();
+            writing = true;
+            lk.unlock();
+            for(size_t i=0;i<b.size();i++)
+                fprintf(f,"%d,%d,%f\n",b[i].iteration,b[i].slice,b[i].error);
+            lk.lock();
+            writing = false;
+            drained.notify_all();
+        }
+    }
+};
+
+#endif /* __METRICS_HPP */
@@ -10,15 +10,17 @@
 
 #include <stdint.h>
 #include <stdio.h>
-#include <stdlib.h>
-#include <errno.h>
-#include <string.h>
-#include <arpa/inet.h>
+#include <memory>
 #include <stdexcept>
 
+#include "idx.hpp"
+
 /**
  * \brief This class encapsulates and loads data in the standard MNIST format.
- * The data resides in two files, an image file and a label file. 
+ * The data resides in two files, an image file and a label file, which
+ * are IDX files of bytes (see IDXFile). These are mapped into memory rather
+ * than read, so loading is almost instant and the images are only read from
+ * the file as they are used.
  */
 
 class MNIST {
@@ -27,89 +29,36 @@ public:
      * \brief constructor which loads the data from the given file, and can load
      * only part of the data in a file.
      * \param labelFile the name of the file containing the labels
-     * \param imgFile the name of the file containing the image data
+     * \param imgFile the name of the file containing the image data; this may
+     * have any number of dimensions after the count, with the rows first and the
+     * rest taken as the columns
      * \param start the image number to start loading from
      * \param len how many images to load (0 means all)
+     * \throws std::runtime_error if the files can't be read or are not valid
      */
     
-    MNIST(const char *labelFile,const char *imgFile,int start=0,int len=0){
-        valid = false;
-        int rd;
-        FILE *a = fopen(labelFile,"rb");
-        if(!a){
-            printf("Error opening label file %s: %s\n",labelFile,strerror(errno));;
-            throw std::runtime_error("cannot open label file: " + std::string(labelFile));
-            exit(1);
-        }
-        uint32_t magic;
-        rd=fread(&magic,sizeof(uint32_t),1,a);
-        magic = htonl(magic);
-        if(magic!=2049){
-            printf("incorrect magic number in label file %s: %x\n",labelFile,magic);
-            throw std::runtime_error("bad magic number in label file");
-        }
-        rd=fread(&ct,sizeof(uint32_t),1,a);
-        ct = htonl(ct);
-        if(ct>100000){
-            printf("unfeasibly large count in label file %s: %x\n",labelFile,ct);
-            throw std::runtime_error("bad count in label file");
-        }
+    MNIST(const char *labelFile,const char *imgFile,int start=0,int len=0) :
+          labelIdx(new IDXFile(labelFile)),imgIdx(new IDXFile(imgFile)) {
+        if(labelIdx->getType()!=IDXType::UBYTE || labelIdx->getDimCount()!=1)
+            throw std::runtime_error("bad magic number in label file "+std::string(labelFile));
+        if(imgIdx->getType()!=IDXType::UBYTE || imgIdx->getDimCount()<2)
+            throw std::runtime_error("bad magic number in image file "+std::string(imgFile));
         
-        if(!len)len=ct;
-        if(start+len>ct){
-            printf("specified range [%d-%d], only %d in file %s\n",start,start+len,ct,labelFile);
-            throw std::runtime_error("bad range in label file");
-        }
-        fseek(a,start*sizeof(uint8_t),SEEK_CUR); // skip some
-        
-        labels = new uint8_t[len];
-        rd = fread(labels,sizeof(uint8_t),len,a);
-        if(rd!=len){
-            printf("not enough items in label file %s: %d\n",labelFile,rd);
-            throw std::runtime_error("not enough elements in label file");
-        }
-        fclose(a);
+        uint32_t n = labelIdx->getCount();
+        if(imgIdx->getCount()!=n)
+            throw std::runtime_error("image file count does not agree with label file count: "+
+                                     std::string(imgFile));
+        if(start<0 || len<0 || (uint32_t)start>n)
+            throw std::runtime_error("bad range in label file "+std::string(labelFile));
+        if(!len)len=n-start;
+        if((uint32_t)len>n-start)
+            throw std::runtime_error("bad range in label file "+std::string(labelFile));
         
-        
-        a = fopen(imgFile,"rb");
-        if(!a){
-            printf("Error opening image file %s: %s\n",imgFile,strerror(errno));
-            throw std::runtime_error("cannot open image file: " + std::string(imgFile));
-        }        
-        rd=fread(&magic,sizeof(uint32_t),1,a);
-        magic=htonl(magic);
-        if(magic!=2051){
-            printf("incorrect magic number in image file %s: %d\n",imgFile,magic);
-            throw std::runtime_error("bad magic in image file");
-        }
-        uint32_t ct2;
-        rd=fread(&ct2,sizeof(uint32_t),1,a);
-        ct2=htonl(ct2);
-        if(ct2!=ct){
-            printf("image file count does not agree with label file count:\n"
-                   "%s:%d != %s:%d\n",
-                   imgFile,ct2,labelFile,ct);
-            throw std::runtime_error("bad count in image file");
-        }
-        
-        rd=fread(&rows,sizeof(uint32_t),1,a);
-        rows = htonl(rows);
-        rd=fread(&cols,sizeof(uint32_t),1,a);
-        cols = htonl(cols);
-        if(rows > 128 || cols > 128){
-            printf("Bad dimensions in image file %s: %dx%d\n",imgFile,rows,cols);
-            throw std::runtime_error("bad dimensions in image file");
-        }
-        
-        fseek(a,start*sizeof(uint8_t)*rows*cols,SEEK_CUR); // skip some
-        imgs = new uint8_t[len*rows*cols];
-        rd = fread(imgs,sizeof(uint8_t),rows*cols*len,a);
-        if(rd!=len*rows*cols){
-            printf("wrong amount of pixels in image file %s: %d\n",imgFile,rd);
-            throw std::runtime_error("bad filesize in image file");
-        }
-        fclose(a);
-        ct=len;
+        rows = imgIdx->getDim(1);
+        cols = imgIdx->getItemSize()/(rows ? rows : 1);
+        ct = len;
+        labels = labelIdx->getData()+start;
+        imgs = imgIdx->getData()+(size_t)start*rows*cols;
         
         // get the max label
         maxLabel=0;
@@ -120,15 +69,6 @@ public:
         
     }
     
-    
-    /**
-     * \brief Destructor
-     */
-    ~MNIST(){
-        delete [] labels;
-        delete [] imgs;
-    }
-    
     /**
      * \brief returns the number of examples
      */
@@ -167,13 +107,36 @@ public:
         return maxLabel;
     }
     
+    /**
+     * \brief get the labels of all the examples
+     */
+    const uint8_t *getLabels() const {
+        return labels;
+    }
+    
     /**
      * \brief get the bitmap for a given example
      * \return a pointer to the first pixel in the image
      */
     
-    uint8_t *getImg(int n) const {
-        return imgs+rows*cols*n;
+    const uint8_t *getImg(int n) const {
+        return imgs+(size_t)rows*cols*n;
+    }
+    
+    /**
+     * \brief get the mapped label file, which holds the memory getLabels()
+     * points into, so that it can be kept after this object is deleted
+     */
+    std::shared_ptr<const IDXFile> getLabelFile() const {
+        return labelIdx;
+    }
+    
+    /**
+     * \brief get the mapped image file, which holds the memory getImg() points
+     * into, as getLabelFile()
+     */
+    std::shared_ptr<const IDXFile> getImageFile() const {
+        return imgIdx;
     }
     
     /**
@@ -194,7 +157,7 @@ public:
             printf("Out of range\n");
         else {
             printf("Label: %d\n",getLabel(i));
-            uint8_t *d = getImg(i);
+            const uint8_t *d = getImg(i);
             for(int x=0;x<r();x++){
                 for(int y=0;y<c();y++){
                     uint8_t qq = *d++ / 25;
@@ -208,9 +171,14 @@ public:
     
 private:
     /**
-     * \brief is the data valid - false if there was a problem in loading
+     * \brief the mapped label file
+     */
+    std::shared_ptr<const IDXFile> labelIdx;
+    
+    /**
+     * \brief the mapped image file
      */
-    bool valid;
+    std::shared_ptr<const IDXFile> imgIdx;
     
     /**
      * \brief the number of rows in each image
@@ -233,15 +201,15 @@ private:
     uint8_t maxLabel;
     
     /**
-     * \brief pointer to the label data
+     * \brief pointer to the label data, in the label file
      */
     
-    uint8_t *labels;
+    const uint8_t *labels;
     
     /**
-     * \brief pointer to the image data
+     * \brief pointer to the image data, in the image file
      */
-    uint8_t *imgs;
+    const uint8_t *imgs;
 };
 
 
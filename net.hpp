@@ -9,42 +9,37 @@
 #define __NET_HPP
 
 #include <math.h>
+#include <string.h>
+#include <time.h>
+#include <atomic>
+#include <chrono>
+#include <algorithm>
 
 #include "netType.hpp"
 #include "data.hpp"
-
-/**
- * Logistic sigmoid function, which is our activation function
- */
-
-inline double sigmoid(double x){
-    return 1.0/(1.0+exp(-x));
-}
-
-/**
- * The derivative of the sigmoid function
- */
-
-inline double sigmoidDiff(double x){
-    double s = sigmoid(x);
-    return (1.0-s)*s;
-}
+#include "activation.hpp"
+#include "optimizer.hpp"
+#include "metrics.hpp"
+#include "checkpoint.hpp"
+#include "threadPool.hpp"
 
 /**
  * \brief 
  * The abstract network type upon which all others are based.
  * It's not pure virtual, in that it encapsulates some high
  * level operations (such as the top-level training algorithm).
+ * The parameters, inputs and outputs are of the scalar type T, which is
+ * double or float; Net is the double version.
  */
-class Net {
-    friend class OutputBlendingNet;
-    friend class HInputNet;
+template <class T> class NetT {
+    template <class> friend class OutputBlendingNetT;
+    template <class> friend class HInputNetT;
 public:
     
     /**
      * \brief virtual destructor which does nothing
      */
-    virtual ~Net() {} 
+    virtual ~NetT() {} 
     
     NetType type; //!< type of the network, used for load/save
     drand48_data rd; //!< PRNG data (thread safe)
@@ -87,29 +82,74 @@ public:
     
     /**
      * \brief Set the inputs to the network before running or training
-     * \param d array of doubles, the size of the input layer
+     * \param d array of values, the size of the input layer
      */
     
-    virtual void setInputs(double *d) = 0;
+    virtual void setInputs(T *d) = 0;
     
     /**
      * \brief Get the outputs after running
      * \return pointer to the output layer outputs
      */
     
-    virtual double *getOutputs() const = 0;
+    virtual T *getOutputs() const = 0;
     
     /**
      * \brief Run the network on some data.
-     * \param in pointer to the input double array
-     * \return pointer to the output double array
+     * \param in pointer to the input array
+     * \return pointer to the output array
      */
-    double *run(double *in) {
+    T *run(T *in) {
         setInputs(in);
         update();
         return getOutputs();
     }
     
+    /**
+     * \brief Run the network on many sets of inputs at once.
+     * This version just calls run() for each; subclasses which can
+     * evaluate a whole batch with matrix products override it. The
+     * modulator set by setH() is left unchanged.
+     * \param in   inputs, num rows of getInputCount() values
+     * \param h    modulator for each row, or NULL to use the current modulator
+     * for all of them
+     * \param num  number of rows
+     * \param out  num rows of getOutputCount() values to receive the outputs
+     */
+    virtual void runBatch(const T *in,const double *h,int num,T *out){
+        int nin = getInputCount();
+        int nout = getOutputCount();
+        double oldh = getH();
+        for(int e=0;e<num;e++){
+            if(h)setH(h[e]);
+            T *o = run(const_cast<T *>(in+e*nin));
+            for(int i=0;i<nout;i++)
+                out[e*nout+i] = o[i];
+        }
+        setH(oldh);
+    }
+    
+    /**
+     * \brief Run the network on a range of examples at once, each at
+     * its own modulator level. As the other runBatch(), this leaves the
+     * modulator set by setH() unchanged.
+     * \param examples example set
+     * \param start    index of first example to run
+     * \param num      number of examples to run
+     * \param out      num rows of getOutputCount() values to receive the outputs
+     */
+    virtual void runBatch(ExampleSetT<T>& examples,int start,int num,T *out){
+        int nout = getOutputCount();
+        double oldh = getH();
+        for(int e=0;e<num;e++){
+            setH(examples.getH(start+e));
+            T *o = run(examples.getInputs(start+e));
+            for(int i=0;i<nout;i++)
+                out[e*nout+i] = o[i];
+        }
+        setH(oldh);
+    }
+    
     /**
      * \brief Set the modulator level for subsequent runs and training of this
      * network.
@@ -121,6 +161,22 @@ public:
      */
     virtual double getH() const =0;
     
+    /**
+     * \brief Set how the sigmoid is calculated when this network is run
+     * or trained, trading accuracy for speed - see SigmoidMode. The default
+     * is SigmoidMode::EXACT.
+     */
+    virtual void setSigmoidMode(SigmoidMode m){
+        sigmoidMode = m;
+    }
+    
+    /**
+     * \brief get how the sigmoid is calculated, see setSigmoidMode()
+     */
+    SigmoidMode getSigmoidMode() const {
+        return sigmoidMode;
+    }
+    
     /**
      * \brief Test a network.
      * Runs the network over a set of examples and returns the mean MSE for all outputs
@@ -139,25 +195,31 @@ public:
      * \param num      number of examples to test (or -1 for all after start point).
      * 
      */
-    double test(ExampleSet& examples,int start=0,int num=-1){
+    double test(ExampleSetT<T>& examples,int start=0,int num=-1){
         double mseSum = 0;
         // have to do this here, too, although runExamples does it, so we can
         // get the denominator for the mse.
         if(num<0)num=examples.getCount()-start;
         
-        // for each example, run it and accumulate the sum of squared errors
-        // on all outputs 
-        
-        for(int i=0;i<num;i++){
-            int idx = start+i;
-            setH(examples.getH(idx));
-            double *netout = run(examples.getInputs(idx));
-            double *exout = examples.getOutputs(idx);
-            for(int j=0;j<examples.getOutputCount();j++){
-                double d = netout[j]-exout[j];
-                mseSum += d*d;
+        // run the examples in chunks with runBatch(), and accumulate the
+        // sum of squared errors on all outputs
+        
+        static const int CHUNK=256;
+        int nout = examples.getOutputCount();
+        T *netouts = new T[CHUNK*nout];
+        for(int s=0;s<num;s+=CHUNK){
+            int n = num-s < CHUNK ? num-s : CHUNK;
+            runBatch(examples,start+s,n,netouts);
+            for(int i=0;i<n;i++){
+                T *netout = netouts+i*nout;
+                T *exout = examples.getOutputs(start+s+i);
+                for(int j=0;j<nout;j++){
+                    double d = netout[j]-exout[j];
+                    mseSum += d*d;
+                }
             }
         }
+        delete [] netouts;
         
         // we then divide by the number of examples and the output count.
         return mseSum / (num * examples.getOutputCount());
@@ -171,12 +233,13 @@ public:
      * You can set parameters by hand, but there are fluent (chainable) setters for many members.
      */
     struct SGDParams {
-        friend class Net;
+        friend class NetT;
         
         /**
          * \brief number of iterations to run: an iteration is the presentation of a single example, NOT
          * an epoch (or occasionally pair-presentation) as is the case in the thesis when discussing the modulatory
-         * network types.
+         * network types. When training in mini-batches (see batchSize) each batch counts as
+         * as many iterations as it has examples.
          */
         int iterations;
         
@@ -185,7 +248,204 @@ public:
          */
         double eta;
         
+        /**
+         * \brief number of examples to train on at each step: 1 (the default)
+         * is plain stochastic gradient descent, larger values train in
+         * mini-batches. The last batch of each epoch may be smaller.
+         */
+        int batchSize;
         
+        /** \brief fluent setter for batchSize */
+        SGDParams& setBatchSize(int n){
+            if(n<1)
+                throw std::out_of_range("batch size must be at least 1");
+            batchSize = n;
+            return *this;
+        }
+
+        /**
+         * \brief how the gradients are applied to the parameters (see Optimizer);
+         * the default is plain gradient descent. The others keep state for each
+         * parameter, which is zeroed at the start of trainSGD(). RMSPROP and ADAM
+         * scale the steps to the size of the gradients, so need a much smaller
+         * eta (0.001 is usual). Only networks based on BPNet can use them, and
+         * not when training in several threads (see threads).
+         */
+        Optimizer optimizer;
+
+        /** \brief momentum, or the decay of Adam's mean gradient; the default is 0.9 */
+        double beta1;
+
+        /** \brief decay of the mean squared gradient for RMSProp and Adam; the default is 0.999 */
+        double beta2;
+
+        /** \brief added to the root mean squared gradient by RMSProp and Adam; the default is 1e-8 */
+        double epsilon;
+
+        /**
+         * \brief fluent setter for the optimizer and its parameters
+         * \param o the optimizer
+         * \param b1 momentum, or the decay of Adam's mean gradient
+         * \param b2 decay of the mean squared gradient
+         * \param eps added to the root mean squared gradient
+         */
+        SGDParams& setOptimizer(Optimizer o,double b1=0.9,double b2=0.999,double eps=1e-8){
+            if(b1<0 || b1>=1 || b2<0 || b2>=1 || eps<0)
+                throw std::out_of_range("bad optimizer parameters");
+            optimizer = o;
+            beta1 = b1;
+            beta2 = b2;
+            epsilon = eps;
+            return *this;
+        }
+        
+        /**
+         * \brief how eta changes during training (see EtaSchedule); the default
+         * is to keep it constant. When training in several threads (see threads)
+         * it only changes between cross-validation events or epochs.
+         */
+        EtaSchedule schedule;
+        
+        /** \brief the interval of the schedule in iterations, see EtaSchedule */
+        int scheduleInterval;
+        
+        /** \brief the factor of the schedule, see EtaSchedule */
+        double scheduleFactor;
+        
+        /**
+         * \brief for EtaSchedule::COSINE_RESTARTS, the factor by which each
+         * period is longer than the last; the default is 1.
+         */
+        int restartMult;
+        
+        /**
+         * \brief fluent setter for the schedule
+         * \param s the schedule
+         * \param interval its interval in iterations (not needed for COSINE)
+         * \param factor its factor, which should be below 1
+         * \param mult the increase in the period for COSINE_RESTARTS
+         */
+        SGDParams& setSchedule(EtaSchedule s,int interval,double factor,int mult=1){
+            if(interval<1 && s!=EtaSchedule::CONSTANT && s!=EtaSchedule::COSINE)
+                throw std::out_of_range("schedule interval must be at least 1");
+            if(factor<0 || mult<1)
+                throw std::out_of_range("bad schedule parameters");
+            schedule = s;
+            scheduleInterval = interval;
+            scheduleFactor = factor;
+            restartMult = mult;
+            return *this;
+        }
+        
+        /**
+         * \brief get the learning rate at a point in training, following the
+         * schedule
+         * \param i number of iterations done
+         * \param progress proportion of training done, from 0 to 1 (used by
+         * EtaSchedule::COSINE)
+         */
+        double getEta(int i,double progress) const {
+            switch(schedule){
+            case EtaSchedule::STEP:
+                return eta*pow(scheduleFactor,i/scheduleInterval);
+            case EtaSchedule::EXPONENTIAL:
+                return eta*pow(scheduleFactor,(double)i/scheduleInterval);
+            case EtaSchedule::COSINE:
+                break;
+            case EtaSchedule::COSINE_RESTARTS:{
+                // find the period we're in and how far through it we are
+                long period = scheduleInterval;
+                long start = 0;
+                if(restartMult==1)
+                    start = (i/period)*period;
+                else {
+                    while(i>=start+period){
+                        start += period;
+                        period *= restartMult;
+                    }
+                }
+                progress = (double)(i-start)/period;
+                break;
+            }
+            default:
+                return eta;
+            }
+            if(progress>1)
+                progress=1;
+            double etaMin = eta*scheduleFactor;
+            return etaMin+(eta-etaMin)*0.5*(1.0+cos(M_PI*progress));
+        }
+        
+        /**
+         * \brief if not empty, the file to which the state of training is saved
+         * every checkpointInterval iterations, so that an interrupted run can be
+         * resumed (see resume). The file is written in the background, to a
+         * temporary file which then replaces it. The state is that of the network
+         * and everything trainSGD() keeps, except for anything recorded by the
+         * metrics sink. Checkpoints can't be taken when training in several
+         * threads or cross-validating in the background (see threads and asyncCV).
+         */
+        std::string checkpointFile;
+        
+        /** \brief the number of iterations between checkpoints, see checkpointFile */
+        int checkpointInterval;
+        
+        /**
+         * \brief if true and checkpointFile exists, trainSGD() carries on from the
+         * checkpoint rather than starting again, and gives exactly the same result
+         * as it would have if it hadn't been interrupted. The other parameters
+         * should be the same as those the checkpoint was made with, although
+         * iterations can be increased to train for longer. The default is true.
+         */
+        bool resume;
+        
+        /**
+         * \brief fluent setter for checkpointing
+         * \param fn the file to save the state to
+         * \param interval number of iterations between checkpoints
+         * \param res whether to resume from the file if it exists
+         */
+        SGDParams& setCheckpoint(const std::string& fn,int interval,bool res=true){
+            if(interval<1)
+                throw std::out_of_range("checkpoint interval must be at least 1");
+            checkpointFile = fn;
+            checkpointInterval = interval;
+            resume = res;
+            return *this;
+        }
+        
+        /**
+         * \brief if positive, the time in seconds after which training stops,
+         * which may then be before the given number of iterations (the number run
+         * is put in stoppedAt). The time is checked every 64 batches, or at every
+         * cross-validation event or epoch when training in several threads. The
+         * default, 0, is no limit.
+         */
+        double timeLimit;
+        
+        /**
+         * \brief if true, timeLimit is in CPU time used by the thread calling
+         * trainSGD() rather than wall-clock time, so that other work on the
+         * machine (including other networks in an EnsembleTrainer) doesn't
+         * count. Time spent by the threads used for threads, batchThreads and
+         * asyncCV is not counted, so these should be used with wall-clock time.
+         */
+        bool timeLimitCPU;
+        
+        /**
+         * \brief fluent setter for the time limit
+         * \param seconds time after which to stop, or 0 for no limit
+         * \param cpu true to measure CPU time rather than wall-clock time
+         */
+        SGDParams& setTimeLimit(double seconds,bool cpu=false){
+            if(seconds<0)
+                throw std::out_of_range("time limit must not be negative");
+            timeLimit = seconds;
+            timeLimitCPU = cpu;
+            return *this;
+        }
+
+
         /**
          * \brief The number of cross-validation slices to use
          */
@@ -215,13 +475,13 @@ public:
         }
         
         /**
-         * \brief The shuffle mode to use - see the ExampleSet::ShuffleMode
+         * \brief The shuffle mode to use - see the ExampleSetBase::ShuffleMode
          * enum for details.
          */
-        ExampleSet::ShuffleMode shuffleMode;
+        ExampleSetBase::ShuffleMode shuffleMode;
         
         /** \brief fluent setter for preserveHAlternation */
-        SGDParams& setShuffle(ExampleSet::ShuffleMode m){
+        SGDParams& setShuffle(ExampleSetBase::ShuffleMode m){
             shuffleMode = m;
             return *this;
         }
@@ -277,11 +537,173 @@ public:
             return *this;
         }
         
+        /**
+         * \brief number of networks to train, with consecutive seeds starting at
+         * seed, when training a batch of seeds with FixedNetT::trainSGDSeeds().
+         * Ignored by trainSGD(), which trains a single network.
+         */
+        int seedCount;
+        
+        /** \brief fluent setter for a batch of seeds
+         * \param first seed of the first network
+         * \param count number of networks, which have seeds first, first+1...
+         */
+        SGDParams& setSeeds(long first,int count){
+            if(count<1)
+                throw std::out_of_range("seed count must be at least 1");
+            seed = first;
+            seedCount = count;
+            return *this;
+        }
+        
+        /**
+         * \brief number of threads to train in. With more than one, each thread
+         * trains on its own shuffled view of the training examples with its own
+         * working storage, applying its updates to the shared weights and biases
+         * without any locking ("Hogwild!" training, Niu et al. 2011). Updates
+         * which collide can be lost, which makes little difference with many
+         * parameters and sparse-ish gradients. The threads train for cvInterval
+         * iterations between cross-validation events (or an epoch without
+         * cross-validation), and the best network is chosen on the mean training
+         * error over that period. Only BPNet and UESNet can be trained like this;
+         * the default is 1.
+         */
+        int threads;
+        
+        /** \brief fluent setter for threads */
+        SGDParams& setThreads(int n){
+            if(n<1)
+                throw std::out_of_range("thread count must be at least 1");
+            threads = n;
+            return *this;
+        }
+        
+        /**
+         * \brief number of threads to split each mini-batch across. With more than
+         * one, the examples in each batch are dealt out in contiguous shards, each
+         * thread sums the gradients of its shard into its own buffers, and the
+         * buffers are added together in a fixed order before the update is applied.
+         * Unlike training in several threads (see threads), this gives exactly the
+         * same network each time for a given seed and thread count, although
+         * not the same as with a different thread count because the sums are
+         * done in a different order. It only helps with large batches (64 or
+         * more MNIST examples, say), cannot be used with threads, and only
+         * BPNet and UESNet can be trained like this; the default is 1.
+         */
+        int batchThreads;
+        
+        /** \brief fluent setter for batchThreads */
+        SGDParams& setBatchThreads(int n){
+            if(n<1)
+                throw std::out_of_range("thread count must be at least 1");
+            batchThreads = n;
+            return *this;
+        }
+        
+        /**
+         * \brief if true, cross-validation is done in a background thread so that
+         * training doesn't wait for it. At each cross-validation event a snapshot
+         * of the network is taken and queued, and the background thread tests it
+         * on a copy of the network. The training itself is unchanged, but when
+         * selectBestWithCV is set the best network is the snapshot with the lowest
+         * cross-validation error (rather than the lowest training error at a
+         * cross-validation event, which is what happens otherwise), and when
+         * cvShuffle is set the cross-validation examples are shuffled with a
+         * separate generator. The default is false.
+         */
+        bool asyncCV;
+        
+        /** \brief fluent setter for asyncCV */
+        SGDParams& setAsyncCV(bool v=true){
+            asyncCV = v;
+            return *this;
+        }
+        
+        /**
+         * \brief number of checks without improvement after which training stops
+         * early, or 0 (the default) to never stop for that reason. A check is made
+         * at each cross-validation event on the cross-validation error, or without
+         * cross-validation at the end of each epoch on the mean training error
+         * over that epoch. The best network is chosen as usual from the iterations
+         * actually run, and the number run is put in stoppedAt.
+         */
+        int stopPatience;
+        
+        /**
+         * \brief the amount by which the error must fall below the lowest so far
+         * to count as an improvement (see stopPatience), so that training on a
+         * plateau stops; the default is 0.
+         */
+        double stopDelta;
+        
+        /**
+         * \brief if not negative, training stops early when a check (see
+         * stopPatience) finds the error at or below this; the default is -1.
+         */
+        double stopError;
+        
+        /**
+         * \brief fluent setter for stopPatience and stopDelta
+         * \param patience number of checks without improvement before stopping
+         * \param delta fall in error needed to count as an improvement
+         */
+        SGDParams& setEarlyStopping(int patience,double delta=0){
+            if(patience<0 || delta<0)
+                throw std::out_of_range("early stopping parameters must not be negative");
+            stopPatience = patience;
+            stopDelta = delta;
+            return *this;
+        }
+        
+        /** \brief fluent setter for stopError */
+        SGDParams& setStopError(double e){
+            stopError = e;
+            return *this;
+        }
+        
+        /**
+         * \brief set by trainSGD() to the number of iterations actually run,
+         * which is less than iterations if training stopped early.
+         */
+        int stoppedAt;
+        
+        /**
+         * \brief where to send a MetricsRecord at each cross-validation event, or
+         * NULL (the default) to record nothing. The sink is not owned by the
+         * parameters.
+         */
+        MetricsSink *metrics;
+        
+        /** \brief fluent setter for metrics */
+        SGDParams& setMetrics(MetricsSink *m){
+            metrics = m;
+            return *this;
+        }
+        
         /**
          * \brief a buffer of at least getDataSize() bytes for the best network. If NULL,
-         * the best network is not saved.
+         * the best network is not saved. During training this holds a snapshot()
+         * of the network, and afterwards the network's data as written by save().
+         */
+        T *bestNetBuffer;
+        
+        /**
+         * \brief when keeping the best network by training error, the least number
+         * of iterations between snapshots of it. An improvement within this many
+         * iterations of the last snapshot is noted, and the network is
+         * snapshotted at the end of the interval, so the network kept may be up
+         * to this many iterations after the best. The default, 1, snapshots
+         * every improvement.
          */
-        double *bestNetBuffer;
+        int bestInterval;
+        
+        /** \brief fluent setter for bestInterval */
+        SGDParams& setBestInterval(int n){
+            if(n<1)
+                throw std::out_of_range("best network interval must be at least 1");
+            bestInterval = n;
+            return *this;
+        }
         
         /**
          * \brief true if we should store the best net data
@@ -297,16 +719,39 @@ public:
         
         void init(double _eta,int _iters){
             seed = 0L;
+            seedCount = 1;
+            metrics = NULL;
+            threads = 1;
+            batchThreads = 1;
+            asyncCV = false;
+            stopPatience = 0;
+            stopDelta = 0;
+            stopError = -1;
+            stoppedAt = 0;
             eta = _eta;
             iterations = _iters;
+            batchSize = 1;
+            optimizer = Optimizer::SGD;
+            beta1 = 0.9;
+            beta2 = 0.999;
+            epsilon = 1e-8;
+            schedule = EtaSchedule::CONSTANT;
+            scheduleInterval = 0;
+            scheduleFactor = 1;
+            restartMult = 1;
+            timeLimit = 0;
+            timeLimitCPU = false;
+            checkpointInterval = 0;
+            resume = true;
             initrange = -1;
             bestNetBuffer = NULL;
+            bestInterval = 1;
             ownsBestNetBuffer = false;
             storeBestNet = false;
             nSlices=0;
             nPerSlice=0;
             cvInterval=1;
-            shuffleMode = ExampleSet::STRIDE;
+            shuffleMode = ExampleSetBase::STRIDE;
             selectBestWithCV=false; // there might not be CV!
             cvShuffle = true; // do shuffle CV at the end of an epoch
         }
@@ -329,7 +774,7 @@ public:
          * the number of iterations from an epoch count
          */
         
-        SGDParams(double _eta,const ExampleSet& examples,int _iters){
+        SGDParams(double _eta,const ExampleSetT<T>& examples,int _iters){
             init(_eta,examples.getCount()*_iters);
         }
         
@@ -353,7 +798,7 @@ public:
          * @return a reference to this, so we can do fluent chains.
          */
         
-        SGDParams &crossValidation(const ExampleSet& examples,
+        SGDParams &crossValidation(const ExampleSetT<T>& examples,
                                    double propCV,
                                    int cvCount,
                                    int cvSlices,
@@ -412,20 +857,29 @@ public:
      * given in the thesis. Here we give the number of slices and number of examples
      * per slice; in the thesis we give the total number of examples to be held out
      * and the number of slices.
+     * 
+     * The examples themselves are not changed: training shuffles a view of its
+     * own, so several networks can be trained on the same example set at once
+     * (see EnsembleTrainer), unless it is a STREAMED set, whose views all share
+     * the one window of examples in memory.
      * \pre Network has weights initialised to random values
      * \post The network will be set to the best network found if bestNetBuffer is set,
      * otherwise the final network will be used.
      * \throws std::out_of_range Too many CV examples
      * \throws std::logic_error Trying to select best by CV when there's no CV done
+     * \throws std::logic_error Training a STREAMED set in several threads or
+     * cross-validating it in the background
      * 
-     * @param examples training set (including cross-validation data)
+     * @param data training set (including cross-validation data)
      * @param params a filled-in SGDParams structure giving the parameters for the training.
      * @return If storeBestNet is null, the MSE of the final network; otherwise the MSE
      * of the best network found. This is done across the entire
      * validation set if provided, or the entire training set if not.
      */
     
-    double trainSGD(ExampleSet &examples,SGDParams& params){
+    double trainSGD(const ExampleSetT<T> &data,SGDParams& params){
+        // the examples we shuffle, which share the data
+        ExampleSetT<T> examples(data,0,data.getCount());
         
         // set seed for PRNG
         setSeed(params.seed);
@@ -439,6 +893,11 @@ public:
         if(!nCV && params.selectBestWithCV)
             throw std::logic_error("cannot use CV to select best when no CV is done");
         
+        // a STREAMED set has only one window of examples in memory to work on
+        if(data.getStorage()==ExampleSetBase::STREAMED &&
+           (params.threads>1 || params.batchThreads>1 || (nCV && params.asyncCV)))
+            throw std::logic_error("cannot train on a streamed set in several threads or cross-validate it in the background");
+        
         // get the number of actual training examples
         int nExamples = examples.getCount() - nCV;
         
@@ -458,7 +917,7 @@ public:
         // even if we're not using CV, so in that case we'll just
         // use a dummy of one example.
         
-        ExampleSet cvExamples(examples,nCV?examples.getCount()-nCV:0,nCV?nCV:1);
+        ExampleSetT<T> cvExamples(examples,nCV?examples.getCount()-nCV:0,nCV?nCV:1);
         
         
         // setup a countdown for when we cross-validate
@@ -466,73 +925,298 @@ public:
         // and which slice we are doing
         int cvSlice = 0;
         
+        // index of the next example to train with, and how many we train
+        // on in each iteration of the loop below
+        int exampleIndex = 0;
+        int num;
+        
+        // whether we have a snapshot of the best network, and if we need to
+        // take one, and when we last did
+        bool haveBest = false;
+        bool bestPending = false;
+        int lastBest = 0;
+        
+        // early stopping checks, and the training error so far this epoch
+        StopCheck stopCheck(params);
+        double epochError = 0;
+        int epochCount = 0;
+        params.stoppedAt = params.iterations;
+        
+        // when we started, and how long we've been going, for the time limit
+        double startTime = params.timeLimit>0 ? getTime(params.timeLimitCPU) : 0;
+        double elapsed = 0;
+        int batches = 0;
+        
+        // set up the optimizer, starting from nothing
+        if(!startOptimizer(params))
+            throw std::logic_error("this network type cannot use that optimizer");
+        
+        // Everything above which changes during training, and the network, can
+        // be saved in a checkpoint (see SGDParams::checkpointFile). This saves
+        // or loads it all, the same code doing both so the order is the same.
+        std::vector<int32_t> order(examples.getCount());
+        std::vector<int32_t> cvOrder(cvExamples.getCount());
+        std::vector<T> netData(getDataSize());
+        auto checkpointState = [&](Checkpoint& cp,bool saving,int& iteration){
+            // a header, to check we are resuming the same run
+            long header[] = {CHECKPOINT_MAGIC,CHECKPOINT_VERSION,(long)sizeof(T),
+                params.seed,data.getCount(),nCV,getInputCount(),getOutputCount(),
+                getDataSize(),params.batchSize,(long)params.optimizer};
+            for(long h : header){
+                long v = h;
+                transfer(cp,saving,v);
+                if(v!=h)
+                    throw std::runtime_error("checkpoint is not of this training run");
+            }
+            if(saving){
+                examples.getOrder(order.data());
+                cvExamples.getOrder(cvOrder.data());
+                snapshot(netData.data());
+                if(params.timeLimit>0)
+                    elapsed = getTime(params.timeLimitCPU)-startTime;
+            }
+            transfer(cp,saving,iteration);
+            transfer(cp,saving,exampleIndex);
+            transfer(cp,saving,cvCountdown);
+            transfer(cp,saving,cvSlice);
+            transfer(cp,saving,minError);
+            transfer(cp,saving,haveBest);
+            transfer(cp,saving,bestPending);
+            transfer(cp,saving,lastBest);
+            transfer(cp,saving,stopCheck);
+            transfer(cp,saving,epochError);
+            transfer(cp,saving,epochCount);
+            transfer(cp,saving,elapsed);
+            transfer(cp,saving,rd);
+            transfer(cp,saving,order.data(),order.size()*sizeof(int32_t));
+            transfer(cp,saving,cvOrder.data(),cvOrder.size()*sizeof(int32_t));
+            transfer(cp,saving,netData.data(),netData.size()*sizeof(T));
+            bool haveBuffer = params.bestNetBuffer!=NULL;
+            transfer(cp,saving,haveBuffer);
+            if(haveBuffer){
+                if(!params.bestNetBuffer)
+                    params.bestNetBuffer = new T[getDataSize()];
+                transfer(cp,saving,params.bestNetBuffer,getDataSize()*sizeof(T));
+            }
+            if(OptimizerStateT<T> *opt = getOptimizerState()){
+                if(saving)
+                    opt->save(cp);
+                else
+                    opt->load(cp);
+            }
+            if(!saving){
+                // the indices in the orders are into the data's block
+                std::vector<int32_t> dataOrder(data.getCount());
+                data.getOrder(dataOrder.data());
+                int limit = 1+*std::max_element(dataOrder.begin(),dataOrder.end());
+                examples.setOrder(order.data(),limit);
+                cvExamples.setOrder(cvOrder.data(),limit);
+                restore(netData.data());
+                startTime -= elapsed;
+            }
+        };
+        
+        // resume from a checkpoint if there is one, and get ready to write them
+        int firstIteration = 0;
+        CheckpointWriter *checkpointer = NULL;
+        if(!params.checkpointFile.empty()){
+            if(params.threads>1 || (nCV && params.asyncCV))
+                throw std::logic_error("cannot checkpoint when training in several threads or cross-validating in the background");
+            Checkpoint cp;
+            if(params.resume && cp.read(params.checkpointFile))
+                checkpointState(cp,false,firstIteration);
+            checkpointer = new CheckpointWriter(params.checkpointFile);
+        }
+        
+        // if we are training in several threads, set up the workers
+        Workers *workers = NULL;
+        if(params.threads>1){
+            if(params.batchThreads>1)
+                throw std::logic_error("cannot split batches across threads when training in several threads");
+            if(params.optimizer!=Optimizer::SGD)
+                throw std::logic_error("cannot use an optimizer when training in several threads");
+            workers = new Workers(this,examples,nExamples,params.threads);
+        }
+        // and if cross-validating in the background, start that
+        CVRunner *cvRunner = NULL;
+        if(nCV && params.asyncCV){
+            NetT *eval = makeSimilar();
+            if(!eval)
+                throw std::logic_error("this network type cannot cross-validate in the background");
+            cvRunner = new CVRunner(this,eval,cvExamples,params);
+        }
+        // or set up the threads for splitting batches
+        if(params.batchThreads>1 && !startBatchThreads(params.batchThreads))
+            throw std::logic_error("this network type cannot split batches across threads");
+        
         // now actually do the training
         
-        FILE *log = fopen("foo","w");
-        fprintf(log,"x,slice,y\n");
-        for(int i=0;i<params.iterations;i++){
-            // find the example number
-            int exampleIndex = i % nExamples;
-            
-            // at the start of each epoch, reshuffle. This will effectively do an extra shuffle
-            // as we've already done it once at the start, before splitting out the CV examples.
-            
-            if(exampleIndex == 0)
-                examples.shuffle(&rd,params.shuffleMode,nExamples);
+        for(int i=firstIteration;i<params.iterations;i+=num){
+            double trainingError;
+            if(workers){
+                // train in all the threads until the next cross-validation
+                // (or for an epoch)
+                num = nCV ? params.cvInterval : nExamples;
+                if(num > params.iterations-i)
+                    num = params.iterations-i;
+                trainingError = workers->train(num,etaAt(params,i,elapsed),params);
+            } else {
+                // at the start of each epoch, reshuffle. This will effectively do an extra shuffle
+                // as we've already done it once at the start, before splitting out the CV examples.
+                
+                if(exampleIndex == 0)
+                    examples.shuffle(&rd,params.shuffleMode,nExamples);
                 
-            // train here, just one example, no batching.
-            double trainingError = trainBatch(examples,exampleIndex,1,params.eta);
+                // work out how many examples to train on; a batch doesn't run
+                // past the end of the epoch (or the end of training)
+                num = params.batchSize;
+                if(num > nExamples-exampleIndex)
+                    num = nExamples-exampleIndex;
+                if(num > params.iterations-i)
+                    num = params.iterations-i;
+                
+                // train here, either one example or a batch
+                trainingError = trainBatch(examples,exampleIndex,num,
+                                           etaAt(params,i,elapsed));
+                exampleIndex = (exampleIndex+num) % nExamples;
+            }
+            
+            // are we stopping early? Without cross-validation, check the mean
+            // training error at the end of each epoch (the workers train an
+            // epoch at a time).
+            bool stopping = false;
+            if(!nCV && stopCheck.enabled()){
+                epochError += trainingError*num;
+                epochCount += num;
+                if(workers || exampleIndex==0){
+                    stopping = stopCheck.check(epochError/epochCount);
+                    epochError = 0;
+                    epochCount = 0;
+                }
+            }
             
             if(!params.selectBestWithCV){
                 // now test the error and keep the best net. This works differently
                 // if we're doing this by cross-validation or training error. Here
-                // we're using the training error.
+                // we're using the training error, and we may put off taking the
+                // snapshot (see SGDParams::bestInterval).
                 if(minError < 0 || trainingError < minError){
-                    if(params.storeBestNet){
-                        if(!params.bestNetBuffer)
-                            params.bestNetBuffer = new double[getDataSize()];
-                        save(params.bestNetBuffer);
-                    }
+                    bestPending = params.storeBestNet;
                     minError = trainingError;
                 }
+                if(bestPending && i+num-lastBest >= params.bestInterval){
+                    if(!params.bestNetBuffer)
+                        params.bestNetBuffer = new T[getDataSize()];
+                    snapshot(params.bestNetBuffer);
+                    haveBest = true;
+                    bestPending = false;
+                    lastBest = i+num;
+                }
             }
             
             // is there cross-validation? If so, do it.
             
-            if(nCV && !--cvCountdown){
-                cvCountdown = params.cvInterval; // reset
-                
-                // test the appropriate slice, from example cvSlice*nPerSlice, length nPerSlice,
-                // and get the MSE
-                double error = test(cvExamples,cvSlice*params.nPerSlice,
-                                    params.nPerSlice);
-                fprintf(log,"%d,%d,%f\n",i,cvSlice,error);
+            if(nCV && (cvCountdown-=num)<=0){
+                cvCountdown += params.cvInterval; // reset
                 
-                // test this against the min error as was done above
-                if(params.selectBestWithCV){
-                    if(minError < 0 || trainingError < minError){
-                        if(params.storeBestNet){
-                        if(!params.bestNetBuffer)
-                            params.bestNetBuffer = new double[getDataSize()];
-                            save(params.bestNetBuffer);
+                if(cvRunner){
+                    // queue a snapshot to be tested on this slice
+                    cvRunner->submit(i,cvSlice);
+                    cvSlice = (cvSlice+1)%params.nSlices;
+                } else {
+                    // test the appropriate slice, from example cvSlice*nPerSlice, length nPerSlice,
+                    // and get the MSE
+                    double error = test(cvExamples,cvSlice*params.nPerSlice,
+                                        params.nPerSlice);
+                    if(params.metrics)
+                        params.metrics->record(MetricsRecord(i,cvSlice,error));
+                    
+                    // test this against the min error as was done above
+                    if(params.selectBestWithCV){
+                        if(minError < 0 || trainingError < minError){
+                            if(params.storeBestNet){
+                                if(!params.bestNetBuffer)
+                                    params.bestNetBuffer = new T[getDataSize()];
+                                snapshot(params.bestNetBuffer);
+                                haveBest = true;
+                            }
+                            minError = trainingError;
                         }
-                        minError = trainingError;
                     }
+                    stopping = stopCheck.check(error);
+                    
+                    // increment the slice index
+                    cvSlice = (cvSlice+1)%params.nSlices;
+                    // if we are now on the first slice, shuffle the entire CV set
+                    if(!cvSlice && params.cvShuffle)
+                        cvExamples.shuffle(&rd,params.shuffleMode);
                 }
-                
-                // increment the slice index
-                cvSlice = (cvSlice+1)%params.nSlices;
-                // if we are now on the first slice, shuffle the entire CV set
-                if(!cvSlice && params.cvShuffle)
-                    cvExamples.shuffle(&rd,params.shuffleMode);
             }
+            
+            // background cross-validation says when to stop when it gets there
+            if(cvRunner && cvRunner->isStopping())
+                stopping = true;
+            // and we stop if time's up, reading the clock only every so often
+            if(params.timeLimit>0 && (workers || ++batches%64==0)){
+                elapsed = getTime(params.timeLimitCPU)-startTime;
+                if(elapsed>=params.timeLimit)
+                    stopping = true;
+            }
+            if(stopping){
+                params.stoppedAt = i+num;
+                break;
+            }
+            
+            // save a checkpoint if we have passed a multiple of the interval; it
+            // is written in the background, while we carry on
+            if(checkpointer &&
+               (i+num)/params.checkpointInterval > i/params.checkpointInterval){
+                int done = i+num;
+                checkpointState(checkpointer->next(),true,done);
+                checkpointer->write();
+            }
+        }
+        
+        // wait for the last checkpoint to be written
+        if(checkpointer){
+            try {
+                checkpointer->finish();
+            } catch(...){
+                delete checkpointer;
+                throw;
+            }
+            delete checkpointer;
+        }
+        
+        delete workers;
+        // wait for any background cross-validation to catch up
+        if(cvRunner){
+            cvRunner->finish();
+            if(cvRunner->hasBest())
+                haveBest = true;
+            delete cvRunner;
+        }
+        
+        // take any snapshot put off until the end
+        if(bestPending){
+            if(!params.bestNetBuffer)
+                params.bestNetBuffer = new T[getDataSize()];
+            snapshot(params.bestNetBuffer);
+            haveBest = true;
         }
         
-        fclose(log);
+        if(params.batchThreads>1)
+            stopBatchThreads();
+        
+        if(params.metrics)
+            params.metrics->flush();
         
-        // at the end, finalise the network to the best found if we can
-        if(params.bestNetBuffer)
-            load(params.bestNetBuffer);
+        // at the end, finalise the network to the best found if we can, and
+        // leave its data in the buffer
+        if(haveBest){
+            restore(params.bestNetBuffer);
+            save(params.bestNetBuffer);
+        }
         
         // test on either the entire CV set or the training set and return result
         return test(nCV?cvExamples:examples);
@@ -541,28 +1225,491 @@ public:
     /**
      * \brief Get the length of the serialised data block
      * for this network.
-     * \return the size in doubles
+     * \return the size in values of the scalar type
      */
     virtual int getDataSize() const = 0;
     
     /**
      * \brief Serialize the data (not including any network type magic number or
      * layer/node counts) to the given memory (which must be of sufficient size).
-     * \param buf the buffer to save the data, must be at least getDataSize() doubles
+     * \param buf the buffer to save the data, must be at least getDataSize() values
      */
-    virtual void save(double *buf) const = 0;
+    virtual void save(T *buf) const = 0;
     
     /**
      * \brief Given that the pointer points to a data block of the correct size
      * for the current network, copy the parameters from that data block into
      * the current network overwriting the current parameters.
-     * \param buf the buffer to load the data from, must be at least getDataSize() doubles
+     * \param buf the buffer to load the data from, must be at least getDataSize() values
+     */
+    virtual void load(T *buf) = 0;
+    
+    /**
+     * \brief Copy the parameters into a buffer, to be copied back with
+     * restore(). This is the same as save() but much quicker for networks
+     * which keep their parameters in a single block (see getParamBlock()),
+     * although the data may be laid out differently.
+     * \param buf the buffer, which must be at least getDataSize() values
      */
-    virtual void load(double *buf) = 0;
+    void snapshot(T *buf) const {
+        int n;
+        const T *block = getParamBlock(n);
+        if(block)
+            memcpy(buf,block,n*sizeof(T));
+        else
+            save(buf);
+    }
+    
+    /**
+     * \brief Copy the parameters back from a buffer written by snapshot() on
+     * this network (or one of the same type and shape).
+     * \param buf the buffer
+     */
+    void restore(T *buf){
+        int n;
+        T *block = getParamBlock(n);
+        if(block)
+            memcpy(block,buf,n*sizeof(T));
+        else
+            load(buf);
+    }
     
 protected:
+    /**
+     * \brief Get the block holding all the network's parameters, if it keeps
+     * them in one, which must be no more than getDataSize() values.
+     * \param n set to the number of values in the block
+     * \return the block, or NULL if the network doesn't keep one
+     */
+    virtual T *getParamBlock(int& n) const {
+        return NULL;
+    }
+    
+    
+    /**
+     * \brief Make a network which shares this network's weights and biases
+     * but has its own working storage, for training in several threads (see
+     * SGDParams::threads). The caller deletes it, before this network.
+     * \return the new network, or NULL if this type of network can't do this
+     */
+    virtual NetT *makeWorker(){
+        return NULL;
+    }
+    
+    /**
+     * \brief Decides when to stop training early, from a series of errors
+     * (see SGDParams::stopPatience).
+     */
+    class StopCheck {
+    public:
+        /**
+         * \brief Constructor
+         * \param params the training parameters
+         */
+        StopCheck(const SGDParams& params){
+            patience = params.stopPatience;
+            delta = params.stopDelta;
+            target = params.stopError;
+            best = -1;
+            waited = 0;
+        }
+        
+        /**
+         * \brief true if training may stop early
+         */
+        bool enabled() const {
+            return patience>0 || target>=0;
+        }
+        
+        /**
+         * \brief check the latest error
+         * \return true if training should stop
+         */
+        bool check(double error){
+            if(target>=0 && error<=target)
+                return true;
+            if(best<0 || error<best-delta){
+                best = error;
+                waited = 0;
+            } else if(patience>0 && ++waited>=patience)
+                return true;
+            return false;
+        }
+        
+    private:
+        int patience; //!< checks without improvement before stopping, or 0
+        double delta; //!< fall in error counted as an improvement
+        double target; //!< error at which to stop, or -1
+        double best; //!< lowest error so far, or -1
+        int waited; //!< checks since the last improvement
+    };
+    
+    /**
+     * \brief Make a new network of the same type, shape and sigmoid mode as
+     * this one, for cross-validation in the background (see SGDParams::asyncCV).
+     * Its parameters are not set.
+     * \return the new network, or NULL if this type of network can't do this
+     */
+    virtual NetT *makeSimilar() const {
+        return NULL;
+    }
+    
+    /**
+     * \brief Cross-validation in a background thread, used by trainSGD()
+     * (see SGDParams::asyncCV). Snapshots of the network are queued by the
+     * training thread and tested in order on a separate network.
+     */
+    class CVRunner {
+    public:
+        /**
+         * \brief Constructor, which starts the thread
+         * \param master the network being trained
+         * \param eval the network snapshots are tested on, now owned by the runner
+         * \param cvExamples the cross-validation examples, used only by the runner
+         * until it is deleted
+         * \param params the training parameters
+         */
+        CVRunner(NetT *master,NetT *eval,ExampleSetT<T>& cvExamples,SGDParams& params) :
+              cvExamples(cvExamples), params(params), stopCheck(params) {
+            this->master = master;
+            this->eval = eval;
+            eval->setSigmoidMode(master->sigmoidMode);
+            // shuffle with a generator of our own, so the training thread's
+            // generator (and therefore the training) is unchanged
+            eval->setSeed(~params.seed);
+            minError = -1;
+            stopping = false;
+            stopRequested = false;
+            gotBest = false;
+            thread = std::thread(&CVRunner::run,this);
+        }
+        
+        /**
+         * \brief Destructor, which waits for all the queued snapshots to be
+         * tested and stops the thread
+         */
+        ~CVRunner(){
+            finish();
+            for(size_t i=0;i<freeBufs.size();i++)
+                delete [] freeBufs[i];
+            delete eval;
+        }
+        
+        /**
+         * \brief true if a snapshot tested so far says training should stop
+         * early (see SGDParams::stopPatience). Snapshots queued after that one
+         * are ignored.
+         */
+        bool isStopping() const {
+            return stopRequested;
+        }
+        
+        /**
+         * \brief true if we have put a snapshot in the best network buffer
+         * \pre finish() has been called
+         */
+        bool hasBest() const {
+            return gotBest;
+        }
+        
+        /**
+         * \brief wait for all the queued snapshots to be tested and stop the
+         * thread
+         */
+        void finish(){
+            {
+                std::unique_lock<std::mutex> lk(lock);
+                stopping = true;
+            }
+            cond.notify_one();
+            if(thread.joinable())
+                thread.join();
+        }
+        
+        /**
+         * \brief take a snapshot of the network and queue it for testing
+         * \param iteration the current iteration
+         * \param slice the slice to test it on
+         */
+        void submit(int iteration,int slice){
+            Job j;
+            j.iteration = iteration;
+            j.slice = slice;
+            {
+                std::unique_lock<std::mutex> lk(lock);
+                if(freeBufs.empty())
+                    j.buf = NULL;
+                else {
+                    j.buf = freeBufs.back();
+                    freeBufs.pop_back();
+                }
+            }
+            if(!j.buf)
+                j.buf = new T[master->getDataSize()];
+            master->snapshot(j.buf);
+            {
+                std::unique_lock<std::mutex> lk(lock);
+                jobs.push_back(j);
+            }
+            cond.notify_one();
+        }
+        
+    private:
+        /**
+         * \brief a snapshot waiting to be tested
+         */
+        struct Job {
+            int iteration; //!< iteration at which it was taken
+            int slice; //!< slice to test it on
+            T *buf; //!< the network's data, see snapshot()
+        };
+        
+        NetT *master; //!< the network being trained
+        NetT *eval; //!< the network the snapshots are loaded into and tested
+        ExampleSetT<T>& cvExamples; //!< the cross-validation examples
+        SGDParams& params; //!< the training parameters
+        double minError; //!< lowest error so far, or -1
+        StopCheck stopCheck; //!< decides when to stop early
+        std::atomic<bool> stopRequested; //!< set when stopCheck says stop
+        bool gotBest; //!< true if we have written to the best network buffer
+        std::thread thread; //!< the thread
+        std::mutex lock; //!< protects everything below
+        std::condition_variable cond; //!< signalled when there is a job or we are stopping
+        std::deque<Job> jobs; //!< snapshots waiting to be tested, oldest first
+        std::vector<T *> freeBufs; //!< snapshot buffers for reuse
+        bool stopping; //!< set to make the thread exit when the jobs are done
+        
+        /**
+         * \brief the body of the thread
+         */
+        void run(){
+            for(;;){
+                Job j;
+                {
+                    std::unique_lock<std::mutex> lk(lock);
+                    cond.wait(lk,[this]{return stopping || !jobs.empty();});
+                    if(jobs.empty())
+                        return; // stopping, and nothing left to test
+                    j = jobs.front();
+                    jobs.pop_front();
+                }
+                if(stopRequested){
+                    // taken after training should have stopped, so ignore it
+                    std::unique_lock<std::mutex> lk(lock);
+                    freeBufs.push_back(j.buf);
+                    continue;
+                }
+                eval->restore(j.buf);
+                double error = eval->test(cvExamples,j.slice*params.nPerSlice,
+                                          params.nPerSlice);
+                if(params.metrics)
+                    params.metrics->record(MetricsRecord(j.iteration,j.slice,error));
+                if(params.selectBestWithCV && (minError < 0 || error < minError)){
+                    if(params.storeBestNet){
+                        int n = master->getDataSize();
+                        // only we use the buffer until training finishes
+                        if(!params.bestNetBuffer)
+                            params.bestNetBuffer = new T[n];
+                        memcpy(params.bestNetBuffer,j.buf,n*sizeof(T));
+                        gotBest = true;
+                    }
+                    minError = error;
+                }
+                if(stopCheck.check(error))
+                    stopRequested = true;
+                // having done the last slice, shuffle the entire CV set
+                if(j.slice==params.nSlices-1 && params.cvShuffle)
+                    cvExamples.shuffle(&eval->rd,params.shuffleMode);
+                std::unique_lock<std::mutex> lk(lock);
+                freeBufs.push_back(j.buf);
+            }
+        }
+    };
+    
+    /**
+     * \brief Start the threads used to split mini-batches across several threads
+     * during training (see SGDParams::batchThreads).
+     * \param n number of threads
+     * \return false if this type of network can't do this
+     */
+    virtual bool startBatchThreads(int n){
+        return false;
+    }
+    
+    /**
+     * \brief Stop the threads started by startBatchThreads()
+     */
+    virtual void stopBatchThreads(){
+    }
+    
+    /**
+     * \brief get the time in seconds since some arbitrary point, for
+     * SGDParams::timeLimit
+     * \param cpu true for the CPU time used by this thread, false for
+     * wall-clock time
+     */
+    static double getTime(bool cpu){
+        if(cpu){
+            timespec ts;
+            clock_gettime(CLOCK_THREAD_CPUTIME_ID,&ts);
+            return ts.tv_sec+ts.tv_nsec*1e-9;
+        }
+        return std::chrono::duration<double>(
+            std::chrono::steady_clock::now().time_since_epoch()).count();
+    }
+    
+    /**
+     * \brief save a value to a checkpoint, or load it from one
+     * \param cp the checkpoint
+     * \param saving true to save, false to load
+     * \param v the value, which must be of a plain (trivially copyable) type
+     */
+    template <class V> static void transfer(Checkpoint& cp,bool saving,V& v){
+        if(saving)
+            cp.put(v);
+        else
+            cp.get(&v,sizeof(V));
+    }
+    
+    /**
+     * \brief save an array to a checkpoint, or load it from one
+     * \param cp the checkpoint
+     * \param saving true to save, false to load
+     * \param p the array
+     * \param n its size in bytes
+     */
+    static void transfer(Checkpoint& cp,bool saving,void *p,size_t n){
+        if(saving)
+            cp.put(p,n);
+        else
+            cp.get(p,n);
+    }
     
+    /**
+     * \brief Get the state of the optimizer set up by startOptimizer(), to save
+     * in a checkpoint
+     * \return the state, or NULL if there is none
+     */
+    virtual OptimizerStateT<T> *getOptimizerState(){
+        return NULL;
+    }
     
+    /**
+     * \brief get the learning rate for the next batch in trainSGD()
+     * \param params the training parameters
+     * \param i number of iterations done
+     * \param elapsed time taken so far, if there is a time limit
+     */
+    static double etaAt(const SGDParams& params,int i,double elapsed){
+        // how far through training we are, by iterations or time
+        double progress = (double)i/params.iterations;
+        if(params.timeLimit>0 && elapsed/params.timeLimit>progress)
+            progress = elapsed/params.timeLimit;
+        return params.getEta(i,progress);
+    }
+    
+    /**
+     * \brief Set up the optimizer given in the parameters with all its state
+     * zeroed, at the start of trainSGD() (see SGDParams::optimizer).
+     * \return false if this type of network can't use the optimizer
+     */
+    virtual bool startOptimizer(const SGDParams& params){
+        return params.optimizer==Optimizer::SGD;
+    }
+    
+    /**
+     * \brief The worker networks and threads used by trainSGD() to train
+     * in several threads at once.
+     */
+    class Workers {
+    public:
+        /**
+         * \brief Constructor
+         * \param master the network being trained
+         * \param examples the examples, the first nExamples of which are for training
+         * \param nExamples number of training examples
+         * \param n number of threads
+         * \throws std::logic_error if the network can't be trained in threads
+         */
+        Workers(NetT *master,ExampleSetT<T>& examples,int nExamples,int n) : pool(n) {
+            this->nExamples = nExamples;
+            for(int k=0;k<n;k++){
+                NetT *w = master->makeWorker();
+                if(!w){
+                    deleteWorkers();
+                    throw std::logic_error("this network type cannot be trained in several threads");
+                }
+                // each worker gets a PRNG seeded from the master's, for shuffling
+                long seed;
+                lrand48_r(&master->rd,&seed);
+                w->setSeed(seed);
+                nets.push_back(w);
+                views.push_back(new ExampleSetT<T>(examples,0,nExamples));
+                indices.push_back(0);
+                errors.push_back(0);
+            }
+        }
+        
+        ~Workers(){
+            deleteWorkers();
+        }
+        
+        /**
+         * \brief train the workers in parallel on a total number of examples,
+         * shared between them, at a given learning rate
+         * \return the mean error for each example
+         */
+        double train(int num,double eta,const SGDParams& params){
+            int n = nets.size();
+            for(int k=0;k<n;k++){
+                int count = num/n + (k<num%n ? 1 : 0);
+                pool.submit([this,k,count,eta,&params]{
+                    NetT *net = nets[k];
+                    int& idx = indices[k];
+                    double err=0;
+                    for(int done=0;done<count;){
+                        if(idx==0)
+                            views[k]->shuffle(&net->rd,params.shuffleMode,nExamples);
+                        int b = params.batchSize;
+                        if(b > nExamples-idx)
+                            b = nExamples-idx;
+                        if(b > count-done)
+                            b = count-done;
+                        // trainBatch() gives the mean error of a batch
+                        err += net->trainBatch(*views[k],idx,b,eta)*b;
+                        idx = (idx+b)%nExamples;
+                        done += b;
+                    }
+                    errors[k]=err;
+                });
+            }
+            pool.wait();
+            double total=0;
+            for(int k=0;k<n;k++)
+                total += errors[k];
+            return total/num;
+        }
+        
+    private:
+        ThreadPool pool; //!< the threads
+        int nExamples; //!< number of training examples
+        std::vector<NetT *> nets; //!< the worker networks
+        std::vector<ExampleSetT<T> *> views; //!< each worker's view of the examples
+        std::vector<int> indices; //!< the next example for each worker
+        std::vector<double> errors; //!< the total error of each worker's last run
+        
+        /**
+         * \brief delete the worker networks and example views
+         */
+        void deleteWorkers(){
+            for(size_t k=0;k<nets.size();k++){
+                delete nets[k];
+                delete views[k];
+            }
+            nets.clear();
+            views.clear();
+        }
+    };
     
     /**
      * \brief Run a single update of the network
@@ -577,11 +1724,17 @@ protected:
      * directly.
      * \param tp network type enumeration
      */
-    Net(NetType tp){
+    NetT(NetType tp){
         type = tp;
+        sigmoidMode = SigmoidMode::EXACT;
         setSeed(0);
     }
     
+    /**
+     * \brief how the sigmoid is calculated, see setSigmoidMode()
+     */
+    SigmoidMode sigmoidMode;
+    
     /**
      * \brief get a random number using this net's PRNG data
      * \param mn minimum value (inclusive)
@@ -631,9 +1784,13 @@ protected:
      * \param eta     learning rate
      * \return        the sum of mean squared errors in the output layer (see formula in method documentation)
      */
-    virtual double trainBatch(ExampleSet& ex,int start,int num,double eta) = 0;
+    virtual double trainBatch(ExampleSetT<T>& ex,int start,int num,double eta) = 0;
     
 };    
 
+/**
+ * \brief the double-precision network, the type used by default throughout
+ */
+typedef NetT<double> Net;
 
 #endif /* __NET_HPP */
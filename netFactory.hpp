@@ -23,42 +23,55 @@
 
 class NetFactory { // not a namespace because Doxygen gets confused.
 public:
+    /**
+     * \brief Flag set in the magic number of a saved network if the
+     * parameters are floats rather than doubles. Files saved before
+     * there were float networks don't have it, and are all doubles.
+     */
+    static const uint32_t MAGIC_FLOAT = 0x10000;
+    
     /**
      * \brief
      * Construct a single hidden layer network of a given type
-     * which conforms to the example set.
+     * which conforms to the example set. The network has the same
+     * scalar type as the examples.
      */
     
-    static Net *makeNet(NetType t,ExampleSet &e,int hnodes){
-        Net *net;
+    template <class T> static NetT<T> *makeNet(NetType t,ExampleSetT<T> &e,int hnodes){
         
         int layers[3];
         layers[0] = e.getInputCount();
         layers[1] = hnodes;
         layers[2] = e.getOutputCount();
         
-        return makeNet(t,3,layers);
+        return makeNet<T>(t,3,layers);
     }
     
-    static Net *makeNet(NetType t,int layercount, int *layers){
+    /**
+     * \brief Construct a network of a given type and layer structure,
+     * with the given scalar type (double by default).
+     */
+    template <class T=double> static NetT<T> *makeNet(NetType t,int layercount, int *layers){
         switch(t){
         case NetType::PLAIN:
-            return new BPNet(layercount,layers);
+            return new BPNetT<T>(layercount,layers);
         case NetType::OUTPUTBLENDING:
-            return new OutputBlendingNet(layercount,layers);
+            return new OutputBlendingNetT<T>(layercount,layers);
         case NetType::HINPUT:
-            return new HInputNet(layercount,layers);
+            return new HInputNetT<T>(layercount,layers);
         case NetType::UESMANN:
-            return new UESNet(layercount,layers);
+            return new UESNetT<T>(layercount,layers);
         default:break;
         }
     }
     
     /**
      * \brief Load a network of any type from a file - note, endianness not checked!
+     * The network will have the scalar type T (double by default), whichever type
+     * the file was saved with; the parameters are converted if required.
      */
     
-    inline static Net *load(const char *fn){
+    template <class T=double> static NetT<T> *load(const char *fn){
         FILE *a = fopen(fn,"rb");
         if(!a)
             throw new std::runtime_error("cannot open file");
@@ -70,7 +83,8 @@ public:
             throw new std::runtime_error("bad net save file");
         }
             
-        NetType t = static_cast<NetType>(magic);
+        bool isFloat = (magic & MAGIC_FLOAT)!=0;
+        NetType t = static_cast<NetType>(magic & ~MAGIC_FLOAT);
         
         // build layer specification reading the layer count and then
         // the layer sizes
@@ -90,17 +104,18 @@ public:
         }
         
         // build the net
-        Net *n = makeNet(t,layercount,layers);
+        NetT<T> *n = makeNet<T>(t,layercount,layers);
         
         // get the parameter data 
         int size = n->getDataSize();
-        double *buf = new double[size];
-        // and read it
-//        printf("loading %d doubles\n",size);
-        int readData = fread(buf,sizeof(double),size,a);
-        if(readData!=size){
+        T *buf = new T[size];
+        // and read it, in whichever type it was saved
+//        printf("loading %d values\n",size);
+        bool ok = isFloat ? readParams<float>(a,buf,size) : readParams<double>(a,buf,size);
+        if(!ok){
             delete [] buf;
             delete [] layers;
+            delete n;
             fclose(a);
             throw new std::runtime_error("bad net save file");
         }
@@ -114,15 +129,19 @@ public:
     
     /**
      * \brief Save a net of any type to a file - note, endianness not checked!
+     * The parameters are saved in the network's own scalar type, which is
+     * recorded in the magic number.
      */
     
-    inline static void save(const char *fn,Net *n) {
+    template <class T> static void save(const char *fn,NetT<T> *n) {
         FILE *a = fopen(fn,"wb");
         if(!a)
             throw new std::runtime_error("cannot open file");
         
         // get and write the magic number
         uint32_t magic=static_cast<uint32_t>(n->type); // magic number
+        if(sizeof(T)==sizeof(float))
+            magic |= MAGIC_FLOAT;
         fwrite(&magic,sizeof(uint32_t),1,a);
         
         // write the layer count and layer sizes, all as 32-bit.
@@ -135,16 +154,30 @@ public:
         
         // get the parameter data 
         int size = n->getDataSize();
-//        printf("saving %d doubles\n",size);
-        double *buf = new double[size];
+//        printf("saving %d values\n",size);
+        T *buf = new T[size];
         n->save(buf);
         // and write it
-        fwrite(buf,sizeof(double),size,a);
+        fwrite(buf,sizeof(T),size,a);
         delete [] buf;
         
         fclose(a);
     }
     
+private:
+    /**
+     * \brief read parameters saved as type S into a buffer of type T,
+     * converting them.
+     * \return false if there weren't enough
+     */
+    template <class S,class T> static bool readParams(FILE *a,T *buf,int size){
+        S *tmp = new S[size];
+        int readData = fread(tmp,sizeof(S),size,a);
+        for(int i=0;i<readData;i++)
+            buf[i] = (T)tmp[i];
+        delete [] tmp;
+        return readData==size;
+    }
 };
 
 
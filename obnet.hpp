@@ -13,9 +13,10 @@
  * \brief A modulatory network architecture which uses two plain backprop networks,
  * each of which is trained separately. When the network is run, each subnetwork is run
  * and the output generated by interpolating between the subnet outputs.
+ * OutputBlendingNet is the double version.
  */
 
-class OutputBlendingNet : public Net {
+template <class T> class OutputBlendingNetT : public NetT<T> {
 private:
     /**
      * \brief the modulator (or h)
@@ -30,18 +31,18 @@ public:
      * \param nlayers number of layers
      * \param layerCounts array of layer counts
      */
-    OutputBlendingNet(int nlayers,const int *layerCounts) 
-                : Net(NetType::OUTPUTBLENDING) {
+    OutputBlendingNetT(int nlayers,const int *layerCounts) 
+                : NetT<T>(NetType::OUTPUTBLENDING) {
         // we create two networks, one for each modulator level.
-        net0 = new BPNet(nlayers,layerCounts);
-        net1 = new BPNet(nlayers,layerCounts);
-        interpolatedOutputs = new double [net0->getOutputCount()];
+        net0 = new BPNetT<T>(nlayers,layerCounts);
+        net1 = new BPNetT<T>(nlayers,layerCounts);
+        interpolatedOutputs = new T [net0->getOutputCount()];
     }
     
     /**
      * \brief destructor to delete subnets and outputs
      */
-    virtual ~OutputBlendingNet(){
+    virtual ~OutputBlendingNetT(){
         delete net0;
         delete net1;
         delete [] interpolatedOutputs;
@@ -65,14 +66,14 @@ public:
     
     
     
-    virtual void setInputs(double *d) {
+    virtual void setInputs(T *d) {
         // a bit inefficient, since we should only need to do this 
         // for the network currently being trained.
         net0->setInputs(d);
         net1->setInputs(d);
     }
     
-    virtual double *getOutputs() const {
+    virtual T *getOutputs() const {
         // constructed during the update
         return interpolatedOutputs;
     }
@@ -82,30 +83,80 @@ public:
         return net0->getDataSize()*2;
     }
     
-    virtual void save(double *buf) const {
+    virtual void save(T *buf) const {
         // just save the two networks, one after the other
         net0->save(buf);
         buf+=net0->getDataSize();
         net1->save(buf);
     }
     
-    virtual void load(double *buf){
+    virtual void load(T *buf){
         net0->load(buf);
         buf+=net0->getDataSize();
         net1->load(buf);
     }
     
+    virtual void setSigmoidMode(SigmoidMode m){
+        NetT<T>::setSigmoidMode(m);
+        net0->setSigmoidMode(m);
+        net1->setSigmoidMode(m);
+    }
+    
+    virtual void runBatch(const T *in,const double *h,int num,T *out){
+        // run both subnets over the whole batch, then interpolate
+        // each example with its own modulator
+        int nout = this->getOutputCount();
+        T *o1 = new T[num*nout];
+        net0->runBatch(in,NULL,num,out);
+        net1->runBatch(in,NULL,num,o1);
+        for(int e=0;e<num;e++)
+            blend(h?h[e]:modulator,out+e*nout,o1+e*nout);
+        delete [] o1;
+    }
+    
+    virtual void runBatch(ExampleSetT<T>& examples,int start,int num,T *out){
+        int nout = this->getOutputCount();
+        T *o1 = new T[num*nout];
+        net0->runBatch(examples,start,num,out);
+        net1->runBatch(examples,start,num,o1);
+        for(int e=0;e<num;e++)
+            blend(examples.getH(start+e),out+e*nout,o1+e*nout);
+        delete [] o1;
+    }
+    
 protected:
     
-    Net *net0; //!< the network trained by h=0 examples
-    Net *net1; //!< the network trained by h=1 examples
-    double *interpolatedOutputs; //!< the interpolated result after update()
+    NetT<T> *net0; //!< the network trained by h=0 examples
+    NetT<T> *net1; //!< the network trained by h=1 examples
+    T *interpolatedOutputs; //!< the interpolated result after update()
+    
+    virtual NetT<T> *makeSimilar() const {
+        int nl = getLayerCount();
+        int *ll = new int[nl];
+        for(int i=0;i<nl;i++)
+            ll[i] = getLayerSize(i);
+        NetT<T> *n = new OutputBlendingNetT(nl,ll);
+        delete [] ll;
+        return n;
+    }
     
     virtual void initWeights(double initr){
         net0->initWeights(initr);
         net1->initWeights(initr);
     }
     
+    /**
+     * \brief interpolate linearly between two sets of outputs, as done
+     * in update()
+     * \param h modulator
+     * \param o0 outputs of net0, overwritten with the result
+     * \param o1 outputs of net1
+     */
+    void blend(double h,T *o0,const T *o1){
+        for(int i=0;i<this->getOutputCount();i++)
+            o0[i] = h*o1[i] + (1.0-h)*o0[i];
+    }
+    
     /**
      * \brief Update the two networks, and interpolate linearly between the
      * outputs with the modulator.
@@ -115,10 +166,10 @@ protected:
         net1->update();
         
         // interpolate the outputs
-        double *o0 = net0->getOutputs();
-        double *o1 = net1->getOutputs();
+        T *o0 = net0->getOutputs();
+        T *o1 = net1->getOutputs();
         double h = getH();
-        for(int i=0;i<getOutputCount();i++){
+        for(int i=0;i<this->getOutputCount();i++){
             interpolatedOutputs[i] = h*o1[i] + (1.0-h)*o0[i];
         }
     }
@@ -130,16 +181,16 @@ protected:
      * is only suitable for SGD; it can only accept one example.
      */
     
-    virtual double trainBatch(ExampleSet& ex,int start,int num,double eta){
+    virtual double trainBatch(ExampleSetT<T>& ex,int start,int num,double eta){
         /** \bug can only use SGD for now; how this works in batching
            could be tricky. */
         if(num!=1)
-            std::runtime_error("num!=1 (i.e. batch training) not implemented");
+            throw std::runtime_error("num!=1 (i.e. batch training) not implemented");
         
         // what we do here depends on the modulator for the first and only
         // example
         double hzero = (ex.getH(start)<0.5);
-        Net *net = hzero ? net0 : net1;
+        NetT<T> *net = hzero ? net0 : net1;
         
         double e = net->trainBatch(ex,start,1,eta);
         // return avg of 0/1 error rate, so this will change once every two cycles;
@@ -160,7 +211,10 @@ protected:
         return rv;
     }
 };    
-    
 
+/**
+ * \brief the double-precision output blending network
+ */
+typedef OutputBlendingNetT<double> OutputBlendingNet;
 
 #endif /* __OBNET_HPP */
@@ -0,0 +1,205 @@
+/**
+ * @file optimizer.hpp
+ * @brief The ways in which gradients can be applied to the parameters of
+ * a network during training, other than plain gradient descent. These keep
+ * some state for each parameter (a velocity, or running averages of the
+ * gradient and its square). Also the schedules by which the learning
+ * rate can change during training.
+ */
+
+#ifndef __OPTIMIZER_HPP
+#define __OPTIMIZER_HPP
+
+#include <math.h>
+
+#include "checkpoint.hpp"
+
+/**
+ * \brief How the mean gradient of each batch is used to update the
+ * parameters, set with Net::SGDParams::setOptimizer(). In the descriptions,
+ * \f$g\f$ is the gradient, \f$\eta\f$ the learning rate, and \f$\beta_1\f$,
+ * \f$\beta_2\f$ and \f$\epsilon\f$ the other parameters.
+ */
+enum class Optimizer {
+    /// \brief plain gradient descent, \f$w \leftarrow w-\eta g\f$
+    SGD,
+    /// \brief classical momentum, \f$v \leftarrow \beta_1 v+g\f$,
+    /// \f$w \leftarrow w-\eta v\f$
+    MOMENTUM,
+    /// \brief Nesterov momentum, as MOMENTUM but with
+    /// \f$w \leftarrow w-\eta(g+\beta_1 v)\f$, which is the update
+    /// at the point momentum is about to take us to.
+    NESTEROV,
+    /// \brief RMSProp, which divides the gradient by a running average of
+    /// its magnitude: \f$s \leftarrow \beta_2 s+(1-\beta_2)g^2\f$,
+    /// \f$w \leftarrow w-\eta g/(\sqrt{s}+\epsilon)\f$
+    RMSPROP,
+    /// \brief Adam (Kingma and Ba, 2015), which is RMSProp with a
+    /// running average of the gradient (decaying by \f$\beta_1\f$) in
+    /// place of the gradient, both averages corrected for their bias
+    /// towards zero early in training.
+    ADAM
+};
+
+/**
+ * \brief How the learning rate \f$\eta\f$ changes during training, set with
+ * Net::SGDParams::setSchedule(). In the descriptions, \f$\eta_0\f$ is the
+ * rate given in the parameters, \f$i\f$ the number of iterations done,
+ * \f$I\f$ the schedule's interval and \f$f\f$ its factor.
+ */
+enum class EtaSchedule {
+    /// \brief \f$\eta_0\f$ throughout
+    CONSTANT,
+    /// \brief multiplied by \f$f\f$ every \f$I\f$ iterations,
+    /// \f$\eta_0 f^{\lfloor i/I \rfloor}\f$
+    STEP,
+    /// \brief falling smoothly by a factor of \f$f\f$ every \f$I\f$
+    /// iterations, \f$\eta_0 f^{i/I}\f$
+    EXPONENTIAL,
+    /// \brief following half a cosine from \f$\eta_0\f$ down to
+    /// \f$f\eta_0\f$ over the whole of training (which, with a time limit,
+    /// is whichever of the iterations and the time runs out first)
+    COSINE,
+    /// \brief as COSINE, but over \f$I\f$ iterations and then starting
+    /// again at \f$\eta_0\f$ ("warm restarts", Loshchilov and Hutter 2017),
+    /// each period being longer than the last by a whole number factor
+    /// (see Net::SGDParams::restartMult)
+    COSINE_RESTARTS
+};
+
+/**
+ * \brief The state of an Optimizer for each of a block of parameters,
+ * used by BPNet. Each training step calls begin() once and then apply()
+ * over the whole block, perhaps split into ranges in different threads.
+ */
+template <class T> class OptimizerStateT {
+public:
+    /**
+     * \brief Constructor, which starts with all the state zero
+     * \param type the optimizer, which must not be Optimizer::SGD
+     * \param n number of parameters
+     * \param beta1 momentum, or the decay of the mean gradient for Adam
+     * \param beta2 decay of the mean squared gradient for RMSProp and Adam
+     * \param epsilon added to the root mean squared gradient before dividing by it
+     */
+    OptimizerStateT(Optimizer type,int n,double beta1,double beta2,double epsilon){
+        this->type = type;
+        this->n = n;
+        this->beta1 = beta1;
+        this->beta2 = beta2;
+        this->epsilon = epsilon;
+        m = new T[n];
+        v = type==Optimizer::ADAM ? new T[n] : NULL;
+        reset();
+    }
+
+    ~OptimizerStateT(){
+        delete [] m;
+        delete [] v;
+    }
+
+    /**
+     * \brief zero the state, as at the start of training
+     */
+    void reset(){
+        for(int i=0;i<n;i++)
+            m[i]=0;
+        if(v){
+            for(int i=0;i<n;i++)
+                v[i]=0;
+        }
+        steps=0;
+    }
+
+    /**
+     * \brief start a step, working out the bias corrections for Adam
+     */
+    void begin(){
+        steps++;
+        corr1 = 1.0/(1.0-pow(beta1,steps));
+        corr2 = 1.0/(1.0-pow(beta2,steps));
+    }
+
+    /**
+     * \brief update a range of the parameters
+     * \param params the parameters
+     * \param grads their gradients, laid out as params
+     * \param scale factor to multiply the gradients by (e.g. 1/batch size)
+     * \param eta the learning rate
+     * \param from index of the first parameter to update
+     * \param to index after the last parameter to update
+     */
+    void apply(T *params,const T *grads,double scale,double eta,int from,int to){
+        switch(type){
+        case Optimizer::MOMENTUM:
+            for(int i=from;i<to;i++){
+                T g = grads[i]*scale;
+                m[i] = beta1*m[i]+g;
+                params[i] -= eta*m[i];
+            }
+            break;
+        case Optimizer::NESTEROV:
+            for(int i=from;i<to;i++){
+                T g = grads[i]*scale;
+                m[i] = beta1*m[i]+g;
+                params[i] -= eta*(g+beta1*m[i]);
+            }
+            break;
+        case Optimizer::RMSPROP:
+            // m holds the mean squared gradient
+            for(int i=from;i<to;i++){
+                T g = grads[i]*scale;
+                m[i] = beta2*m[i]+(1-beta2)*g*g;
+                params[i] -= eta*g/(sqrt(m[i])+epsilon);
+            }
+            break;
+        case Optimizer::ADAM:
+            for(int i=from;i<to;i++){
+                T g = grads[i]*scale;
+                m[i] = beta1*m[i]+(1-beta1)*g;
+                v[i] = beta2*v[i]+(1-beta2)*g*g;
+                params[i] -= eta*corr1*m[i]/(sqrt(v[i]*corr2)+epsilon);
+            }
+            break;
+        default:
+            for(int i=from;i<to;i++)
+                params[i] -= eta*grads[i]*scale;
+            break;
+        }
+    }
+
+    /**
+     * \brief write the state to a checkpoint
+     */
+    void save(Checkpoint& cp) const {
+        cp.put(steps);
+        cp.put(m,n*sizeof(T));
+        if(v)
+            cp.put(v,n*sizeof(T));
+    }
+
+    /**
+     * \brief read the state from a checkpoint written by save() on a
+     * state with the same optimizer and number of parameters
+     */
+    void load(Checkpoint& cp){
+        steps = cp.get<int>();
+        cp.get(m,n*sizeof(T));
+        if(v)
+            cp.get(v,n*sizeof(T));
+    }
+
+private:
+    Optimizer type; //!< the optimizer
+    int n; //!< number of parameters
+    double beta1; //!< momentum or decay of the mean gradient
+    double beta2; //!< decay of the mean squared gradient
+    double epsilon; //!< avoids division by zero
+    T *m; //!< velocity, or mean (squared for RMSProp) gradient
+    T *v; //!< mean squared gradient for Adam, or NULL
+    int steps; //!< number of steps taken
+    double corr1; //!< Adam's bias correction for m this step
+    double corr2; //!< Adam's bias correction for v this step
+};
+
+#endif /* __OPTIMIZER_HPP */
@@ -0,0 +1,263 @@
+/**
+ * @file stream.hpp
+ * @brief Examples read from files as they are needed, for example sets
+ * too large to hold in memory (see ExampleSetBase::STREAMED).
+ */
+
+#ifndef __STREAM_HPP
+#define __STREAM_HPP
+
+#include <stdint.h>
+#include <string>
+#include <vector>
+#include <memory>
+#include <mutex>
+#include <condition_variable>
+#include <stdexcept>
+#include <algorithm>
+
+#include "idx.hpp"
+#include "threadPool.hpp"
+
+/**
+ * \brief The examples of a STREAMED example set (see ExampleSetBase::Storage),
+ * in IDX files (see IDXFile) of inputs, outputs and optionally modulators,
+ * each with an item per example. The examples are divided into chunks of
+ * consecutive examples, and only a few chunks are converted to the scalar
+ * type and held in memory at once; the rest are read from the files when
+ * they are needed. Example sets using the stream ask for the chunks they
+ * will need next to be read in a background thread.
+ *
+ * Shuffling a STREAMED set shuffles the order of the chunks, and then the
+ * examples within each window of a few chunks, so that training works through
+ * one window at a time (see ExampleSetT::shuffle()). There are enough chunks
+ * in memory for about three windows.
+ */
+template <class T> class ExampleStreamT {
+public:
+    /**
+     * \brief Constructor, which opens the files
+     * \param inputFile IDX file of inputs, an item of any shape for each example
+     * \param outputFile IDX file of outputs, as inputFile
+     * \param hFile IDX file of the modulator of each example, or empty for none
+     * (when the modulators are all zero)
+     * \param chunkSize the number of examples in each chunk
+     * \param windowChunks the number of chunks in each shuffled window
+     * \throws std::runtime_error if the files can't be opened or don't agree
+     * \throws std::out_of_range if the chunk or window size is less than one
+     */
+    ExampleStreamT(const std::string& inputFile,const std::string& outputFile,
+                   const std::string& hFile="",int chunkSize=4096,int windowChunks=16) :
+          inputs(inputFile),outputs(outputFile),pool(1) {
+        if(chunkSize<1 || windowChunks<1)
+            throw std::out_of_range("bad chunk or window size");
+        if(!hFile.empty())
+            hs.reset(new IDXFile(hFile));
+        ct = inputs.getCount();
+        if(outputs.getCount()!=(uint32_t)ct || (hs && hs->getCount()!=(uint32_t)ct))
+            throw std::runtime_error("example counts of files do not agree: "+inputFile);
+        ninputs = inputs.getItemSize();
+        noutputs = outputs.getItemSize();
+        stride = ninputs+noutputs;
+        this->chunkSize = chunkSize;
+        this->windowChunks = windowChunks;
+
+        nChunks = (ct+chunkSize-1)/chunkSize;
+        chunkSlot.assign(nChunks,-1);
+        queued.assign(nChunks,false);
+        int nSlots = 3*windowChunks;
+        if(nSlots>nChunks)
+            nSlots = nChunks;
+        if(nSlots<3)
+            nSlots = 3;
+        slots.resize(nSlots);
+        slotData.resize((size_t)nSlots*chunkSize*stride);
+        tick = 0;
+        current = -1;
+        reads = 0;
+    }
+
+    /**
+     * \brief get the number of examples
+     */
+    int getCount() const {
+        return ct;
+    }
+
+    /**
+     * \brief get the number of inputs in each example
+     */
+    int getInputCount() const {
+        return ninputs;
+    }
+
+    /**
+     * \brief get the number of outputs in each example
+     */
+    int getOutputCount() const {
+        return noutputs;
+    }
+
+    /**
+     * \brief get the number of examples in each chunk
+     */
+    int getChunkSize() const {
+        return chunkSize;
+    }
+
+    /**
+     * \brief get the number of chunks in each window
+     */
+    int getWindowChunks() const {
+        return windowChunks;
+    }
+
+    /**
+     * \brief get the number of chunks which have been read from the files
+     */
+    long getReads() const {
+        std::unique_lock<std::mutex> lk(lock);
+        return reads;
+    }
+
+    /**
+     * \brief get the modulator of an example from the file
+     * \param k the index of the example
+     */
+    double getH(int32_t k) const {
+        return hs ? hs->get(k) : 0;
+    }
+
+    /**
+     * \brief get an example, reading its chunk if it isn't in memory. The
+     * example is only valid until an example in another chunk is got.
+     * \param k the index of the example
+     * \return the inputs of the example, followed by its outputs
+     */
+    T *get(int32_t k){
+        int c = k/chunkSize;
+        std::unique_lock<std::mutex> lk(lock);
+        int s = chunkSlot[c];
+        // wait if the background thread is reading it
+        while(s>=0 && slots[s].loading){
+            loaded.wait(lk);
+            s = chunkSlot[c];
+        }
+        if(s<0){
+            s = claim(c);
+            lk.unlock();
+            read(s,c);
+            lk.lock();
+            slots[s].loading = false;
+            loaded.notify_all();
+        }
+        slots[s].used = ++tick;
+        current = s;
+        return slotData.data()+((size_t)s*chunkSize+k%chunkSize)*stride;
+    }
+
+    /**
+     * \brief read a chunk in the background, if it isn't already in memory
+     * \param c the chunk
+     */
+    void prefetch(int c){
+        {
+            std::unique_lock<std::mutex> lk(lock);
+            if(chunkSlot[c]>=0 || queued[c])
+                return;
+            queued[c] = true;
+        }
+        pool.submit([this,c]{
+            std::unique_lock<std::mutex> lk(lock);
+            queued[c] = false;
+            if(chunkSlot[c]>=0)
+                return;
+            int s = claim(c);
+            lk.unlock();
+            read(s,c);
+            lk.lock();
+            slots[s].loading = false;
+            loaded.notify_all();
+        });
+    }
+
+private:
+    /**
+     * \brief A place in memory for a chunk
+     */
+    struct Slot {
+        int chunk = -1; //!< the chunk in the slot, or -1
+        bool loading = false; //!< true while the chunk is being read
+        unsigned long used = 0; //!< when the slot was last used
+    };
+
+    /**
+     * \brief choose a slot for a chunk to be read into, which is the least
+     * recently used of those not being read into and not holding the last
+     * example got, and mark it as being read into
+     * \pre the lock is held
+     */
+    int claim(int c){
+        int best = -1;
+        for(int i=0;i<(int)slots.size();i++){
+            if(!slots[i].loading && i!=current &&
+               (best<0 || slots[i].used<slots[best].used))
+                best = i;
+        }
+        Slot& s = slots[best];
+        if(s.chunk>=0)
+            chunkSlot[s.chunk] = -1;
+        s.chunk = c;
+        s.loading = true;
+        s.used = ++tick;
+        chunkSlot[c] = best;
+        reads++;
+        return best;
+    }
+
+    /**
+     * \brief read a chunk into a slot from the files, converting it
+     */
+    void read(int s,int c){
+        T *dest = slotData.data()+(size_t)s*chunkSize*stride;
+        int first = c*chunkSize;
+        int n = std::min(chunkSize,ct-first);
+        for(int i=0;i<n;i++){
+            inputs.copy((size_t)(first+i)*ninputs,ninputs,dest);
+            outputs.copy((size_t)(first+i)*noutputs,noutputs,dest+ninputs);
+            dest += stride;
+        }
+    }
+
+    IDXFile inputs; //!< the file of inputs
+    IDXFile outputs; //!< the file of outputs
+    std::unique_ptr<IDXFile> hs; //!< the file of modulators, if any
+    int ct; //!< number of examples
+    int ninputs; //!< number of inputs
+    int noutputs; //!< number of outputs
+    int stride; //!< values in each example in a chunk
+    int chunkSize; //!< examples in each chunk
+    int windowChunks; //!< chunks in each window
+    int nChunks; //!< number of chunks
+
+    mutable std::mutex lock; //!< protects everything below
+    std::condition_variable loaded; //!< signalled when a chunk has been read
+    std::vector<int> chunkSlot; //!< the slot each chunk is in, or -1
+    std::vector<bool> queued; //!< whether each chunk is waiting to be read in the background
+    std::vector<Slot> slots; //!< the slots
+    std::vector<T> slotData; //!< the chunks in the slots
+    unsigned long tick; //!< counts uses of slots, for finding the least recently used
+    int current; //!< the slot of the last example got, which isn't replaced
+    long reads; //!< number of chunks read
+
+    /// \brief the thread reading chunks in the background, last so that it
+    /// is destroyed first
+    ThreadPool pool;
+};
+
+/**
+ * \brief Stream of double examples
+ */
+typedef ExampleStreamT<double> ExampleStream;
+
+#endif /* __STREAM_HPP */
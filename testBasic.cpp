@@ -6,12 +6,14 @@
  */
 
 #include <iostream>
+#include <atomic>
 
 #define BOOST_TEST_MAIN
 #define BOOST_TEST_DYN_LINK
 #include <boost/test/unit_test.hpp>
 
 #include "test.hpp"
+#include "threadPool.hpp"
 
 /**
  * \brief Utility test class.
@@ -147,6 +149,90 @@ BOOST_AUTO_TEST_CASE(alt) {
     }
 }
 
+/**
+ * \brief Test the alternate() function when there are more of some values than
+ * others: the values should cycle until one runs out.
+ */
+
+BOOST_AUTO_TEST_CASE(altunbalanced) {
+    // three values, with 500 0s, 250 1s and 250 2s, and 100 -1s which never match
+    static const int NUMEXAMPLES = 1100;
+    int arr[NUMEXAMPLES];
+    int j=0;
+    for(int i=0;i<NUMEXAMPLES;i++)
+        arr[i] = i*10 + (i%11==10 ? 9 : (j++%4)%3);
+    auto f = [](int v){return v%10==9 ? -1 : v%10;};
+    alternate<int>(arr,NUMEXAMPLES,3,f);
+    
+    // they cycle 250 times and then once more up to the 1 which isn't there
+    int counts[4] = {0,0,0,0};
+    for(int i=0;i<NUMEXAMPLES;i++){
+        int v = f(arr[i]);
+        counts[v+1]++;
+        if(i<751)
+            BOOST_REQUIRE(v==i%3);
+    }
+    BOOST_REQUIRE(counts[0]==100 && counts[1]==500 && counts[2]==250 && counts[3]==250);
+}
+
+/**
+ * \brief The original alternate(), which scans forward for each item
+ * to swap, so that we can check the faster version does the same.
+ */
+
+template <class T,class TestFunc> void alternateByScanning(T *arr,int nitems,int cycle,TestFunc f){
+    for(int i=0;i<nitems;i++){
+        if(f(arr[i])%cycle!=(i%cycle)){
+            for(int j=i;;j++){
+                if(j>=nitems)return;
+                if(f(arr[j])%cycle==i%cycle){
+                    T v=arr[i];
+                    arr[i]=arr[j];
+                    arr[j]=v;
+                    break;
+                }
+            }
+        }
+    }
+}
+
+/**
+ * \brief Test that alternate() gives exactly the same order as the original
+ * version, on random arrays with balanced and unbalanced values (and some which
+ * never match), so that shuffling with ExampleSet::ALTERNATE is unchanged.
+ */
+
+BOOST_AUTO_TEST_CASE(altmatch) {
+    auto f = [](int v){return v%10==9 ? -1 : v%10;};
+    int arr[4] = {0,1,2,3};
+    alternate<int>(arr,4,2,[](int k){return k<2?1:0;});
+    BOOST_REQUIRE(arr[0]==2 && arr[1]==1 && arr[2]==3 && arr[3]==0);
+    
+    drand48_data rd;
+    srand48_r(10,&rd);
+    for(int t=0;t<2000;t++){
+        long r;
+        lrand48_r(&rd,&r);
+        int n = 1+r%200;
+        lrand48_r(&rd,&r);
+        int cycle = 1+r%5;
+        lrand48_r(&rd,&r);
+        bool balanced = r%2;
+        std::vector<int> a(n),b;
+        for(int i=0;i<n;i++){
+            lrand48_r(&rd,&r);
+            // balanced arrays have the values in turn; the rest have random
+            // values, including some 9s which never match
+            a[i] = i*10 + (balanced ? i%cycle : r%10);
+        }
+        sshuffle<int>(a.data(),n);
+        b = a;
+        alternate<int>(a.data(),n,cycle,f);
+        alternateByScanning<int>(b.data(),n,cycle,f);
+        BOOST_REQUIRE(a==b);
+    }
+}
+
 /**
  * \brief Test the alternation function on examples, simple version
  */
@@ -313,6 +399,203 @@ BOOST_AUTO_TEST_CASE(testmse) {
     
 }
 
+/**
+ * \brief Check that runBatch() gives exactly the same outputs as
+ * running each example with run(), for each network type. There are
+ * more examples than BPNet runs through its batch buffers at once,
+ * and the modulator alternates between examples.
+ */
+
+BOOST_AUTO_TEST_CASE(runbatch) {
+    const int NUMEXAMPLES=300;
+    ExampleSet e(NUMEXAMPLES,3,2,2);
+    drand48_data rd;
+    srand48_r(10,&rd);
+    for(int i=0;i<NUMEXAMPLES;i++){
+        double *ins = e.getInputs(i);
+        for(int j=0;j<3;j++)
+            drand48_r(&rd,ins+j);
+        e.setH(i,i%2);
+    }
+    
+    NetType types[] = {NetType::PLAIN,NetType::OUTPUTBLENDING,
+        NetType::HINPUT,NetType::UESMANN};
+    for(NetType tp: types){
+        Net *n = NetFactory::makeNet(tp,e,4);
+        // give the network random parameters
+        int ct = n->getDataSize();
+        double *buf = new double[ct];
+        for(int i=0;i<ct;i++){
+            drand48_r(&rd,buf+i);
+            buf[i] = buf[i]*2.0-1.0;
+        }
+        n->load(buf);
+        delete [] buf;
+        
+        double *outs = new double[NUMEXAMPLES*2];
+        n->runBatch(e,0,NUMEXAMPLES,outs);
+        for(int i=0;i<NUMEXAMPLES;i++){
+            n->setH(e.getH(i));
+            double *o = n->run(e.getInputs(i));
+            BOOST_REQUIRE(o[0]==outs[i*2]);
+            BOOST_REQUIRE(o[1]==outs[i*2+1]);
+        }
+        delete [] outs;
+        delete n;
+    }
+}
+
+/**
+ * \brief get the maximum error of a sigmoid mode over [-100,100]
+ */
+template <class T> double sigmoidError(SigmoidMode m){
+    const int N=200001;
+    T *x = new T[N];
+    for(int i=0;i<N;i++)
+        x[i] = (T)(-100.0+200.0*i/(N-1));
+    T *y = new T[N];
+    for(int i=0;i<N;i++)
+        y[i]=x[i];
+    activate(m,y,N);
+    double maxErr=0;
+    for(int i=0;i<N;i++){
+        double e = fabs((double)y[i]-sigmoid((double)x[i]));
+        if(e>maxErr)maxErr=e;
+    }
+    delete [] x;
+    delete [] y;
+    return maxErr;
+}
+
+/**
+ * \brief Check that the approximate sigmoid modes are within the
+ * maximum errors given in the SigmoidMode documentation, at every
+ * kernel level this processor supports.
+ */
+BOOST_AUTO_TEST_CASE(sigmoidmodes) {
+    KernelLevel old = Kernels::getLevel();
+    KernelLevel levels[] = {KernelLevel::SCALAR,KernelLevel::SSE2,
+        KernelLevel::AVX2,KernelLevel::AVX512};
+    for(KernelLevel l: levels){
+        if(!Kernels::supported(l))continue;
+        Kernels::setLevel(l);
+        BOOST_REQUIRE(sigmoidError<double>(SigmoidMode::EXACT)==0);
+        BOOST_REQUIRE(sigmoidError<double>(SigmoidMode::POLY)<3e-15);
+        BOOST_REQUIRE(sigmoidError<float>(SigmoidMode::POLY)<1e-7);
+        BOOST_REQUIRE(sigmoidError<double>(SigmoidMode::TABLE)<1e-6);
+        BOOST_REQUIRE(sigmoidError<float>(SigmoidMode::TABLE)<1e-6);
+    }
+    Kernels::setLevel(old);
+}
+
+/**
+ * \brief Check that the delta rule kernel rounds exactly as the plain
+ * loop y -= eta*(e*x)*f does, at every kernel level.
+ */
+template <class T> bool deltaMatches(){
+    static const int N=37; // odd, so the leftovers are done too
+    T x[N],y[N],ref[N];
+    T eta=(T)0.1,e=(T)0.37,f=(T)1.7;
+    for(int i=0;i<N;i++){
+        x[i] = (T)sin(i*1.3);
+        y[i] = ref[i] = (T)cos(i*0.7);
+        T d = eta*(e*x[i])*f;
+        ref[i] -= d;
+    }
+    vecDelta(eta,e,f,x,y,N);
+    return !memcmp(y,ref,sizeof(y));
+}
+
+BOOST_AUTO_TEST_CASE(delta) {
+    KernelLevel old = Kernels::getLevel();
+    KernelLevel levels[] = {KernelLevel::SCALAR,KernelLevel::SSE2,
+        KernelLevel::AVX2,KernelLevel::AVX512};
+    for(KernelLevel l: levels){
+        if(!Kernels::supported(l))continue;
+        Kernels::setLevel(l);
+        BOOST_REQUIRE(deltaMatches<double>());
+        BOOST_REQUIRE(deltaMatches<float>());
+    }
+    Kernels::setLevel(old);
+}
+
+/**
+ * \brief Check that the thread pool runs all the tasks it is given,
+ * including those submitted by other tasks, and passes on exceptions.
+ */
+BOOST_AUTO_TEST_CASE(threadpool) {
+    ThreadPool pool(4);
+    BOOST_REQUIRE(pool.getThreadCount()==4);
+    std::atomic<int> total(0);
+    for(int i=0;i<100;i++){
+        pool.submit([&pool,&total,i]{
+            for(int j=0;j<10;j++)
+                pool.submit([&total,i,j]{total+=i*10+j;});
+        });
+    }
+    pool.wait();
+    BOOST_REQUIRE(total==999*1000/2);
+    
+    pool.submit([]{throw std::runtime_error("task failed");});
+    BOOST_REQUIRE_THROW(pool.wait(),std::runtime_error);
+    // and the pool still works afterwards
+    pool.submit([&total]{total=0;});
+    pool.wait();
+    BOOST_REQUIRE(total==0);
+}
+
+/**
+ * \brief Check that cross-validation events are sent to the metrics
+ * sinks, and that nothing is written without one.
+ */
+BOOST_AUTO_TEST_CASE(metrics) {
+    // a small addition problem
+    ExampleSet e(100,2,1,1);
+    for(int i=0;i<100;i++){
+        double a = (i%10)*0.05;
+        double b = (i/10)*0.05;
+        e.getInputs(i)[0]=a;
+        e.getInputs(i)[1]=b;
+        *e.getOutputs(i)=a+b;
+    }
+    Net *n = NetFactory::makeNet(NetType::PLAIN,e,2);
+    
+    // no sink; the old version always wrote a file called "foo"
+    remove("foo");
+    Net::SGDParams params(1,10000);
+    params.crossValidation(e,0.5,100,10,false);
+    n->trainSGD(e,params);
+    BOOST_REQUIRE(fopen("foo","r")==NULL);
+    
+    // a ring buffer, which should hold the last 30 of 100 events
+    RingBufferMetrics ring(30);
+    params.setMetrics(&ring);
+    n->trainSGD(e,params);
+    BOOST_REQUIRE(ring.getTotal()==100);
+    BOOST_REQUIRE(ring.getCount()==30);
+    for(int i=0;i<30;i++){
+        MetricsRecord r = ring.get(i);
+        BOOST_REQUIRE(r.iteration==(70+i)*100+99);
+        BOOST_REQUIRE(r.slice==(70+i)%10);
+    }
+    
+    // a file, in small batches so several are written
+    {
+        FileMetrics file("metrics.csv",7);
+        params.setMetrics(&file);
+        n->trainSGD(e,params);
+    }
+    FILE *a = fopen("metrics.csv","r");
+    BOOST_REQUIRE(a!=NULL);
+    char buf[256];
+    int lines=0;
+    while(fgets(buf,256,a))
+        lines++;
+    fclose(a);
+    BOOST_REQUIRE(lines==101);
+    delete n;
+}
+
 /**
  * \brief Loading MNIST data and converting to an example set.
  * Ensure we can load MNIST data into an example set, and that
@@ -344,6 +627,127 @@ BOOST_AUTO_TEST_CASE(loadmnist) {
     }
 }
 
+/**
+ * \brief write an IDX file with a given header and payload
+ */
+static void writeIDX(const char *fn,const std::vector<uint8_t>& header,
+                     const std::vector<uint8_t>& payload){
+    FILE *a = fopen(fn,"wb");
+    fwrite(header.data(),1,header.size(),a);
+    fwrite(payload.data(),1,payload.size(),a);
+    fclose(a);
+}
+
+/**
+ * \brief Reading IDX files (see IDXFile) of different types and numbers of
+ * dimensions, rejecting bad ones, and loading part of the MNIST data from them.
+ */
+BOOST_AUTO_TEST_CASE(idx) {
+    // 16-bit integers in 2x3x2: 0,-1,2,-3...
+    std::vector<uint8_t> shorts;
+    for(int i=0;i<12;i++){
+        uint16_t v = (uint16_t)(i&1 ? -i : i);
+        shorts.push_back(v>>8);
+        shorts.push_back(v&255);
+    }
+    writeIDX("test.idx",{0,0,0x0B,3, 0,0,0,2, 0,0,0,3, 0,0,0,2},shorts);
+    {
+        IDXFile f("test.idx");
+        BOOST_REQUIRE(f.getType()==IDXType::SHORT);
+        BOOST_REQUIRE(f.getDimCount()==3);
+        BOOST_REQUIRE(f.getCount()==2);
+        BOOST_REQUIRE(f.getDim(1)==3);
+        BOOST_REQUIRE(f.getItemSize()==6);
+        for(int i=0;i<12;i++)
+            BOOST_REQUIRE(f.get(i)==(i&1 ? -i : i));
+    }
+    
+    // doubles and floats, one dimension
+    writeIDX("test.idx",{0,0,0x0E,1, 0,0,0,1},{0xc0,0x09,0x21,0xfb,0x54,0x44,0x2d,0x18});
+    BOOST_REQUIRE(IDXFile("test.idx").get(0)==-3.141592653589793);
+    writeIDX("test.idx",{0,0,0x0D,1, 0,0,0,1},{0x3e,0x80,0,0});
+    BOOST_REQUIRE(IDXFile("test.idx").get(0)==0.25);
+    
+    // a file which is too short, too long, of a bad type, or missing
+    writeIDX("test.idx",{0,0,0x08,2, 0,0,0,2, 0,0,0,2},{1,2,3});
+    BOOST_REQUIRE_THROW(IDXFile("test.idx"),std::runtime_error);
+    writeIDX("test.idx",{0,0,0x08,2, 0,0,0,2, 0,0,0,2},{1,2,3,4,5});
+    BOOST_REQUIRE_THROW(IDXFile("test.idx"),std::runtime_error);
+    writeIDX("test.idx",{0,0,0x0A,1, 0,0,0,1},{1});
+    BOOST_REQUIRE_THROW(IDXFile("test.idx"),std::runtime_error);
+    remove("test.idx");
+    BOOST_REQUIRE_THROW(IDXFile("test.idx"),std::runtime_error);
+    
+    // part of the MNIST data
+    MNIST all("../testdata/t10k-labels-idx1-ubyte","../testdata/t10k-images-idx3-ubyte");
+    MNIST part("../testdata/t10k-labels-idx1-ubyte","../testdata/t10k-images-idx3-ubyte",
+               1000,500);
+    BOOST_REQUIRE(all.getCount()==10000);
+    BOOST_REQUIRE(part.getCount()==500);
+    BOOST_REQUIRE(part.r()==28 && part.c()==28);
+    for(int i=0;i<500;i++){
+        BOOST_REQUIRE(part.getLabel(i)==all.getLabel(i+1000));
+        BOOST_REQUIRE(!memcmp(part.getImg(i),all.getImg(i+1000),28*28));
+    }
+    BOOST_REQUIRE_THROW(MNIST("../testdata/t10k-labels-idx1-ubyte",
+                              "../testdata/t10k-images-idx3-ubyte",9900,200),
+                        std::runtime_error);
+    // labels and images swapped
+    BOOST_REQUIRE_THROW(MNIST("../testdata/t10k-images-idx3-ubyte",
+                              "../testdata/t10k-labels-idx1-ubyte"),
+                        std::runtime_error);
+}
+
+/**
+ * \brief Loading MNIST data into a COMPACT example set (see ExampleSetBase::Storage),
+ * and checking that every example reads back exactly as it does from the ordinary
+ * FULL set, both in the original order and after a subset of each has been shuffled
+ * in the same way.
+ */
+BOOST_AUTO_TEST_CASE(loadmnistcompact) {
+    MNIST m("../testdata/t10k-labels-idx1-ubyte","../testdata/t10k-images-idx3-ubyte");
+    ExampleSet full(m);
+    // the compact set uses the MNIST object's mapped files, and keeps them
+    // after it is deleted
+    MNIST *m2 = new MNIST("../testdata/t10k-labels-idx1-ubyte",
+                          "../testdata/t10k-images-idx3-ubyte");
+    ExampleSet compact(*m2,ExampleSet::COMPACT);
+    delete m2;
+    BOOST_REQUIRE(full.getStorage()==ExampleSet::FULL);
+    BOOST_REQUIRE(compact.getStorage()==ExampleSet::COMPACT);
+    BOOST_REQUIRE(compact.getCount()==full.getCount());
+    BOOST_REQUIRE(compact.getInputCount()==full.getInputCount());
+    BOOST_REQUIRE(compact.getOutputCount()==full.getOutputCount());
+    
+    int nin = full.getInputCount();
+    int nout = full.getOutputCount();
+    BOOST_REQUIRE(compact.getLabel(1233)==5);
+    
+    ExampleSet fullSub(full,100,5000);
+    ExampleSet compactSub(compact,100,5000);
+    drand48_data rd1,rd2;
+    srand48_r(3,&rd1);
+    srand48_r(3,&rd2);
+    fullSub.shuffle(&rd1,ExampleSet::STRIDE);
+    compactSub.shuffle(&rd2,ExampleSet::STRIDE);
+    
+    ExampleSet *sets[][2] = {{&full,&compact},{&fullSub,&compactSub}};
+    for(auto& s: sets){
+        for(int i=0;i<s[0]->getCount();i++){
+            double *fin = s[0]->getInputs(i);
+            double *cin = s[1]->getInputs(i);
+            for(int j=0;j<nin;j++)
+                BOOST_REQUIRE(fin[j]==cin[j]);
+            double *fout = s[0]->getOutputs(i);
+            double *cout = s[1]->getOutputs(i);
+            for(int j=0;j<nout;j++)
+                BOOST_REQUIRE(fout[j]==cout[j]);
+            BOOST_REQUIRE(fout[s[1]->getLabel(i)]==1.0);
+            BOOST_REQUIRE(s[0]->getH(i)==s[1]->getH(i));
+        }
+    }
+}
+
 /** 
  * @}
  */
@@ -103,6 +103,281 @@ BOOST_AUTO_TEST_CASE(saveloadues) {
 }
 
 
+/**
+ * \brief Test that saving and loading float networks of all types
+ * leaves the weights and biases unchanged, and that loading them
+ * as double networks gives the same values.
+ */
+BOOST_AUTO_TEST_CASE(saveloadfloat) {
+    NetType types[] = {NetType::PLAIN,NetType::OUTPUTBLENDING,
+        NetType::HINPUT,NetType::UESMANN};
+    for(NetType tp: types){
+        int layers[3];
+        layers[0]=4;
+        layers[1]=3;
+        layers[2]=2;
+        NetT<float> *n = NetFactory::makeNet<float>(tp,3,layers);
+        
+        ExampleSetT<float> e(1,4,2,1);
+        float *p = e.getInputs(0);
+        *p++=0;
+        *p++=2;
+        *p++=3;
+        *p=1;
+        p = e.getOutputs(0);
+        *p++=100;
+        *p=20;
+        e.setH(0,0);
+        
+        NetT<float>::SGDParams parms(10,e,100);
+        n->trainSGD(e,parms);
+        
+        float *oldData = new float[n->getDataSize()];
+        n->save(oldData);
+        
+        NetFactory::save("foo.net",n);
+        
+        // load as float
+        NetT<float> *saved = NetFactory::load<float>("foo.net");
+        BOOST_REQUIRE(n->type == saved->type);
+        BOOST_REQUIRE(n->getDataSize() == saved->getDataSize());
+        float *savedData = new float[saved->getDataSize()];
+        saved->save(savedData);
+        for(int i=0;i<n->getDataSize();i++){
+            BOOST_REQUIRE(oldData[i]==savedData[i]);
+        }
+        
+        // load as double
+        Net *savedd = NetFactory::load("foo.net");
+        BOOST_REQUIRE(n->type == savedd->type);
+        BOOST_REQUIRE(n->getDataSize() == savedd->getDataSize());
+        double *savedDataD = new double[savedd->getDataSize()];
+        savedd->save(savedDataD);
+        for(int i=0;i<n->getDataSize();i++){
+            BOOST_REQUIRE((double)oldData[i]==savedDataD[i]);
+        }
+        
+        delete [] savedDataD;
+        delete [] savedData;
+        delete [] oldData;
+        delete savedd;
+        delete saved;
+        delete n;
+    }
+}
+
+/**
+ * \brief Test that restoring a snapshot of a network of each type (see
+ * Net::snapshot()) gives the same parameters, and that after training with
+ * a best network buffer (taking snapshots every few iterations) the buffer
+ * holds the network's saved data.
+ */
+BOOST_AUTO_TEST_CASE(snapshot) {
+    NetType types[] = {NetType::PLAIN,NetType::OUTPUTBLENDING,
+        NetType::HINPUT,NetType::UESMANN};
+    for(NetType tp: types){
+        int layers[3];
+        layers[0]=4;
+        layers[1]=3;
+        layers[2]=2;
+        Net *n = NetFactory::makeNet(tp,3,layers);
+        
+        ExampleSet e(1,4,2,1);
+        double *p = e.getInputs(0);
+        *p++=0;
+        *p++=2;
+        *p++=3;
+        *p=1;
+        p = e.getOutputs(0);
+        *p++=100;
+        *p=20;
+        e.setH(0,0);
+        
+        Net::SGDParams parms(10,e,100);
+        parms.storeBest().setBestInterval(7);
+        n->trainSGD(e,parms);
+        
+        int size = n->getDataSize();
+        double *oldData = new double[size];
+        double *snap = new double[size];
+        double *newData = new double[size];
+        n->save(oldData);
+        for(int i=0;i<size;i++)
+            BOOST_REQUIRE(oldData[i]==parms.bestNetBuffer[i]);
+        
+        // snapshot, train from a different seed, and restore
+        n->snapshot(snap);
+        Net::SGDParams parms2(10,e,100);
+        parms2.setSeed(1);
+        n->trainSGD(e,parms2);
+        n->restore(snap);
+        n->save(newData);
+        for(int i=0;i<size;i++)
+            BOOST_REQUIRE(oldData[i]==newData[i]);
+        
+        delete [] oldData;
+        delete [] snap;
+        delete [] newData;
+        delete n;
+    }
+}
+
+/**
+ * \brief Save example sets to files and load them again (see ExampleSetT::save()):
+ * a shuffled modulated set, which should keep its order, modulator levels and
+ * range, and a COMPACT MNIST set, which should load as the ordinary set. Changes
+ * to a loaded set should not reach the file, and files which are not of sets of
+ * the scalar type should be rejected.
+ */
+
+BOOST_AUTO_TEST_CASE(saveexamples) {
+    ExampleSet e(1000,3,2,4);
+    for(int i=0;i<1000;i++){
+        for(int j=0;j<3;j++)
+            e.getInputs(i)[j] = i*0.01+j;
+        for(int j=0;j<2;j++)
+            e.getOutputs(i)[j] = -i*0.02-j;
+        e.setH(i,2+(i%4)/3.0);
+    }
+    e.setHRange(2,3);
+    drand48_data rd;
+    srand48_r(1,&rd);
+    e.shuffle(&rd,ExampleSet::ALTERNATE);
+    e.save("examples.exs");
+    
+    for(int k=0;k<2;k++){
+        ExampleSet l("examples.exs");
+        BOOST_REQUIRE(l.getStorage()==ExampleSet::FULL);
+        BOOST_REQUIRE(l.getCount()==1000);
+        BOOST_REQUIRE(l.getInputCount()==3);
+        BOOST_REQUIRE(l.getOutputCount()==2);
+        BOOST_REQUIRE(l.getNumHLevels()==4);
+        BOOST_REQUIRE(l.getMinH()==2 && l.getMaxH()==3);
+        for(int i=0;i<1000;i++){
+            for(int j=0;j<3;j++)
+                BOOST_REQUIRE(l.getInputs(i)[j]==e.getInputs(i)[j]);
+            for(int j=0;j<2;j++)
+                BOOST_REQUIRE(l.getOutputs(i)[j]==e.getOutputs(i)[j]);
+            BOOST_REQUIRE(l.getH(i)==e.getH(i));
+        }
+        // the second time round, check this didn't change the file
+        l.getInputs(0)[0] = 1000;
+        l.setH(1,0);
+    }
+    
+    BOOST_REQUIRE_THROW(ExampleSetT<float>("examples.exs"),std::runtime_error);
+    ExampleSetT<float> f((ExampleSet("examples.exs")));
+    BOOST_REQUIRE(f.getInputs(999)[2]==(float)e.getInputs(999)[2]);
+    
+    FILE *a = fopen("examples.exs","r+b");
+    fseek(a,-8,SEEK_END);
+    fwrite("12345678",8,1,a); // not too short, but not the length...
+    fputc(0,a); // ...after this
+    fclose(a);
+    BOOST_REQUIRE_THROW(ExampleSet("examples.exs"),std::runtime_error);
+    BOOST_REQUIRE_THROW(ExampleSet("../testdata/t10k-labels-idx1-ubyte"),std::runtime_error);
+    remove("examples.exs");
+    BOOST_REQUIRE_THROW(ExampleSet("examples.exs"),std::runtime_error);
+    
+    MNIST m("../testdata/t10k-labels-idx1-ubyte","../testdata/t10k-images-idx3-ubyte");
+    ExampleSet full(m);
+    ExampleSet(m,ExampleSet::COMPACT).save("mnist.exs");
+    ExampleSet l("mnist.exs");
+    remove("mnist.exs"); // which we can do, as it's mapped
+    BOOST_REQUIRE(l.getCount()==full.getCount());
+    for(int i=0;i<full.getCount();i++){
+        for(int j=0;j<full.getInputCount();j++)
+            BOOST_REQUIRE(l.getInputs(i)[j]==full.getInputs(i)[j]);
+        for(int j=0;j<full.getOutputCount();j++)
+            BOOST_REQUIRE(l.getOutputs(i)[j]==full.getOutputs(i)[j]);
+    }
+}
+
+/**
+ * \brief Train a UESMANN network with cross-validation, once straight
+ * through and once interrupted and resumed from a checkpoint (see
+ * Net::SGDParams::setCheckpoint()), checking that the results are exactly
+ * the same. This is done with plain gradient descent, and with Adam in
+ * mini-batches, whose state is also saved.
+ */
+
+BOOST_AUTO_TEST_CASE(checkpoint) {
+    ExampleSet e(1000,2,1,2);
+    drand48_data rd;
+    srand48_r(10,&rd);
+    for(int i=0;i<1000;i++){
+        double a,b;
+        drand48_r(&rd,&a);a*=0.5;
+        drand48_r(&rd,&b);b*=0.5;
+        e.getInputs(i)[0] = a;
+        e.getInputs(i)[1] = b;
+        e.setH(i,i%2);
+        *e.getOutputs(i) = (i%2) ? (a+b)*0.3 : a+b;
+    }
+    
+    for(int k=0;k<2;k++){
+        remove("straight.ckpt");
+        remove("resumed.ckpt");
+        
+        // straight through, checkpointing as we go
+        Net *n = NetFactory::makeNet(NetType::UESMANN,e,4);
+        Net::SGDParams params(k ? 0.01 : 1,50000);
+        params.crossValidationManual(10,20,1000)
+              .storeBest()
+              .setSeed(3)
+              .setShuffle(ExampleSet::ALTERNATE)
+              .setCheckpoint("straight.ckpt",7000);
+        if(k)
+            params.setOptimizer(Optimizer::ADAM).setBatchSize(4);
+        double mse = n->trainSGD(e,params);
+        int size = n->getDataSize();
+        double *data = new double[size];
+        n->save(data);
+        delete n;
+        
+        // interrupted after 30000 iterations, and resumed from the last
+        // checkpoint (at 28000) in a new network
+        for(int r=0;r<2;r++){
+            n = NetFactory::makeNet(NetType::UESMANN,e,4);
+            Net::SGDParams params2(params.eta,r ? 50000 : 30000);
+            params2.crossValidationManual(10,20,1000)
+                   .storeBest()
+                   .setSeed(3)
+                   .setShuffle(ExampleSet::ALTERNATE)
+                   .setCheckpoint("resumed.ckpt",7000);
+            if(k)
+                params2.setOptimizer(Optimizer::ADAM).setBatchSize(4);
+            double mse2 = n->trainSGD(e,params2);
+            if(r){
+                printf("%f %f\n",mse,mse2);
+                BOOST_REQUIRE(mse==mse2);
+                double *data2 = new double[size];
+                n->save(data2);
+                for(int i=0;i<size;i++)
+                    BOOST_REQUIRE(data[i]==data2[i]);
+                delete [] data2;
+            }
+            delete n;
+        }
+        
+        // resuming a finished run finishes it again the same way
+        n = NetFactory::makeNet(NetType::UESMANN,e,4);
+        BOOST_REQUIRE(n->trainSGD(e,params)==mse);
+        
+        // but we can't resume a different run
+        Net::SGDParams params3(1,50000);
+        params3.crossValidationManual(10,20,1000)
+               .setSeed(4)
+               .setCheckpoint("straight.ckpt",7000);
+        BOOST_REQUIRE_THROW(n->trainSGD(e,params3),std::runtime_error);
+        delete n;
+        delete [] data;
+    }
+    remove("straight.ckpt");
+    remove("resumed.ckpt");
+}
+
+
 /** 
  * @}
  */
@@ -5,9 +5,11 @@
  */
 
 #include <iostream>
+#include <set>
 #include <boost/test/unit_test.hpp>
 
 #include "test.hpp"
+#include "ensemble.hpp"
 
 BOOST_AUTO_TEST_SUITE(basictrain)
 
@@ -191,6 +193,624 @@ BOOST_AUTO_TEST_CASE(addition) {
 
 //! [addition]
 
+/**
+ * \brief As the addition test, but training in mini-batches of 8 examples
+ * rather than one example at a time.
+ */
+
+BOOST_AUTO_TEST_CASE(additionbatch) {
+    ExampleSet e(1000,2,1,1);
+    
+    drand48_data rd;
+    srand48_r(10,&rd);
+    
+    for(int i=0;i<1000;i++){
+        double *ins = e.getInputs(i);
+        double *out = e.getOutputs(i);
+        double a,b;
+        drand48_r(&rd,&a);a*=0.5;
+        drand48_r(&rd,&b);b*=0.5;
+        ins[0] = a;
+        ins[1] = b;
+        *out = a+b;
+    }
+    
+    Net *net = NetFactory::makeNet(NetType::PLAIN,e,2);
+    
+    // eta=1, lots of iterations (each batch counts as 8 iterations),
+    // batches of 8 examples
+    Net::SGDParams params(1,10000000);
+    params.crossValidation(e,0.5,1000,10,false)
+          .storeBest()
+          .setSeed(0)
+          .setBatchSize(8);
+    
+    double mse = net->trainSGD(e,params);
+    printf("%f\n",mse);
+    BOOST_REQUIRE(mse<0.03);
+    
+    // as in additionmod, keep away from the ends where the nodes saturate
+    for(double a=0.1;a<0.4;a+=0.02){
+        for(double b=0.1;b<0.4;b+=0.02){
+            double runIns[2];
+            runIns[0]=a;
+            runIns[1]=b;
+            double out = *(net->run(runIns));
+            double diff = fabs(out-(a+b));
+            BOOST_REQUIRE(diff<0.05);
+        }
+    }
+    delete net;
+}
+
+/**
+ * \brief Train on addition examples streamed from files (see ExampleStreamT),
+ * with only a few chunks of them in memory at once. Check that the streamed
+ * examples are those written, that shuffling keeps each window of examples to
+ * a few chunks, that the network learns as in additionbatch, and that each
+ * chunk is read about once an epoch.
+ */
+
+BOOST_AUTO_TEST_CASE(additionstream) {
+    ExampleSet e(4000,2,1,1);
+    drand48_data rd;
+    srand48_r(10,&rd);
+    std::vector<double> ins,outs,hs;
+    for(int i=0;i<4000;i++){
+        double a,b;
+        drand48_r(&rd,&a);a*=0.5;
+        drand48_r(&rd,&b);b*=0.5;
+        e.getInputs(i)[0] = a;
+        e.getInputs(i)[1] = b;
+        *e.getOutputs(i) = a+b;
+        e.setH(i,i%3);
+        ins.push_back(a);
+        ins.push_back(b);
+        outs.push_back(a+b);
+        hs.push_back(i%3);
+    }
+    IDXFile::write("streamins.idx",{4000,2},ins.data());
+    IDXFile::write("streamouts.idx",{4000,1},outs.data());
+    IDXFile::write("streamhs.idx",{4000},hs.data());
+    
+    // 40 chunks of 100 examples, in windows of 4 chunks
+    std::shared_ptr<ExampleStream> stream(new ExampleStream("streamins.idx","streamouts.idx",
+                                                            "streamhs.idx",100,4));
+    ExampleSet s(stream);
+    BOOST_REQUIRE(s.getStorage()==ExampleSet::STREAMED);
+    BOOST_REQUIRE(s.getCount()==4000);
+    for(int i=0;i<4000;i++){
+        BOOST_REQUIRE(s.getInputs(i)[0]==e.getInputs(i)[0]);
+        BOOST_REQUIRE(s.getInputs(i)[1]==e.getInputs(i)[1]);
+        BOOST_REQUIRE(*s.getOutputs(i)==*e.getOutputs(i));
+        BOOST_REQUIRE(s.getH(i)==e.getH(i));
+    }
+    
+    // shuffle a view, and check each window of 400 examples is from 4 chunks
+    ExampleSet view(s,0,4000);
+    view.shuffle(&rd,ExampleSet::STRIDE);
+    std::vector<int32_t> order(4000);
+    view.getOrder(order.data());
+    std::vector<bool> seen(4000,false);
+    for(int w=0;w<10;w++){
+        std::set<int> chunks;
+        for(int i=w*400;i<(w+1)*400;i++){
+            BOOST_REQUIRE(!seen[order[i]]);
+            seen[order[i]] = true;
+            chunks.insert(order[i]/100);
+            BOOST_REQUIRE(view.getInputs(i)[0]+view.getInputs(i)[1]==*view.getOutputs(i));
+        }
+        BOOST_REQUIRE(chunks.size()==4);
+    }
+    
+    Net *net = NetFactory::makeNet(NetType::PLAIN,s,2);
+    Net::SGDParams params(1,2000000);
+    params.crossValidation(s,0.25,1000,10,false)
+          .storeBest()
+          .setSeed(0)
+          .setBatchSize(8);
+    long reads = stream->getReads();
+    double mse = net->trainSGD(s,params);
+    reads = stream->getReads()-reads;
+    int epochs = 2000000/3000;
+    printf("%f, %ld chunks read in %d epochs\n",mse,reads,epochs);
+    BOOST_REQUIRE(mse<0.03);
+    BOOST_REQUIRE(reads<epochs*40*3/2);
+    
+    for(double a=0.1;a<0.4;a+=0.02){
+        for(double b=0.1;b<0.4;b+=0.02){
+            double runIns[2] = {a,b};
+            BOOST_REQUIRE(fabs(*(net->run(runIns))-(a+b))<0.05);
+        }
+    }
+    
+    params.setThreads(2);
+    BOOST_REQUIRE_THROW(net->trainSGD(s,params),std::logic_error);
+    
+    // nor can several networks be trained on it at once
+    params.setThreads(1);
+    EnsembleTrainer ens(s,2);
+    ens.add(net,params);
+    BOOST_REQUIRE_THROW(ens.train(),std::logic_error);
+    delete net;
+    remove("streamins.idx");
+    remove("streamouts.idx");
+    remove("streamhs.idx");
+}
+
+/**
+ * \brief Train on the addition examples in mini-batches split across
+ * threads (see Net::SGDParams::batchThreads), checking that this
+ * gives exactly the same network each time, and much the same network as
+ * when not split, for both plain and UESMANN networks.
+ */
+
+BOOST_AUTO_TEST_CASE(additionbatchthreads) {
+    ExampleSet e(1000,2,1,2);
+    
+    drand48_data rd;
+    srand48_r(10,&rd);
+    
+    for(int i=0;i<1000;i++){
+        double *ins = e.getInputs(i);
+        double *out = e.getOutputs(i);
+        double a,b;
+        drand48_r(&rd,&a);a*=0.5;
+        drand48_r(&rd,&b);b*=0.5;
+        ins[0] = a;
+        ins[1] = b;
+        // odd examples are scaled down at h=1, as in additionmod
+        e.setH(i,i%2);
+        *out = (i%2) ? (a+b)*0.3 : a+b;
+    }
+    
+    NetType types[] = {NetType::PLAIN,NetType::UESMANN};
+    for(int t=0;t<2;t++){
+        Net *nets[3];
+        double mses[3];
+        for(int k=0;k<3;k++){
+            nets[k] = NetFactory::makeNet(types[t],e,4);
+            // the first is unsplit, the other two split across 3 threads
+            Net::SGDParams params(1,200000);
+            params.storeBest()
+                  .setSeed(0)
+                  .setBatchSize(64)
+                  .setBatchThreads(k?3:1);
+            mses[k] = nets[k]->trainSGD(e,params);
+        }
+        printf("%f %f %f\n",mses[0],mses[1],mses[2]);
+        BOOST_REQUIRE(mses[1]==mses[2]);
+        BOOST_REQUIRE(fabs(mses[0]-mses[1])<0.001);
+        
+        int size = nets[0]->getDataSize();
+        double *d1 = new double[size];
+        double *d2 = new double[size];
+        nets[1]->save(d1);
+        nets[2]->save(d2);
+        for(int i=0;i<size;i++)
+            BOOST_REQUIRE(d1[i]==d2[i]);
+        delete [] d1;
+        delete [] d2;
+        for(int k=0;k<3;k++)
+            delete nets[k];
+    }
+    
+    // networks which can't split batches say so
+    Net *n = NetFactory::makeNet(NetType::HINPUT,e,4);
+    Net::SGDParams params(1,1000);
+    params.setBatchSize(64).setBatchThreads(3);
+    BOOST_REQUIRE_THROW(n->trainSGD(e,params),std::logic_error);
+    delete n;
+}
+
+/**
+ * \brief Cross-validate in the background (see Net::SGDParams::asyncCV)
+ * while training on addition. This should record the same errors and train
+ * the same network as cross-validating in the training thread, and when
+ * picking the best network by cross-validation, it should be the one
+ * with the lowest recorded error.
+ */
+
+BOOST_AUTO_TEST_CASE(additionasynccv) {
+    ExampleSet e(1000,2,1,1);
+    
+    drand48_data rd;
+    srand48_r(10,&rd);
+    
+    for(int i=0;i<1000;i++){
+        double *ins = e.getInputs(i);
+        double *out = e.getOutputs(i);
+        double a,b;
+        drand48_r(&rd,&a);a*=0.5;
+        drand48_r(&rd,&b);b*=0.5;
+        ins[0] = a;
+        ins[1] = b;
+        *out = a+b;
+    }
+    
+    // first pick the best by training error, with and without the background
+    RingBufferMetrics ring0(100),ring1(100);
+    RingBufferMetrics *ring[2] = {&ring0,&ring1};
+    double mses[2];
+    for(int k=0;k<2;k++){
+        Net *net = NetFactory::makeNet(NetType::PLAIN,e,2);
+        Net::SGDParams params(1,100000);
+        params.crossValidation(e,0.5,100,10,false)
+              .setSelectBestWithCV(false)
+              .storeBest()
+              .setSeed(0)
+              .setMetrics(ring[k])
+              .setAsyncCV(k==1);
+        mses[k] = net->trainSGD(e,params);
+        delete net;
+    }
+    printf("%f %f\n",mses[0],mses[1]);
+    BOOST_REQUIRE(mses[0]==mses[1]);
+    BOOST_REQUIRE(ring[0]->getTotal()==100);
+    BOOST_REQUIRE(ring[1]->getTotal()==100);
+    for(int i=0;i<100;i++){
+        MetricsRecord r0 = ring[0]->get(i);
+        MetricsRecord r1 = ring[1]->get(i);
+        BOOST_REQUIRE(r0.iteration==r1.iteration);
+        BOOST_REQUIRE(r0.slice==r1.slice);
+        BOOST_REQUIRE(r0.error==r1.error);
+    }
+    
+    // then by cross-validation error in the background
+    Net *net = NetFactory::makeNet(NetType::PLAIN,e,2);
+    Net::SGDParams params(1,100000);
+    ring[1]->clear();
+    params.crossValidation(e,0.5,100,10,false)
+          .storeBest()
+          .setSeed(0)
+          .setMetrics(ring[1])
+          .setAsyncCV();
+    double mse = net->trainSGD(e,params);
+    printf("%f\n",mse);
+    BOOST_REQUIRE(mse<0.03);
+    
+    MetricsRecord best = ring[1]->get(0);
+    for(int i=1;i<100;i++){
+        if(ring[1]->get(i).error < best.error)
+            best = ring[1]->get(i);
+    }
+    // the CV examples are at the end, and weren't shuffled
+    ExampleSet cv(e,500,500);
+    BOOST_REQUIRE(net->test(cv,best.slice*50,50)==best.error);
+    delete net;
+}
+
+/**
+ * \brief Train several networks on addition at once, with different seeds
+ * and learning rates, using EnsembleTrainer. Each should be exactly
+ * the network trained on its own, and the examples should be unchanged.
+ */
+
+BOOST_AUTO_TEST_CASE(additionensemble) {
+    ExampleSet e(1000,2,1,1);
+    
+    drand48_data rd;
+    srand48_r(10,&rd);
+    
+    for(int i=0;i<1000;i++){
+        double *ins = e.getInputs(i);
+        double *out = e.getOutputs(i);
+        double a,b;
+        drand48_r(&rd,&a);a*=0.5;
+        drand48_r(&rd,&b);b*=0.5;
+        ins[0] = a;
+        ins[1] = b;
+        *out = a+b;
+    }
+    double *first = e.getInputs(0);
+    
+    static const int N=6;
+    Net *nets[N];
+    Net::SGDParams *params[N];
+    EnsembleTrainer ens(e,3);
+    for(int i=0;i<N;i++){
+        nets[i] = NetFactory::makeNet(NetType::PLAIN,e,2);
+        params[i] = new Net::SGDParams(i<3 ? 1 : 0.5,100000);
+        params[i]->storeBest().setSeed(i%3);
+        BOOST_REQUIRE(ens.add(nets[i],*params[i])==i);
+    }
+    ens.train();
+    BOOST_REQUIRE(e.getInputs(0)==first);
+    
+    int best = ens.getBest();
+    for(int i=0;i<N;i++){
+        printf("%f\n",ens.getScore(i));
+        BOOST_REQUIRE(ens.getNet(i)==nets[i]);
+        BOOST_REQUIRE(ens.getScore(i)<0.03);
+        BOOST_REQUIRE(ens.getScore(best)<=ens.getScore(i));
+        
+        // train the same network on its own
+        Net *n = NetFactory::makeNet(NetType::PLAIN,e,2);
+        Net::SGDParams p(i<3 ? 1 : 0.5,100000);
+        p.storeBest().setSeed(i%3);
+        BOOST_REQUIRE(n->trainSGD(e,p)==ens.getScore(i));
+        
+        int size = n->getDataSize();
+        double *a = new double[size];
+        double *b = new double[size];
+        n->save(a);
+        nets[i]->save(b);
+        for(int j=0;j<size;j++)
+            BOOST_REQUIRE(a[j]==b[j]);
+        delete [] a;
+        delete [] b;
+        delete n;
+        delete nets[i];
+        delete params[i];
+    }
+}
+
+/**
+ * \brief Stop training on addition early (see Net::SGDParams::stopPatience):
+ * on training error at the end of each epoch, when a target error is
+ * reached, and on cross-validation error in and out of the training thread.
+ */
+
+BOOST_AUTO_TEST_CASE(additionstop) {
+    ExampleSet e(1000,2,1,1);
+    
+    drand48_data rd;
+    srand48_r(10,&rd);
+    
+    for(int i=0;i<1000;i++){
+        double *ins = e.getInputs(i);
+        double *out = e.getOutputs(i);
+        double a,b;
+        drand48_r(&rd,&a);a*=0.5;
+        drand48_r(&rd,&b);b*=0.5;
+        ins[0] = a;
+        ins[1] = b;
+        *out = a+b;
+    }
+    Net *net = NetFactory::makeNet(NetType::PLAIN,e,2);
+    
+    // stop when the training error over an epoch stops falling much
+    Net::SGDParams params(1,1000000);
+    params.storeBest().setSeed(0).setEarlyStopping(5,0.00001);
+    double mse = net->trainSGD(e,params);
+    printf("%f %d\n",mse,params.stoppedAt);
+    BOOST_REQUIRE(mse<0.03);
+    BOOST_REQUIRE(params.stoppedAt<1000000);
+    BOOST_REQUIRE(params.stoppedAt%1000==0);
+    
+    // stop on reaching an error
+    Net::SGDParams params2(1,1000000);
+    params2.storeBest().setSeed(0).setStopError(0.001);
+    mse = net->trainSGD(e,params2);
+    printf("%f %d\n",mse,params2.stoppedAt);
+    BOOST_REQUIRE(params2.stoppedAt<1000000);
+    BOOST_REQUIRE(params2.stoppedAt%1000==0);
+    BOOST_REQUIRE(mse<0.002);
+    
+    // stop on cross-validation error, which should happen at the same
+    // point in the background as here
+    int stops[2];
+    for(int k=0;k<2;k++){
+        Net::SGDParams params3(1,1000000);
+        params3.crossValidation(e,0.5,1000,10,false)
+              .storeBest()
+              .setSeed(0)
+              .setEarlyStopping(20,0.00001)
+              .setAsyncCV(k==1);
+        mse = net->trainSGD(e,params3);
+        stops[k] = params3.stoppedAt;
+        printf("%f %d\n",mse,stops[k]);
+        BOOST_REQUIRE(mse<0.03);
+    }
+    BOOST_REQUIRE(stops[0]<1000000);
+    BOOST_REQUIRE(stops[0]%1000==0);
+    // the background thread may not catch up straight away
+    BOOST_REQUIRE(stops[1]>=stops[0]);
+    delete net;
+}
+
+/**
+ * \brief Check the learning rates given by each EtaSchedule, train on addition
+ * with each of them, and train with wall-clock and CPU time limits (see
+ * Net::SGDParams::setTimeLimit()) rather than for the full number of iterations.
+ */
+
+BOOST_AUTO_TEST_CASE(additionschedule) {
+    Net::SGDParams p(1,1000);
+    BOOST_REQUIRE(p.getEta(500,0.5)==1);
+    p.setSchedule(EtaSchedule::STEP,100,0.5);
+    BOOST_REQUIRE(p.getEta(99,0)==1);
+    BOOST_REQUIRE(p.getEta(100,0)==0.5);
+    BOOST_REQUIRE(p.getEta(250,0)==0.25);
+    p.setSchedule(EtaSchedule::EXPONENTIAL,100,0.5);
+    BOOST_REQUIRE(fabs(p.getEta(50,0)-sqrt(0.5))<1e-12);
+    BOOST_REQUIRE(fabs(p.getEta(200,0)-0.25)<1e-12);
+    p.setSchedule(EtaSchedule::COSINE,0,0.1);
+    BOOST_REQUIRE(fabs(p.getEta(0,0)-1)<1e-12);
+    BOOST_REQUIRE(fabs(p.getEta(0,0.5)-0.55)<1e-12);
+    BOOST_REQUIRE(fabs(p.getEta(0,1)-0.1)<1e-12);
+    // periods of 100, 200, 400...
+    p.setSchedule(EtaSchedule::COSINE_RESTARTS,100,0.1,2);
+    BOOST_REQUIRE(fabs(p.getEta(100,0)-1)<1e-12);
+    BOOST_REQUIRE(fabs(p.getEta(200,0)-0.55)<1e-12);
+    BOOST_REQUIRE(fabs(p.getEta(300,0)-1)<1e-12);
+    BOOST_REQUIRE(fabs(p.getEta(500,0)-0.55)<1e-12);
+    p.setSchedule(EtaSchedule::COSINE_RESTARTS,100,0.1);
+    BOOST_REQUIRE(fabs(p.getEta(350,0)-0.55)<1e-12);
+    
+    ExampleSet e(1000,2,1,1);
+    
+    drand48_data rd;
+    srand48_r(10,&rd);
+    
+    for(int i=0;i<1000;i++){
+        double *ins = e.getInputs(i);
+        double *out = e.getOutputs(i);
+        double a,b;
+        drand48_r(&rd,&a);a*=0.5;
+        drand48_r(&rd,&b);b*=0.5;
+        ins[0] = a;
+        ins[1] = b;
+        *out = a+b;
+    }
+    Net *net = NetFactory::makeNet(NetType::PLAIN,e,2);
+    
+    EtaSchedule schedules[] = {EtaSchedule::STEP,EtaSchedule::EXPONENTIAL,
+        EtaSchedule::COSINE,EtaSchedule::COSINE_RESTARTS};
+    for(int k=0;k<4;k++){
+        Net::SGDParams params(1,1000000);
+        params.storeBest().setSeed(0).setSchedule(schedules[k],100000,0.1);
+        double mse = net->trainSGD(e,params);
+        printf("%d %f\n",k,mse);
+        BOOST_REQUIRE(mse<0.03);
+    }
+    
+    // stop after a fifth of a second, well short of the iterations
+    for(int cpu=0;cpu<2;cpu++){
+        Net::SGDParams params(1,1000000000);
+        params.setSeed(0)
+              .setSchedule(EtaSchedule::COSINE,0,0.1)
+              .setTimeLimit(0.2,cpu==1);
+        auto t0 = std::chrono::steady_clock::now();
+        double mse = net->trainSGD(e,params);
+        double t = std::chrono::duration<double>(std::chrono::steady_clock::now()-t0).count();
+        printf("%f %d %f\n",mse,params.stoppedAt,t);
+        BOOST_REQUIRE(mse<0.03);
+        BOOST_REQUIRE(params.stoppedAt<1000000000);
+        BOOST_REQUIRE(t>=0.2 && t<2);
+    }
+    delete net;
+}
+
+/**
+ * \brief Train UESMANN networks on addition and scaled addition (as in
+ * additionbatchthreads) with each optimizer (see Net::SGDParams::setOptimizer()),
+ * one example at a time and in mini-batches, until the error reaches a target.
+ * All should learn the task, and Adam should get there in far fewer iterations
+ * than plain gradient descent. Also check that splitting batches across threads
+ * still gives the same network each time, and that networks which can't use an
+ * optimizer say so.
+ */
+
+BOOST_AUTO_TEST_CASE(additionoptimizers) {
+    ExampleSet e(1000,2,1,2);
+
+    drand48_data rd;
+    srand48_r(10,&rd);
+
+    for(int i=0;i<1000;i++){
+        double *ins = e.getInputs(i);
+        double *out = e.getOutputs(i);
+        double a,b;
+        drand48_r(&rd,&a);a*=0.5;
+        drand48_r(&rd,&b);b*=0.5;
+        ins[0] = a;
+        ins[1] = b;
+        e.setH(i,i%2);
+        *out = (i%2) ? (a+b)*0.3 : a+b;
+    }
+
+    Optimizer opts[] = {Optimizer::SGD,Optimizer::MOMENTUM,Optimizer::NESTEROV,
+        Optimizer::RMSPROP,Optimizer::ADAM};
+    double etas[] = {1,0.1,0.1,0.01,0.01};
+    for(int batch=1;batch<=8;batch*=8){
+        int stops[5];
+        for(int o=0;o<5;o++){
+            Net *net = NetFactory::makeNet(NetType::UESMANN,e,4);
+            Net::SGDParams params(etas[o],1000000);
+            params.setSeed(0)
+                  .setShuffle(ExampleSet::ALTERNATE)
+                  .setBatchSize(batch)
+                  .setOptimizer(opts[o])
+                  .setStopError(0.001);
+            double mse = net->trainSGD(e,params);
+            stops[o] = params.stoppedAt;
+            printf("%d %d %f %d\n",batch,o,mse,stops[o]);
+            BOOST_REQUIRE(mse<0.002);
+            delete net;
+        }
+        BOOST_REQUIRE(stops[4]<stops[0]/4);
+    }
+
+    double mses[2];
+    for(int k=0;k<2;k++){
+        Net *net = NetFactory::makeNet(NetType::UESMANN,e,4);
+        Net::SGDParams params(0.01,100000);
+        params.setSeed(0)
+              .setBatchSize(64)
+              .setBatchThreads(3)
+              .setOptimizer(Optimizer::ADAM);
+        mses[k] = net->trainSGD(e,params);
+        delete net;
+    }
+    printf("%f %f\n",mses[0],mses[1]);
+    BOOST_REQUIRE(mses[0]==mses[1]);
+    BOOST_REQUIRE(mses[0]<0.03);
+
+    // the workers of several training threads would have to share the state
+    Net *n = NetFactory::makeNet(NetType::UESMANN,e,4);
+    Net::SGDParams params(0.01,1000);
+    params.setThreads(2).setOptimizer(Optimizer::ADAM);
+    BOOST_REQUIRE_THROW(n->trainSGD(e,params),std::logic_error);
+    delete n;
+
+    // and output blending networks can't use optimizers at all
+    n = NetFactory::makeNet(NetType::OUTPUTBLENDING,e,4);
+    Net::SGDParams params2(0.01,1000);
+    params2.setOptimizer(Optimizer::MOMENTUM);
+    BOOST_REQUIRE_THROW(n->trainSGD(e,params2),std::logic_error);
+    delete n;
+}
+
+/**
+ * \brief As the addition test, but with a single-precision network and
+ * examples converted from a double example set.
+ */
+
+BOOST_AUTO_TEST_CASE(additionfloat) {
+    ExampleSet e(1000,2,1,1);
+    
+    drand48_data rd;
+    srand48_r(10,&rd);
+    
+    for(int i=0;i<1000;i++){
+        double *ins = e.getInputs(i);
+        double *out = e.getOutputs(i);
+        double a,b;
+        drand48_r(&rd,&a);a*=0.5;
+        drand48_r(&rd,&b);b*=0.5;
+        ins[0] = a;
+        ins[1] = b;
+        *out = a+b;
+    }
+    
+    // convert the examples to floats, and make a float network
+    ExampleSetT<float> ef(e);
+    NetT<float> *net = NetFactory::makeNet(NetType::PLAIN,ef,2);
+    
+    NetT<float>::SGDParams params(1,10000000);
+    params.crossValidation(ef,0.5,1000,10,false)
+          .storeBest()
+          .setSeed(0);
+    
+    double mse = net->trainSGD(ef,params);
+    printf("%f\n",mse);
+    BOOST_REQUIRE(mse<0.03);
+    
+    // as in additionmod, keep away from the ends where the nodes saturate
+    for(float a=0.1;a<0.4;a+=0.02){
+        for(float b=0.1;b<0.4;b+=0.02){
+            float runIns[2];
+            runIns[0]=a;
+            runIns[1]=b;
+            float out = *(net->run(runIns));
+            float diff = fabs(out-(a+b));
+            BOOST_REQUIRE(diff<0.05);
+        }
+    }
+    delete net;
+}
+
 //! [additionmod]
 
 /**
@@ -342,13 +962,17 @@ BOOST_AUTO_TEST_CASE(trainmnist){
     MNIST mtest("../testdata/t10k-labels-idx1-ubyte","../testdata/t10k-images-idx3-ubyte");
     ExampleSet testSet(mtest);
     
+    // run the whole test set through the network in one go, getting a
+    // row of outputs for each example
+    int nout = testSet.getOutputCount();
+    double *outs = new double[testSet.getCount()*nout];
+    n->runBatch(testSet,0,testSet.getCount(),outs);
+    
     // and test against the test set, recording how many are good.
     int correct=0;
     for(int i=0;i<testSet.getCount();i++){
-        // for each test, get the inputs
-        double *ins = testSet.getInputs(i);
-        // run them through the network and get the outputs
-        double *o = n->run(ins);
+        // get the network's outputs for this example
+        double *o = outs+i*nout;
         // find the correct label by getting the highest output in the example
         int correctLabel = getHighest(testSet.getOutputs(i),testSet.getOutputCount());
         // find the network's result by getting its highest output 
@@ -361,12 +985,89 @@ BOOST_AUTO_TEST_CASE(trainmnist){
     // we've not trained for long so this isn't going to be brilliant performance.
     double ratio = ((double)correct)/(double)testSet.getCount();
     printf("MSE=%f, correct=%d/%d=%f\n",mse,correct,testSet.getCount(),ratio);
+    delete [] outs;
     // assert that it's at least 85%
     BOOST_REQUIRE(ratio>0.85);
     delete n;
 }
 //! [trainmnist]
 
+/**
+ * \brief Train for MNIST from a COMPACT example set (see ExampleSetBase::Storage),
+ * which keeps the images as bytes, and check that the training is exactly that from
+ * the ordinary FULL set: both in mini-batches, where the pixels are converted straight
+ * into the input layer and the output errors worked out from the labels, and one
+ * example at a time.
+ */
+BOOST_AUTO_TEST_CASE(trainmnistcompact){
+    MNIST m("../testdata/train-labels-idx1-ubyte","../testdata/train-images-idx3-ubyte");
+    ExampleSet full(m);
+    ExampleSet compact(m,ExampleSet::COMPACT);
+    
+    for(int batchSize: {16,1}){
+        Net::SGDParams params(0.1,2000);
+        params.crossValidation(full,0.5,500,10,true)
+              .storeBest()
+              .setBatchSize(batchSize)
+              .setSeed(10);
+        
+        Net *nf = NetFactory::makeNet(NetType::PLAIN,full,16);
+        Net *nc = NetFactory::makeNet(NetType::PLAIN,compact,16);
+        double msef = nf->trainSGD(full,params);
+        double msec = nc->trainSGD(compact,params);
+        printf("batch %d: MSE full=%f, compact=%f\n",batchSize,msef,msec);
+        BOOST_REQUIRE(msef==msec);
+        
+        int n = nf->getDataSize();
+        std::vector<double> df(n),dc(n);
+        nf->save(df.data());
+        nc->save(dc.data());
+        BOOST_REQUIRE(df==dc);
+        delete nf;
+        delete nc;
+    }
+}
+
+/**
+ * \brief Train for MNIST as in trainmnist, but in four threads at once
+ * ("Hogwild!" training, see Net::SGDParams::threads), which should do as well.
+ * Also check that networks which can't be trained in threads say so.
+ */
+BOOST_AUTO_TEST_CASE(trainmnistthreads){
+    MNIST m("../testdata/train-labels-idx1-ubyte","../testdata/train-images-idx3-ubyte");
+    ExampleSet e(m);
+    Net *n = NetFactory::makeNet(NetType::PLAIN,e,16);
+    
+    Net::SGDParams params(0.1,10000);
+    params.crossValidation(e,0.5,1000,10,true)
+          .storeBest()
+          .setSeed(10)
+          .setThreads(4);
+    double mse = n->trainSGD(e,params);
+    BOOST_REQUIRE(mse<0.03);
+    
+    MNIST mtest("../testdata/t10k-labels-idx1-ubyte","../testdata/t10k-images-idx3-ubyte");
+    ExampleSet testSet(mtest);
+    int nout = testSet.getOutputCount();
+    double *outs = new double[testSet.getCount()*nout];
+    n->runBatch(testSet,0,testSet.getCount(),outs);
+    int correct=0;
+    for(int i=0;i<testSet.getCount();i++){
+        int correctLabel = getHighest(testSet.getOutputs(i),nout);
+        int netLabel = getHighest(outs+i*nout,nout);
+        if(correctLabel==netLabel)correct++;
+    }
+    double ratio = ((double)correct)/(double)testSet.getCount();
+    printf("MSE=%f, correct=%d/%d=%f\n",mse,correct,testSet.getCount(),ratio);
+    delete [] outs;
+    BOOST_REQUIRE(ratio>0.85);
+    delete n;
+    
+    n = NetFactory::makeNet(NetType::HINPUT,e,16);
+    BOOST_REQUIRE_THROW(n->trainSGD(e,params),std::logic_error);
+    delete n;
+}
+
 /** 
  * @}
  */
@@ -8,6 +8,7 @@
 #include <boost/test/unit_test.hpp>
 
 #include "test.hpp"
+#include "fixednet.hpp"
 
 BOOST_AUTO_TEST_SUITE(booleans)
 
@@ -79,6 +80,123 @@ BOOST_AUTO_TEST_CASE(uesxorand) {
     dotest(NetType::UESMANN);
 }
 
+/**
+ * \brief train a general network and a FixedNet of the same type and shape
+ * on the same examples with the same parameters, and return the largest
+ * difference between their parameters.
+ */
+static double compareFixed(NetType tp,Net *fixed,ExampleSet& e,int batchSize){
+    Net *net = NetFactory::makeNet(tp,e,fixed->getLayerSize(1));
+    Net::SGDParams params(0.1,100000);
+    params.storeBest().setSeed(3).setBatchSize(batchSize);
+    double mse = net->trainSGD(e,params);
+    Net::SGDParams fparams(0.1,100000);
+    fparams.storeBest().setSeed(3).setBatchSize(batchSize);
+    double fmse = fixed->trainSGD(e,fparams);
+    printf("%f %f\n",mse,fmse);
+    
+    BOOST_REQUIRE(net->getDataSize()==fixed->getDataSize());
+    int size = net->getDataSize();
+    double *a = new double[size];
+    double *b = new double[size];
+    net->save(a);
+    fixed->save(b);
+    double maxdiff=0;
+    for(int i=0;i<size;i++){
+        double d = fabs(a[i]-b[i]);
+        if(d>maxdiff)maxdiff=d;
+    }
+    delete [] a;
+    delete [] b;
+    delete net;
+    return maxdiff;
+}
+
+/**
+ * \brief Check that FixedNet trains exactly as UESNet and BPNet do: with
+ * layers this small and the scalar kernels the results should be identical
+ * when training single examples, and almost identical in mini-batches
+ * (where the general networks sum in a different order).
+ */
+BOOST_AUTO_TEST_CASE(fixedxorand) {
+    BooleanExampleSet e;
+    e.add0(0,1,1,0);
+    e.add1(0,0,0,1);
+    
+    KernelLevel old = Kernels::getLevel();
+    Kernels::setLevel(KernelLevel::SCALAR);
+    
+    FixedNet<NetType::UESMANN,2,2,1> ues;
+    BOOST_REQUIRE(compareFixed(NetType::UESMANN,&ues,e,1)==0);
+    BOOST_REQUIRE(booleanTest(&ues,0,  0,1,1)<0.4);
+    BOOST_REQUIRE(booleanTest(&ues,1,  0,1,0)<0.4);
+    
+    FixedNet<NetType::UESMANN,2,2,1> uesbatch;
+    BOOST_REQUIRE(compareFixed(NetType::UESMANN,&uesbatch,e,4)<1e-8);
+    
+    FixedNet<NetType::PLAIN,2,3,1> plain;
+    BOOST_REQUIRE(compareFixed(NetType::PLAIN,&plain,e,1)==0);
+    
+    Kernels::setLevel(old);
+}
+
+/**
+ * \brief Check that training a batch of seeds in lanes with
+ * FixedNetT::trainSGDSeeds() gives the same networks as training each
+ * seed in turn, including a final partly-filled set of lanes, with and
+ * without early stopping, and when snapshotting the best network at
+ * intervals (which falls back to training each seed in turn).
+ */
+BOOST_AUTO_TEST_CASE(fixedseeds) {
+    BooleanExampleSet e;
+    e.add0(0,1,1,0);
+    e.add1(0,0,0,1);
+    
+    KernelLevel old = Kernels::getLevel();
+    Kernels::setLevel(KernelLevel::SCALAR);
+    
+    typedef FixedNet<NetType::UESMANN,2,2,1> FNet;
+    static const int N=10;
+    
+    // the second time round, the networks stop early at different times;
+    // the third, the best networks are snapshotted every 50 iterations
+    for(int mode=0;mode<3;mode++){
+        FNet serial[N],lanes[N];
+        double serialMSE[N],lanesMSE[N];
+        int serialStop[N],lanesStop[N];
+        
+        Net::SGDParams params(0.1,20000);
+        params.storeBest();
+        if(mode==1)
+            params.setEarlyStopping(20,0.001);
+        if(mode==2)
+            params.setBestInterval(50);
+        for(int i=0;i<N;i++){
+            params.setSeed(100+i);
+            serialMSE[i] = serial[i].trainSGD(e,params);
+            serialStop[i] = params.stoppedAt;
+        }
+        params.setSeeds(100,N);
+        FNet::trainSGDSeeds(e,params,lanes,lanesMSE,lanesStop);
+        
+        int stopped=0;
+        for(int i=0;i<N;i++){
+            double a[11],b[11];
+            serial[i].save(a);
+            lanes[i].save(b);
+            for(int j=0;j<11;j++)
+                BOOST_REQUIRE(a[j]==b[j]);
+            BOOST_REQUIRE(serialMSE[i]==lanesMSE[i]);
+            BOOST_REQUIRE(serialStop[i]==lanesStop[i]);
+            if(lanesStop[i]<20000)
+                stopped++;
+        }
+        BOOST_REQUIRE(mode==1 ? stopped>0 : stopped==0);
+    }
+    
+    Kernels::setLevel(old);
+}
+
 /** 
  * @}
  */
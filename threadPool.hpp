@@ -0,0 +1,222 @@
+/**
+ * @file threadPool.hpp
+ * @brief A simple work-stealing thread pool, used to run large numbers of
+ * independent training runs (as in genBoolMap) across several cores.
+ *
+ */
+
+#ifndef __THREADPOOL_HPP
+#define __THREADPOOL_HPP
+
+#include <deque>
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
+#include <exception>
+
+/**
+ * \brief A pool of worker threads which run tasks (any callable with no
+ * arguments). Each worker has its own queue of tasks: tasks submitted
+ * from a worker go onto its own queue, which it runs newest first, and
+ * tasks submitted from elsewhere are dealt out to the queues in turn. A
+ * worker whose queue is empty steals the oldest task from another's.
+ *
+ * Tasks may themselves submit tasks. If a task throws an exception, the
+ * first such exception is rethrown by wait().
+ */
+
+class ThreadPool {
+public:
+    /**
+     * \brief the type of a task
+     */
+    typedef std::function<void()> Task;
+
+    /**
+     * \brief Constructor, which starts the threads
+     * \param nthreads number of worker threads, or 0 for one per core
+     */
+    explicit ThreadPool(int nthreads=0){
+        if(nthreads<=0)
+            nthreads = defaultThreadCount();
+        queued = 0;
+        pending = 0;
+        stopping = false;
+        nextQueue = 0;
+        for(int i=0;i<nthreads;i++)
+            queues.push_back(new Queue);
+        for(int i=0;i<nthreads;i++)
+            threads.push_back(std::thread(&ThreadPool::run,this,i));
+    }
+
+    /**
+     * \brief Destructor, which waits for all the tasks to finish (ignoring
+     * any exceptions) and stops the threads.
+     */
+    ~ThreadPool(){
+        {
+            std::unique_lock<std::mutex> lk(lock);
+            doneCond.wait(lk,[this]{return pending==0;});
+            stopping = true;
+        }
+        workCond.notify_all();
+        for(size_t i=0;i<threads.size();i++)
+            threads[i].join();
+        for(size_t i=0;i<queues.size();i++)
+            delete queues[i];
+    }
+
+    /**
+     * \brief the number of threads to use by default: the number of cores,
+     * or 1 if that can't be found.
+     */
+    static int defaultThreadCount(){
+        int n = std::thread::hardware_concurrency();
+        return n>0 ? n : 1;
+    }
+
+    /**
+     * \brief get the number of worker threads
+     */
+    int getThreadCount() const {
+        return (int)threads.size();
+    }
+
+    /**
+     * \brief add a task to be run by one of the workers
+     */
+    void submit(Task t){
+        // tasks submitted by one of our workers go on its own queue
+        int q;
+        if(currentPool()==this)
+            q = currentWorker();
+        else {
+            std::unique_lock<std::mutex> lk(lock);
+            q = nextQueue;
+            nextQueue = (nextQueue+1)%queues.size();
+        }
+        {
+            std::unique_lock<std::mutex> lk(queues[q]->lock);
+            queues[q]->tasks.push_back(t);
+        }
+        {
+            std::unique_lock<std::mutex> lk(lock);
+            queued++;
+            pending++;
+        }
+        workCond.notify_one();
+    }
+
+    /**
+     * \brief wait until all the tasks submitted so far (and any tasks they
+     * submit) have finished. This must not be called from a task.
+     * \throws the first exception thrown by a task, if any
+     */
+    void wait(){
+        std::unique_lock<std::mutex> lk(lock);
+        doneCond.wait(lk,[this]{return pending==0;});
+        if(error){
+            std::exception_ptr e = error;
+            error = nullptr;
+            std::rethrow_exception(e);
+        }
+    }
+
+private:
+    /**
+     * \brief a worker's queue of tasks
+     */
+    struct Queue {
+        std::mutex lock; //!< lock for the queue
+        std::deque<Task> tasks; //!< the tasks, oldest first
+    };
+
+    std::vector<Queue *> queues; //!< a queue for each worker
+    std::vector<std::thread> threads; //!< the workers
+
+    std::mutex lock; //!< lock for the counts and flags below
+    std::condition_variable workCond; //!< signalled when there is work (or we are stopping)
+    std::condition_variable doneCond; //!< signalled when pending reaches zero
+    int queued; //!< number of tasks in the queues
+    int pending; //!< number of tasks queued or running
+    bool stopping; //!< set to make the workers exit
+    int nextQueue; //!< the queue for the next task submitted from outside
+    std::exception_ptr error; //!< the first exception thrown by a task
+
+    /**
+     * \brief the pool whose worker is running in this thread, if any
+     */
+    static ThreadPool *& currentPool(){
+        static thread_local ThreadPool *p = NULL;
+        return p;
+    }
+
+    /**
+     * \brief the index of the worker running in this thread
+     */
+    static int& currentWorker(){
+        static thread_local int w = -1;
+        return w;
+    }
+
+    /**
+     * \brief get a task to run: the newest on our own queue, or failing
+     * that the oldest on another worker's queue.
+     * \return false if there are none
+     */
+    bool getTask(int self,Task& t){
+        int n = queues.size();
+        for(int i=0;i<n;i++){
+            Queue *q = queues[(self+i)%n];
+            std::unique_lock<std::mutex> lk(q->lock);
+            if(!q->tasks.empty()){
+                if(i==0){
+                    t = q->tasks.back();
+                    q->tasks.pop_back();
+                } else {
+                    t = q->tasks.front();
+                    q->tasks.pop_front();
+                }
+                return true;
+            }
+        }
+        return false;
+    }
+
+    /**
+     * \brief the body of each worker thread
+     */
+    void run(int self){
+        currentPool() = this;
+        currentWorker() = self;
+        for(;;){
+            {
+                std::unique_lock<std::mutex> lk(lock);
+                workCond.wait(lk,[this]{return stopping || queued>0;});
+                if(stopping)
+                    return;
+            }
+            Task t;
+            if(!getTask(self,t))
+                continue; // someone else got it first
+            {
+                std::unique_lock<std::mutex> lk(lock);
+                queued--;
+            }
+            try {
+                t();
+            } catch(...) {
+                std::unique_lock<std::mutex> lk(lock);
+                if(!error)
+                    error = std::current_exception();
+            }
+            std::unique_lock<std::mutex> lk(lock);
+            if(--pending==0)
+                doneCond.notify_all();
+        }
+    }
+};
+
+#endif /* __THREADPOOL_HPP */
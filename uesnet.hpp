@@ -11,10 +11,10 @@
 
 /**
  * \brief The UESMANN network, which it itself based on the BPNet code as it has
- * the same architecture as the plain MLP.
+ * the same architecture as the plain MLP. UESNet is the double version.
  */
 
-class UESNet: public BPNet {
+template <class T> class UESNetT: public BPNetT<T> {
     /**
      * \brief the modulator value, initially 0
      */
@@ -25,11 +25,11 @@ public:
      * \brief The constructor is mostly identical to the BPNet constructor
      */
     
-    UESNet(int nlayers,const int *layerCounts) : BPNet(nlayers,layerCounts),
+    UESNetT(int nlayers,const int *layerCounts) : BPNetT<T>(nlayers,layerCounts),
           modulator(0)
     {
         // replace the net type, it's not a plain net any more
-        type = NetType::UESMANN;
+        this->type = NetType::UESMANN;
         
     }
     
@@ -42,118 +42,128 @@ public:
     }
     
 protected:
+    using BPNetT<T>::numLayers;
+    using BPNetT<T>::layerSizes;
+    using BPNetT<T>::outputs;
+    using BPNetT<T>::errors;
+    using BPNetT<T>::biases;
+    using BPNetT<T>::getwrow;
+    using BPNetT<T>::trainMiniBatch;
     
-    void calcError(double *in,double *out){
+    void calcError(T *in,T *out){
         // first run the network forwards
-        setInputs(in);
+        this->setInputs(in);
         update();
         
         // first, calculate the error in the output layer
         // This does the THIRD of the backprop equations, Eq. 4.15, giving dLj.
         int ol = numLayers-1;
         for(int i=0;i<layerSizes[ol];i++){
-            double o = outputs[ol][i];
+            T o = outputs[ol][i];
             errors[ol][i] = o*(1-o)*(o-out[i]);
         }
         
-        // then work out the errors in all the other layers
-        // factoring in (rather inefficiently) the hormone.
+        // then work out the errors in all the other layers (backwards,
+        // since each needs the errors of the next) factoring in the hormone.
         // This is the FOURTH backprop equation, Eq. 4.16.
-        for(int l=1;l<numLayers-1;l++){
+        for(int l=numLayers-2;l>0;l--){
+            // weighted sum of the next layer's errors, a row at a time
+            T *e = errors[l];
+            for(int j=0;j<layerSizes[l];j++)
+                e[j] = 0;
+            for(int i=0;i<layerSizes[l+1];i++)
+                vecAxpy(errors[l+1][i],getwrow(l+1,i),e,layerSizes[l]);
+            
             for(int j=0;j<layerSizes[l];j++){
-                double e = 0;
-                for(int i=0;i<layerSizes[l+1];i++)
-                    e += errors[l+1][i]*getw(l+1,i,j);
-                
                 // produce the \delta^l_i term where l is the layer and i
                 // the index of the node. Here is where we factor in the modulator.
                 
-                errors[l][j] = e * (modulator+1.0) * outputs[l][j] * (1-outputs[l][j]); 
+                errors[l][j] = e[j] * (modulator+1.0) * outputs[l][j] * (1-outputs[l][j]); 
             }
         }
     }
     
     virtual void update(){
-        double hfactor = modulator+1.0;
+        T hfactor = modulator+1.0;
         for(int i=1;i<numLayers;i++){
             for(int j=0;j<layerSizes[i];j++){
-                double v = 0.0;
-                for(int k=0;k<layerSizes[i-1];k++){
-                    v += getw(i,j,k) * outputs[i-1][k];
-                }
+                T v = vecDot(getwrow(i,j),outputs[i-1],layerSizes[i-1]);
                 // factor in the hormone here
-                outputs[i][j]=sigmoid(v*hfactor+biases[i][j]);
+                outputs[i][j] = v*hfactor+biases[i][j];
             }
+            activate(this->sigmoidMode,outputs[i],layerSizes[i]);
         }
     }
     
-    virtual double trainBatch(ExampleSet& ex,int start,int num,double eta){
-        // zero average gradients
-        for(int j=0;j<numLayers;j++){
-            for(int k=0;k<layerSizes[j];k++)
-                gradAvgsBiases[j][k]=0;
-            for(int i=0;i<largestLayerSize*largestLayerSize;i++)
-                gradAvgsWeights[j][i]=0;
-        }
-        
-        // reset total error
-        double totalError=0;
-        // iterate over examples
-        for(int nn=0;nn<num;nn++){
-            int exampleIndex = nn+start;
-            // set modulator
-            setH(ex.getH(exampleIndex));
-            // get outputs for this example
-            double *outs = ex.getOutputs(exampleIndex);
-            // build errors for each example
-            calcError(ex.getInputs(exampleIndex),outs);
-            
-            // accumulate errors
-            for(int l=1;l<numLayers;l++){
-                for(int i=0;i<layerSizes[l];i++){
-                    // this does the FIRST of the backprop equations, 
-                    // Eq. 4.13, calculating dC/dw(h+1), but the modulator
-                    // is dealt with below.
-                    for(int j=0;j<layerSizes[l-1];j++)
-                        getavggradw(l,i,j) += errors[l][i]*outputs[l-1][j];
-                    // this does the SECOND of the backprop equations,
-                    // Eq. 4.14.
-                    gradAvgsBiases[l][i] += errors[l][i];
-                }
-            }
-            // count up the total error
-            int ol = numLayers-1;
-            for(int i=0;i<layerSizes[ol];i++){
-                double o = outputs[ol][i];
-                double e = (o-outs[i]);
-                totalError += e*e;
-            }
-        }
+    /**
+     * \brief Train on a single example without using the gradient
+     * accumulators - see BPNet::trainSingle(). This gives the same
+     * result as going through the accumulators with a single example,
+     * bit for bit with the scalar kernels.
+     */
+    double trainSingle(ExampleSetT<T>& ex,int idx,double eta){
+        // set modulator
+        setH(ex.getH(idx));
+        // get outputs for this example
+        T *outs = ex.getOutputs(idx);
+        // build errors
+        calcError(ex.getInputs(idx),outs);
         
         // get modulator factor
         double hfactor = modulator+1.0;
         
-        
-        // for calculating average error - 1/number of examples trained
-        double factor = 1.0/(double)num;
-        // we now have a full set of running averages. Time to apply them.
         for(int l=1;l<numLayers;l++){
             for(int i=0;i<layerSizes[l];i++){
-                for(int j=0;j<layerSizes[l-1];j++){
-                    // this does the modulation part of Eq. 4.13, but a little
-                    // later than in the thesis.
-                    double wdelta = eta*getavggradw(l,i,j)*factor*hfactor;
-                    //                    printf("WCORR: %f factor %f\n",wdelta,getavggradw(l,i,j));
-                    getw(l,i,j) -= wdelta;
-                }
-                // biases are not modulated
-                double bdelta = eta*gradAvgsBiases[l][i]*factor;
-                biases[l][i] -= bdelta;
+                T e = errors[l][i];
+                // Eq. 4.13 with the modulation applied, as in trainBatch()
+                vecDelta((T)eta,e,(T)hfactor,outputs[l-1],getwrow(l,i),layerSizes[l-1]);
+                // biases are not modulated (Eq. 4.14)
+                biases[l][i] -= eta*e;
             }
         }
-        // and return total error - this is the SUM of the MSE of each output
-        return totalError*factor;
+        
+        // count up the total error
+        double totalError=0;
+        int ol = numLayers-1;
+        for(int i=0;i<layerSizes[ol];i++){
+            T o = outputs[ol][i];
+            T e = (o-outs[i]);
+            totalError += e*e;
+        }
+        return totalError;
+    }
+    
+    /**
+     * \brief The weights are multiplied by (h+1). In batch training this also
+     * does the modulation part of Eq. 4.13 (dC/dw(h+1)) for each example.
+     */
+    virtual double modFactor(double h) const {
+        return h+1.0;
+    }
+    
+    virtual NetT<T> *makeWorker(){
+        UESNetT *w = new UESNetT(numLayers,layerSizes);
+        w->shareParams(this);
+        return w;
+    }
+    
+    virtual NetT<T> *makeSimilar() const {
+        return new UESNetT(numLayers,layerSizes);
+    }
+    
+    virtual double trainBatch(ExampleSetT<T>& ex,int start,int num,double eta){
+        // a single example (i.e. SGD) can skip the accumulators, unless
+        // the optimizer needs the gradients
+        if(num==1 && !this->optimizerState)
+            return trainSingle(ex,start,eta);
+        else
+            return trainMiniBatch(ex,start,num,eta);
     }
 };
 
+/**
+ * \brief the double-precision UESMANN network
+ */
+typedef UESNetT<double> UESNet;
+
 #endif /* __UESNET_HPP */